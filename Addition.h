@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Expression.h"
+#include "Build.h"
 
 template<typename T>
 class Addition : public Expression<T> {
@@ -9,7 +10,7 @@ private:
 	ExpressionPtr<T> b;
 public:
 
-	Addition(ExpressionPtr<T> a, ExpressionPtr<T> b) : a(a), b(b) {}
+	Addition(ExpressionPtr<T> a, ExpressionPtr<T> b) : Expression<T>(ExpressionType::Addition, 0, a.get(), b.get()), a(a), b(b) {}
 
 	T evaluate(T x, T y) const override;
 
@@ -23,7 +24,15 @@ public:
 
 	bool isConstant() const override { return a->isConstant() && b->isConstant(); }
 
-	ExpressionPtr<T> mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+	ExpressionPtr<T> mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+
+	static const ExpressionType Type = ExpressionType::Addition;
+
+	ExpressionType type() const override { return Type; }
+
+	int childCount() const override { return 2; }
+
+	ExpressionPtr<T> child(int i) const override { return i == 0 ? a : b; }
 };
 #define AdditionPtr(T, a, b) ExpressionPtr<T>(new Addition<T>(a, b))
 #define AdditionPtrf(a, b) AdditionPtr(float, a, b)
@@ -40,7 +49,7 @@ template<typename T>
 inline ExpressionPtr<T> Addition<T>::derivative(int dimension) const {
 	auto aPrime = a->derivative(dimension);
 	auto bPrime = b->derivative(dimension);
-	return AdditionPtr(T, aPrime, bPrime);
+	return Build::add(aPrime, bPrime);
 }
 
 template<typename T>
@@ -62,12 +71,15 @@ inline ExpressionPtr<T> Addition<T>::simplify() const {
 }
 
 template<typename T>
-inline ExpressionPtr<T> Addition<T>::mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
+inline ExpressionPtr<T> Addition<T>::mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
 	TREE_MUTATION();
 	auto newA = a->mutate(rng, mutationChance, treeMutationChance, grammar, false);
 	auto newB = b->mutate(rng, mutationChance, treeMutationChance, grammar, false);
 	if (MUTATION) {
 		return grammar->instantiateOperation(newA, newB, rng);
 	}
+	if (newA == a && newB == b) {
+		return this->self(); // nothing changed, keep sharing the same node
+	}
 	return AdditionPtr(T, newA, newB);
 }
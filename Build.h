@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cmath>
+#include "Expression.h"
+
+template<typename T> class Addition;
+template<typename T> class Subtraction;
+template<typename T> class Multiplication;
+template<typename T> class Division;
+template<typename T> class Power;
+
+
+/// Constructors of operation nodes that simplify as they build, used by derivatives so that they come out near minimal without calling simplify()
+/// Operands that are constant nodes are folded into a single constant, and neutral or absorbing constants (0 and 1) are eliminated;
+/// unlike simplify(), constant sub-trees that aren't a single constant node are left alone, and nothing is folded into a division by zero or a non-finite value,
+/// so that the expressions built are invalid exactly where the original ones were (except for 0 * f and f^0, which are folded even where f is invalid, as in simplify())
+
+
+namespace Build {
+
+	/**
+	 * Returns whether an expression is a constant node, and its value if so
+	 */
+	template<typename T>
+	inline bool constant(const std::shared_ptr<Expression<T>>& e, T& value) {
+		if (e->type() != ExpressionType::Constant) return false;
+		value = e->value();
+		return true;
+	}
+
+	/**
+	 * Returns a constant node with the given value, or nullptr if the value isn't finite, in which case the operation is built as is
+	 */
+	template<typename T>
+	inline std::shared_ptr<Expression<T>> folded(T value) {
+		return std::isfinite(value) ? ConstantPtr(T, value) : nullptr;
+	}
+
+	template<typename T>
+	inline std::shared_ptr<Expression<T>> multiply(const std::shared_ptr<Expression<T>>& a, const std::shared_ptr<Expression<T>>& b);
+
+	/**
+	 * a + b
+	 */
+	template<typename T>
+	inline std::shared_ptr<Expression<T>> add(const std::shared_ptr<Expression<T>>& a, const std::shared_ptr<Expression<T>>& b) {
+		T va, vb;
+		bool ca = constant(a, va), cb = constant(b, vb);
+		if (ca && cb) {
+			if (auto c = folded(va + vb)) return c;
+		}
+		if (ca && va == 0) return b;
+		if (cb && vb == 0) return a;
+		return std::shared_ptr<Expression<T>>(new Addition<T>(a, b)); // not the AdditionPtr macro, which may not be defined yet when this header is included
+	}
+
+	/**
+	 * a - b
+	 */
+	template<typename T>
+	inline std::shared_ptr<Expression<T>> subtract(const std::shared_ptr<Expression<T>>& a, const std::shared_ptr<Expression<T>>& b) {
+		T va, vb;
+		bool ca = constant(a, va), cb = constant(b, vb);
+		if (ca && cb) {
+			if (auto c = folded(va - vb)) return c;
+		}
+		if (cb && vb == 0) return a;
+		if (ca && va == 0) return multiply<T>(ConstantPtr(T, -1), b);
+		return std::shared_ptr<Expression<T>>(new Subtraction<T>(a, b));
+	}
+
+	/**
+	 * a * b; constant factors are gathered on the left, and folded with the constant factor of a product they multiply, e.g. 2 * (3 * x) = 6 * x
+	 */
+	template<typename T>
+	inline std::shared_ptr<Expression<T>> multiply(const std::shared_ptr<Expression<T>>& a, const std::shared_ptr<Expression<T>>& b) {
+		T va, vb;
+		bool ca = constant(a, va), cb = constant(b, vb);
+		if (ca && cb) {
+			if (auto c = folded(va * vb)) return c;
+		}
+		if ((ca && va == 0) || (cb && vb == 0)) return ConstantPtr(T, 0);
+		if (ca && va == 1) return b;
+		if (cb && vb == 1) return a;
+		if (cb && !ca) return multiply<T>(b, a);
+		T vc;
+		if (ca && b->type() == ExpressionType::Multiplication && constant(b->child(0), vc)) {
+			if (auto c = folded(va * vc)) return multiply<T>(c, b->child(1));
+		}
+		return std::shared_ptr<Expression<T>>(new Multiplication<T>(a, b));
+	}
+
+	/**
+	 * a / b
+	 */
+	template<typename T>
+	inline std::shared_ptr<Expression<T>> divide(const std::shared_ptr<Expression<T>>& a, const std::shared_ptr<Expression<T>>& b) {
+		T va, vb;
+		bool ca = constant(a, va), cb = constant(b, vb);
+		if (cb && vb != 0) {
+			if (ca) {
+				if (auto c = folded(va / vb)) return c;
+			}
+			if (vb == 1) return a;
+		}
+		return std::shared_ptr<Expression<T>>(new Division<T>(a, b));
+	}
+
+	/**
+	 * a ^ b
+	 */
+	template<typename T>
+	inline std::shared_ptr<Expression<T>> power(const std::shared_ptr<Expression<T>>& a, const std::shared_ptr<Expression<T>>& b) {
+		T va, vb;
+		bool ca = constant(a, va), cb = constant(b, vb);
+		if (ca && cb) { // folded only where the power is valid, which depends on its kernel (see Power::evaluate)
+			std::shared_ptr<Expression<T>> p(new Power<T>(a, b));
+			try {
+				if (auto c = folded(p->evaluate(0, 0))) return c;
+			} catch (...) {}
+			return p;
+		}
+		if (cb && vb == 0) return ConstantPtr(T, 1); // a^0 is 1 even for a = 0 (see integerPower)
+		if (cb && vb == 1) return a;
+		return std::shared_ptr<Expression<T>>(new Power<T>(a, b));
+	}
+
+};
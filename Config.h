@@ -0,0 +1,333 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include "DuplicatePolicy.h"
+#include "TreeCrossover.h"
+
+
+/**
+ * Runtime settings, given as key=value pairs on the command line (--key=value) or in configuration files (one pair per line, # starts a comment)
+ * A configuration file is loaded with --config=path; settings given later override earlier ones
+ * A value can be a comma-separated list of values, e.g. to run the same problems with several parameter sets (see combinations())
+ */
+class Config {
+private:
+
+	/**
+	 * Settings in the order they were first given, each with its list of values
+	 */
+	std::vector<std::pair<std::string, std::vector<std::string>>> entries;
+
+public:
+
+	/**
+	 * Sets the values of a setting from a comma-separated list
+	 */
+	void set(const std::string& key, const std::string& values);
+
+	/**
+	 * Reads settings from command line arguments of the form --key=value, or --key for boolean flags
+	 */
+	void parseArguments(int argc, char** argv);
+
+	/**
+	 * Reads settings from a file with one key=value pair per line
+	 */
+	void parseFile(const std::string& filename);
+
+	/**
+	 * Returns whether the setting was given
+	 */
+	bool has(const std::string& key) const;
+
+	/**
+	 * Returns all values of a setting, or an empty list if it was not given
+	 */
+	const std::vector<std::string>& values(const std::string& key) const;
+
+	/**
+	 * Returns the (first) value of a setting, or the given default value if it was not given
+	 */
+	std::string get(const std::string& key, const std::string& defaultValue) const;
+
+	/**
+	 * Returns the (first) value of a setting as an integer within [min, max], or the given default value if it was not given; throws if the value is invalid
+	 */
+	int getInt(const std::string& key, int defaultValue, int min = INT_MIN, int max = INT_MAX) const;
+
+	/**
+	 * Returns every combination of values of the given settings, as lists of key=value pairs (a single empty combination if none of the settings was given)
+	 */
+	std::vector<std::vector<std::pair<std::string, std::string>>> combinations(const std::vector<std::string>& keys) const;
+
+	/**
+	 * Returns the settings that were given but are not part of the given list of known settings
+	 */
+	std::vector<std::string> unknownKeys(const std::vector<std::string>& knownKeys) const;
+
+	/**
+	 * Parses a whole value as an integer (or a number) within [min, max], or within (min, max) if open; throws, naming the setting, if the value is not a number or is out of range
+	 */
+	static int parseInt(const std::string& key, const std::string& value, int min = INT_MIN, int max = INT_MAX);
+	static double parseNumber(const std::string& key, const std::string& value, double min, double max, bool open = false);
+
+private:
+
+	static std::string trim(const std::string& s);
+
+}; // class Config
+
+
+/**
+ * Parameters of a single run of the genetic algorithm
+ */
+struct RunParameters {
+	bool useTrees = true; // whether to use a TreePopulation instead of the grammar-based population
+	int populationSize = 5000;
+	int generations = 5000;
+	float replicationRate = 0.05f;
+	float mutationRate = 0.1f;
+	float randomRate = 0.1f;
+	int chromosomeSize = 50; // grammar-based population only
+	int replicationBias = 25; // tree population only
+	float treeMutationRate = 0.1f; // tree population only
+	float crossoverRate = 0; // tree population only
+	CrossoverMode crossoverMode = CrossoverMode::SizeFair; // tree population only
+	unsigned int crossoverMaxDepth = 0; // tree population only
+	DuplicatePolicy duplicatePolicy = DuplicatePolicy::Share;
+	int checkpointInterval = 0; // number of generations between two checkpoints, or 0 to disable checkpoints
+	double timeLimit = 0; // maximum wall-clock time of the run in seconds, or 0 for no limit
+	double evaluationLimit = 0; // maximum number of fitness evaluations of the run, or 0 for no limit
+	int stagnationLimit = 0; // number of generations without improvement of the best fitness after which the run stops (or restarts), or 0 for no limit
+	bool restartOnStagnation = false; // whether to restart from a new random population instead of stopping when the stagnation limit is reached
+	bool verbose = false; // whether to output console messages each time a new best fit is found
+	bool json = true; // whether to output a json file for the run
+	bool binaryLog = false; // whether to output a binary run log for the run, which can be converted to json with runlog2json
+	bool monitor = false; // whether to publish the progress of the run to shared memory, for the monitor tool
+	bool fastMath = false; // whether to screen candidates with approximated functions, only computing exact fitness values for the best ones (see Fitness::setAccuracy)
+	int collocationPoints = 0; // number of grid points the equation is evaluated at, moved toward the highest residuals of the best candidate (see Fitness::refine), or 0 for the whole grid
+	int refineInterval = 10; // number of generations between two refinements of the collocation points
+
+	/**
+	 * Sets a parameter from its name and textual value; returns false if there is no parameter with that name, and throws if the value is invalid
+	 */
+	bool set(const std::string& key, const std::string& value);
+
+	/**
+	 * Returns the names of all parameters
+	 */
+	static const std::vector<std::string>& keys();
+
+}; // struct RunParameters
+
+
+
+inline void Config::set(const std::string& key, const std::string& values) {
+	std::vector<std::string> list;
+	size_t start = 0;
+	while (true) {
+		size_t end = values.find(',', start);
+		std::string value = trim(values.substr(start, end == std::string::npos ? std::string::npos : end - start));
+		if (!value.empty()) list.push_back(value);
+		if (end == std::string::npos) break;
+		start = end + 1;
+	}
+	for (auto& entry : entries) {
+		if (entry.first == key) {
+			entry.second = list;
+			return;
+		}
+	}
+	entries.push_back({ key, list });
+}
+
+inline void Config::parseArguments(int argc, char** argv) {
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg.compare(0, 2, "--") != 0) {
+			fprintf(stderr, "Invalid argument: %s (expected --key=value)\n", arg.c_str());
+			throw "Invalid command line argument";
+		}
+		size_t equals = arg.find('=');
+		std::string key = arg.substr(2, equals == std::string::npos ? std::string::npos : equals - 2);
+		std::string value = equals == std::string::npos ? "true" : arg.substr(equals + 1);
+		if (key == "config") {
+			parseFile(value);
+		} else {
+			set(key, value);
+		}
+	}
+}
+
+inline void Config::parseFile(const std::string& filename) {
+	std::ifstream f(filename);
+	if (!f.is_open()) {
+		fprintf(stderr, "Could not open configuration file %s\n", filename.c_str());
+		throw "Could not open configuration file";
+	}
+	std::string line;
+	while (std::getline(f, line)) {
+		line = trim(line.substr(0, line.find('#')));
+		if (line.empty()) continue;
+		size_t equals = line.find('=');
+		if (equals == std::string::npos) {
+			fprintf(stderr, "Invalid line in %s: %s (expected key=value)\n", filename.c_str(), line.c_str());
+			throw "Invalid configuration file";
+		}
+		set(trim(line.substr(0, equals)), line.substr(equals + 1));
+	}
+}
+
+inline bool Config::has(const std::string& key) const {
+	for (auto& entry : entries) {
+		if (entry.first == key) return true;
+	}
+	return false;
+}
+
+inline const std::vector<std::string>& Config::values(const std::string& key) const {
+	static const std::vector<std::string> none;
+	for (auto& entry : entries) {
+		if (entry.first == key) return entry.second;
+	}
+	return none;
+}
+
+inline std::string Config::get(const std::string& key, const std::string& defaultValue) const {
+	auto& v = values(key);
+	return v.empty() ? defaultValue : v[0];
+}
+
+inline int Config::getInt(const std::string& key, int defaultValue, int min, int max) const {
+	auto& v = values(key);
+	return v.empty() ? defaultValue : parseInt(key, v[0], min, max);
+}
+
+inline std::vector<std::vector<std::pair<std::string, std::string>>> Config::combinations(const std::vector<std::string>& keys) const {
+	std::vector<std::vector<std::pair<std::string, std::string>>> result(1);
+	for (auto& entry : entries) {
+		bool known = false;
+		for (auto& key : keys) known = known || key == entry.first;
+		if (!known || entry.second.empty()) continue;
+		// every existing combination is repeated once for each value of this setting
+		std::vector<std::vector<std::pair<std::string, std::string>>> expanded;
+		for (auto& combination : result) {
+			for (auto& value : entry.second) {
+				expanded.push_back(combination);
+				expanded.back().push_back({ entry.first, value });
+			}
+		}
+		result.swap(expanded);
+	}
+	return result;
+}
+
+inline std::vector<std::string> Config::unknownKeys(const std::vector<std::string>& knownKeys) const {
+	std::vector<std::string> unknown;
+	for (auto& entry : entries) {
+		bool known = false;
+		for (auto& key : knownKeys) known = known || key == entry.first;
+		if (!known) unknown.push_back(entry.first);
+	}
+	return unknown;
+}
+
+inline int Config::parseInt(const std::string& key, const std::string& value, int min, int max) {
+	char* end;
+	errno = 0;
+	long result = strtol(value.c_str(), &end, 10);
+	if (value.empty() || *end != 0 || errno == ERANGE || result < min || result > max) {
+		fprintf(stderr, "Invalid value for %s: %s (expected an integer between %d and %d)\n", key.c_str(), value.c_str(), min, max);
+		throw "Invalid integer parameter";
+	}
+	return int(result);
+}
+
+inline double Config::parseNumber(const std::string& key, const std::string& value, double min, double max, bool open) {
+	char* end;
+	errno = 0;
+	double result = strtod(value.c_str(), &end);
+	// the negated comparisons also reject nan
+	if (value.empty() || *end != 0 || errno == ERANGE || !(result >= min) || !(result <= max) || (open && (result == min || result == max))) {
+		fprintf(stderr, "Invalid value for %s: %s (expected a number between %g and %g%s)\n", key.c_str(), value.c_str(), min, max, open ? ", excluded" : "");
+		throw "Invalid numeric parameter";
+	}
+	return result;
+}
+
+inline std::string Config::trim(const std::string& s) {
+	size_t start = s.find_first_not_of(" \t\r\n");
+	if (start == std::string::npos) return "";
+	size_t end = s.find_last_not_of(" \t\r\n");
+	return s.substr(start, end - start + 1);
+}
+
+
+
+inline bool RunParameters::set(const std::string& key, const std::string& value) {
+	auto toBool = [&]() -> bool {
+		if (value == "true" || value == "1" || value == "yes") return true;
+		if (value == "false" || value == "0" || value == "no") return false;
+		fprintf(stderr, "Invalid value for %s: %s (expected true or false)\n", key.c_str(), value.c_str());
+		throw "Invalid boolean parameter";
+	};
+	if (key == "useTrees") useTrees = toBool();
+	else if (key == "populationSize") populationSize = Config::parseInt(key, value, 2);
+	else if (key == "generations") generations = Config::parseInt(key, value, 0);
+	else if (key == "replicationRate") replicationRate = float(Config::parseNumber(key, value, 0, 1, true));
+	else if (key == "mutationRate") mutationRate = float(Config::parseNumber(key, value, 0, 1, true));
+	else if (key == "randomRate") randomRate = float(Config::parseNumber(key, value, 0, 1));
+	else if (key == "chromosomeSize") chromosomeSize = Config::parseInt(key, value, 2);
+	else if (key == "replicationBias") replicationBias = Config::parseInt(key, value, 1);
+	else if (key == "treeMutationRate") treeMutationRate = float(Config::parseNumber(key, value, 0, 1));
+	else if (key == "crossoverRate") crossoverRate = float(Config::parseNumber(key, value, 0, 1));
+	else if (key == "crossoverMaxDepth") crossoverMaxDepth = (unsigned int)Config::parseInt(key, value, 0);
+	else if (key == "checkpointInterval") checkpointInterval = Config::parseInt(key, value, 0);
+	else if (key == "timeLimit") timeLimit = Config::parseNumber(key, value, 0, HUGE_VAL);
+	else if (key == "evaluationLimit") evaluationLimit = Config::parseNumber(key, value, 0, HUGE_VAL);
+	else if (key == "stagnationLimit") stagnationLimit = Config::parseInt(key, value, 0);
+	else if (key == "restartOnStagnation") restartOnStagnation = toBool();
+	else if (key == "verbose") verbose = toBool();
+	else if (key == "json") json = toBool();
+	else if (key == "binaryLog") binaryLog = toBool();
+	else if (key == "monitor") monitor = toBool();
+	else if (key == "fastMath") fastMath = toBool();
+	else if (key == "collocationPoints") collocationPoints = Config::parseInt(key, value, 0);
+	else if (key == "refineInterval") refineInterval = Config::parseInt(key, value, 0);
+	else if (key == "crossoverMode") {
+		if (value == "Subtree") crossoverMode = CrossoverMode::Subtree;
+		else if (value == "SizeFair") crossoverMode = CrossoverMode::SizeFair;
+		else {
+			fprintf(stderr, "Invalid crossover mode: %s (expected Subtree or SizeFair)\n", value.c_str());
+			throw "Invalid crossover mode";
+		}
+	}
+	else if (key == "duplicatePolicy") {
+		if (value == "Keep") duplicatePolicy = DuplicatePolicy::Keep;
+		else if (value == "Share") duplicatePolicy = DuplicatePolicy::Share;
+		else if (value == "Replace") duplicatePolicy = DuplicatePolicy::Replace;
+		else {
+			fprintf(stderr, "Invalid duplicate policy: %s (expected Keep, Share or Replace)\n", value.c_str());
+			throw "Invalid duplicate policy";
+		}
+	}
+	else return false;
+	return true;
+}
+
+inline const std::vector<std::string>& RunParameters::keys() {
+	static const std::vector<std::string> keys = {
+		"useTrees", "populationSize", "generations", "replicationRate", "mutationRate", "randomRate", "chromosomeSize",
+		"replicationBias", "treeMutationRate", "crossoverRate", "crossoverMode", "crossoverMaxDepth",
+		"duplicatePolicy", "checkpointInterval", "timeLimit", "evaluationLimit", "stagnationLimit", "restartOnStagnation", "verbose", "json", "binaryLog", "monitor", "fastMath",
+		"collocationPoints", "refineInterval"
+	};
+	return keys;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Expression.h"
+#include "Build.h"
 #include "Multiplication.h"
 #include "Subtraction.h"
 
@@ -11,7 +12,7 @@ private:
 	ExpressionPtr<T> b;
 public:
 
-	Division(ExpressionPtr<T> a, ExpressionPtr<T> b) : a(a), b(b) {}
+	Division(ExpressionPtr<T> a, ExpressionPtr<T> b) : Expression<T>(ExpressionType::Division, 0, a.get(), b.get()), a(a), b(b) {}
 
 	T evaluate(T x, T y) const override;
 
@@ -25,7 +26,15 @@ public:
 
 	bool isConstant() const override { return a->isConstant() && b->isConstant(); }
 
-	ExpressionPtr<T> mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+	ExpressionPtr<T> mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+
+	static const ExpressionType Type = ExpressionType::Division;
+
+	ExpressionType type() const override { return Type; }
+
+	int childCount() const override { return 2; }
+
+	ExpressionPtr<T> child(int i) const override { return i == 0 ? a : b; }
 };
 #define DivisionPtr(T, a, b) ExpressionPtr<T>(new Division<T>(a, b))
 #define DivisionPtrf(a, b) DivisionPtr(float, a, b)
@@ -48,9 +57,12 @@ inline ExpressionPtr<T> Division<T>::derivative(int dimension) const {
 	// f' = (a'b - ab') / b^2
 	auto aPrime = a->derivative(dimension);
 	auto bPrime = b->derivative(dimension);
-	auto aPrimeB = MultiplicationPtr(T, aPrime, b);
-	auto bPrimeA = MultiplicationPtr(T, bPrime, a);
-	return DivisionPtr(T, SubtractionPtr(T, aPrimeB, bPrimeA), MultiplicationPtr(T, b, b));
+	if (bPrime->type() == ExpressionType::Constant && bPrime->value() == 0) {
+		return Build::divide(aPrime, b); // f' = a' / b
+	}
+	auto aPrimeB = Build::multiply(aPrime, b);
+	auto bPrimeA = Build::multiply(bPrime, a);
+	return Build::divide(Build::subtract(aPrimeB, bPrimeA), Build::multiply(b, b));
 }
 
 template<typename T>
@@ -72,12 +84,15 @@ inline ExpressionPtr<T> Division<T>::simplify() const {
 }
 
 template<typename T>
-inline ExpressionPtr<T> Division<T>::mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
+inline ExpressionPtr<T> Division<T>::mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
 	TREE_MUTATION();
 	ExpressionPtr<T> newA = a->mutate(rng, mutationChance, treeMutationChance, grammar, false);
 	ExpressionPtr<T> newB = b->mutate(rng, mutationChance, treeMutationChance, grammar, false);
 	if (MUTATION) {
 		return grammar->instantiateOperation(newA, newB, rng);
 	}
+	if (newA == a && newB == b) {
+		return this->self(); // nothing changed, keep sharing the same node
+	}
 	return DivisionPtr(T, newA, newB);
 }
@@ -0,0 +1,12 @@
+#pragma once
+
+
+/**
+ * How a population deals with individuals whose expression is identical to that of another individual in the same generation
+ * With Replace, replacements aren't checked for duplicates in turn, as random individuals rarely duplicate another one, so a generation may still hold a few copies
+ */
+enum class DuplicatePolicy {
+	Keep, // evaluate every individual, as if they were all different
+	Share, // only evaluate the first copy of each expression, the other copies share its fitness
+	Replace // only evaluate the first copy of each expression, the other copies are replaced with new random individuals
+};
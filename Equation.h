@@ -0,0 +1,686 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <functional>
+#include "Expression.h"
+#include "Program.h"
+#include "FastMath.h"
+#ifndef M_PI
+	#define M_PI 3.14159265358979323846
+#endif
+#ifndef M_E
+	#define M_E 2.71828182845904523536
+#endif
+
+
+/// Differential equations and boundary conditions given as text, e.g. "uxx - ut = 0" or "u(x, 0) = sin(pi * x)"
+/// They are compiled into residuals: postfix programs with the same operations as expression nodes, whose leaves are constants or terms (the coordinates,
+/// the candidate solution u and its derivatives), evaluated over many points at once like the programs of candidates (see Program::evaluate)
+
+
+/**
+ * Values a residual can depend on at each point: the coordinates, and the candidate solution along with its derivatives
+ */
+enum class Term : unsigned char {
+	X, Y, F, Dx, Dy, Dxx, Dyy
+};
+static const int TermCount = 7;
+
+
+/**
+ * Single instruction of a residual: an operation, a constant, or a term
+ */
+template<typename T>
+struct ResidualInstruction {
+	ExpressionType type; // type of the operation, or Constant for the values pushed onto the stack
+	int term; // index of the term pushed (see Term), or -1 for constants and operations
+	T value; // value pushed by constants
+};
+
+
+/**
+ * Compiled expression of the terms of a differential equation, evaluating to 0 where the equation holds
+ * Unlike candidate programs, residuals don't throw: invalid operations give infinities or NaNs, which make the fitness infinite
+ */
+template<typename T>
+class Residual {
+private:
+
+	std::vector<ResidualInstruction<T>> instructions;
+
+	/**
+	 * Bit mask of the terms the residual depends on
+	 */
+	unsigned int usedTerms = 0;
+
+	/**
+	 * Values of the parts of the residual that only depend on the coordinates, at the points given to precompute(), pushed by terms numbered from TermCount
+	 */
+	std::vector<std::vector<T>> precomputed;
+
+public:
+
+	inline Residual() {}
+	inline Residual(const std::vector<ResidualInstruction<T>>& instructions) : instructions(instructions) {
+		for (auto& instruction : instructions) {
+			if (instruction.term >= 0 && instruction.term < TermCount) usedTerms |= 1u << instruction.term;
+		}
+	}
+
+	inline bool empty() const { return instructions.empty(); }
+	inline size_t size() const { return instructions.size(); }
+
+	/**
+	 * Returns whether the residual depends on the given term
+	 */
+	inline bool uses(Term term) const { return (usedTerms >> int(term)) & 1; }
+
+	/**
+	 * Evaluates the parts of the residual that only depend on the coordinates (e.g. the source term of a Poisson equation) once and for all at count points,
+	 * which are then the only points the residual can be evaluated at, in the same order; the results are the same as without precomputing
+	 */
+	void precompute(const T* x, const T* y, size_t count);
+
+	/**
+	 * Evaluates the residual at count points, given one array of count values per term (indexed by Term; arrays of unused terms may be null), into out
+	 */
+	void evaluate(const T* const* terms, size_t count, T* out, FastMath::Accuracy accuracy = FastMath::Accuracy::Exact) const;
+
+	/**
+	 * Evaluates the residual at a single point, given the value of each term (indexed by Term); not available once precomputed
+	 */
+	T evaluate(const T* terms) const;
+
+private:
+
+	/**
+	 * Number of points evaluated together, as in Program
+	 */
+	static const size_t BlockSize = 64;
+
+	void evaluateBlock(const T* const* terms, size_t offset, size_t n, T* out, FastMath::Accuracy accuracy) const;
+
+}; // class Residual
+
+
+/**
+ * Boundary condition given as text, e.g. "u(0, t) = 0": a residual that has to be 0 along the line x = p (dimension 0) or y = p (dimension 1)
+ */
+template<typename T>
+struct BoundaryCondition {
+	int dimension = 0;
+	T p = 0;
+	Residual<T> residual;
+};
+
+
+/**
+ * Parser of equations, boundary conditions and constant expressions
+ *
+ * Expressions are made of numbers, the constants pi and e, the variables x and y (or t, the same as y), the operators + - * / ^ and parentheses,
+ * the functions sin, cos, exp, log and sqrt, and the terms u, ux, uy, uxx, uyy (also written ut, utt, u_x, u_xx..., or u' and u'' for ux and uxx)
+ * Equations are of the form lhs = rhs, or lhs alone for lhs = 0
+ * Terms of boundary conditions give the point at which they are taken, e.g. u(0, t), ux(1, y) or u'(0) for ODEs, and must all be on the same line
+ * Invalid text is reported on stderr, and throws
+ */
+template<typename T>
+class EquationParser {
+private:
+
+	const std::string text;
+	size_t pos = 0;
+	bool boundary; // whether terms must be given a point, as in boundary conditions
+	int dimension = -1; // line of the boundary condition, once one of its terms has given it
+	T point = 0;
+	std::vector<ResidualInstruction<T>> code;
+
+public:
+
+	/**
+	 * Parses a differential equation, e.g. "uxx - ut = 0", into a residual
+	 */
+	static Residual<T> equation(const std::string& text);
+
+	/**
+	 * Parses a boundary condition, e.g. "u(x, 0) = sin(pi * x)"
+	 */
+	static BoundaryCondition<T> boundaryCondition(const std::string& text);
+
+	/**
+	 * Parses an expression that only involves numbers and constants, e.g. "2 * pi", and returns its value
+	 */
+	static T constant(const std::string& text);
+
+private:
+
+	inline EquationParser(const std::string& text, bool boundary) : text(text), boundary(boundary) {}
+
+	void parseEquation();
+	void parseSum();
+	void parseProduct();
+	void parseUnary();
+	void parsePower();
+	void parsePrimary();
+	void parseTerm(Term term);
+
+	/**
+	 * Appends an operation on the code emitted since start, folding it if its operands are constants
+	 */
+	void emit(ExpressionType type, size_t start, size_t second = 0);
+
+	/**
+	 * Returns whether the code emitted between start and end (excluded) is a single constant, and its value if so
+	 */
+	bool isConstant(size_t start, size_t end, T& value) const;
+
+	void emitConstant(T value);
+	void skipSpaces();
+	bool accept(char c);
+	void expect(char c);
+	std::string identifier();
+	void error(const char* message) const;
+
+}; // class EquationParser
+
+
+
+template<typename T>
+inline void Residual<T>::evaluate(const T* const* terms, size_t count, T* out, FastMath::Accuracy accuracy) const {
+	for (size_t start = 0; start < count; start += BlockSize) {
+		size_t n = count - start < BlockSize ? count - start : BlockSize;
+		const T* block[TermCount];
+		for (int k = 0; k < TermCount; ++k) {
+			block[k] = terms[k] ? terms[k] + start : nullptr;
+		}
+		evaluateBlock(block, start, n, out + start, accuracy);
+	}
+}
+
+template<typename T>
+inline void Residual<T>::precompute(const T* x, const T* y, size_t count) {
+	// finds the extent of the code of each sub-expression, and whether it only depends on the coordinates
+	std::vector<size_t> start(instructions.size());
+	std::vector<bool> coordinates(instructions.size());
+	std::vector<size_t> stack;
+	for (size_t i = 0; i < instructions.size(); ++i) {
+		const ResidualInstruction<T>& instruction = instructions[i];
+		start[i] = i;
+		coordinates[i] = instruction.term < 0 || instruction.term == int(Term::X) || instruction.term == int(Term::Y);
+		if (instruction.type != ExpressionType::Constant) {
+			for (int k = 0; k < operandCount(instruction.type); ++k) {
+				size_t operand = stack.back();
+				stack.pop_back();
+				start[i] = start[operand];
+				coordinates[i] = coordinates[i] && coordinates[operand];
+			}
+		}
+		stack.push_back(i);
+	}
+
+	// replaces the largest of these sub-expressions, except single constants and coordinates, with their values
+	const T* terms[TermCount] = { x, y };
+	std::vector<ResidualInstruction<T>> code;
+	std::function<void(size_t)> rewrite = [&](size_t i) {
+		if (coordinates[i] && start[i] < i) {
+			Residual<T> part(std::vector<ResidualInstruction<T>>(instructions.begin() + start[i], instructions.begin() + i + 1));
+			precomputed.emplace_back(count);
+			part.evaluate(terms, count, precomputed.back().data());
+			code.push_back({ ExpressionType::Constant, int(TermCount + precomputed.size() - 1), 0 });
+			return;
+		}
+		if (instructions[i].type != ExpressionType::Constant) {
+			if (operandCount(instructions[i].type) == 2) {
+				rewrite(start[i - 1] - 1);
+			}
+			rewrite(i - 1);
+		}
+		code.push_back(instructions[i]);
+	};
+	precomputed.clear();
+	rewrite(instructions.size() - 1);
+	instructions = code;
+}
+
+template<typename T>
+inline T Residual<T>::evaluate(const T* terms) const {
+	const T* arrays[TermCount];
+	for (int k = 0; k < TermCount; ++k) {
+		arrays[k] = terms + k;
+	}
+	T out;
+	evaluate(arrays, 1, &out);
+	return out;
+}
+
+template<typename T>
+inline void Residual<T>::evaluateBlock(const T* const* terms, size_t offset, size_t n, T* out, FastMath::Accuracy accuracy) const {
+	struct Entry {
+		T v[BlockSize];
+	};
+	thread_local std::vector<Entry> stack;
+	if (stack.size() < instructions.size()) stack.resize(instructions.size());
+	Entry* top = stack.data() - 1;
+	T u[BlockSize], w[BlockSize]; // results of function calls
+
+	for (const ResidualInstruction<T>& instruction : instructions) {
+		switch (instruction.type) {
+		case ExpressionType::Constant:
+			++top;
+			if (instruction.term >= 0) {
+				const T* values = instruction.term < TermCount ? terms[instruction.term] : precomputed[instruction.term - TermCount].data() + offset;
+				for (size_t i = 0; i < n; ++i) top->v[i] = values[i];
+			} else {
+				for (size_t i = 0; i < n; ++i) top->v[i] = instruction.value;
+			}
+			break;
+
+		case ExpressionType::Addition: {
+			const T* b = top->v;
+			T* a = (--top)->v;
+			for (size_t i = 0; i < n; ++i) a[i] += b[i];
+			break;
+		}
+		case ExpressionType::Subtraction: {
+			const T* b = top->v;
+			T* a = (--top)->v;
+			for (size_t i = 0; i < n; ++i) a[i] -= b[i];
+			break;
+		}
+		case ExpressionType::Multiplication: {
+			const T* b = top->v;
+			T* a = (--top)->v;
+			for (size_t i = 0; i < n; ++i) a[i] *= b[i];
+			break;
+		}
+		case ExpressionType::Division: {
+			const T* b = top->v;
+			T* a = (--top)->v;
+			for (size_t i = 0; i < n; ++i) a[i] /= b[i];
+			break;
+		}
+		case ExpressionType::Power: {
+			const T* b = top->v;
+			T* a = (--top)->v;
+			const ResidualInstruction<T>& exponent = (&instruction)[-1];
+			if (exponent.type == ExpressionType::Constant && exponent.term < 0) {
+				// constant exponents, typically u^2, get the same kernels as in Power nodes
+				if (powerKernel(exponent.value) == PowerKernel::Integer) {
+					integerPowers(a, int(exponent.value), u, w, n);
+					for (size_t i = 0; i < n; ++i) a[i] = u[i];
+				} else {
+					FastMath::pow(a, exponent.value, a, n, accuracy);
+				}
+			} else {
+				for (size_t i = 0; i < n; ++i) {
+					a[i] = accuracy == FastMath::Accuracy::Fast ? T(FastMath::pow(double(a[i]), double(b[i]))) : std::pow(a[i], b[i]);
+				}
+			}
+			break;
+		}
+
+		case ExpressionType::Sine:
+		case ExpressionType::Cosine: {
+			T* a = top->v;
+			FastMath::sincos(a, u, w, n, accuracy);
+			const T* result = instruction.type == ExpressionType::Sine ? u : w;
+			for (size_t i = 0; i < n; ++i) a[i] = result[i];
+			break;
+		}
+		case ExpressionType::Exponential:
+			FastMath::exp(top->v, top->v, n, accuracy);
+			break;
+		case ExpressionType::Logarithm:
+			FastMath::log(top->v, top->v, n, accuracy);
+			break;
+		case ExpressionType::SquareRoot: {
+			T* a = top->v;
+			for (size_t i = 0; i < n; ++i) a[i] = std::sqrt(a[i]);
+			break;
+		}
+
+		default: // terms are pushed by Constant instructions
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < n; ++i) out[i] = top->v[i];
+}
+
+
+
+template<typename T>
+inline Residual<T> EquationParser<T>::equation(const std::string& text) {
+	EquationParser<T> parser(text, false);
+	parser.parseEquation();
+	return Residual<T>(parser.code);
+}
+
+template<typename T>
+inline BoundaryCondition<T> EquationParser<T>::boundaryCondition(const std::string& text) {
+	EquationParser<T> parser(text, true);
+	parser.parseEquation();
+	if (parser.dimension < 0) {
+		parser.error("A boundary condition must involve u, e.g. u(0, t) = 0");
+	}
+	BoundaryCondition<T> condition;
+	condition.dimension = parser.dimension;
+	condition.p = parser.point;
+	condition.residual = Residual<T>(parser.code);
+	return condition;
+}
+
+template<typename T>
+inline T EquationParser<T>::constant(const std::string& text) {
+	EquationParser<T> parser(text, false);
+	parser.parseSum();
+	parser.skipSpaces();
+	if (parser.pos < text.size()) {
+		parser.error("Unexpected character");
+	}
+	T value;
+	if (!parser.isConstant(0, parser.code.size(), value)) {
+		parser.error("Expected a constant expression");
+	}
+	return value;
+}
+
+template<typename T>
+inline void EquationParser<T>::parseEquation() {
+	parseSum();
+	if (accept('=')) {
+		size_t second = code.size();
+		parseSum();
+		emit(ExpressionType::Subtraction, 0, second);
+	}
+	skipSpaces();
+	if (pos < text.size()) {
+		error("Unexpected character");
+	}
+}
+
+template<typename T>
+inline void EquationParser<T>::parseSum() {
+	size_t start = code.size();
+	parseProduct();
+	while (true) {
+		size_t second = code.size();
+		if (accept('+')) {
+			parseProduct();
+			emit(ExpressionType::Addition, start, second);
+		} else if (accept('-')) {
+			parseProduct();
+			emit(ExpressionType::Subtraction, start, second);
+		} else {
+			return;
+		}
+	}
+}
+
+template<typename T>
+inline void EquationParser<T>::parseProduct() {
+	size_t start = code.size();
+	parseUnary();
+	while (true) {
+		size_t second = code.size();
+		if (accept('*')) {
+			parseUnary();
+			emit(ExpressionType::Multiplication, start, second);
+		} else if (accept('/')) {
+			parseUnary();
+			emit(ExpressionType::Division, start, second);
+		} else {
+			return;
+		}
+	}
+}
+
+template<typename T>
+inline void EquationParser<T>::parseUnary() {
+	// unary minus binds less tightly than powers, so -x^2 is -(x^2)
+	if (accept('-')) {
+		size_t start = code.size();
+		parseUnary();
+		size_t second = code.size();
+		emitConstant(-1);
+		emit(ExpressionType::Multiplication, start, second);
+	} else if (accept('+')) {
+		parseUnary();
+	} else {
+		parsePower();
+	}
+}
+
+template<typename T>
+inline void EquationParser<T>::parsePower() {
+	size_t start = code.size();
+	parsePrimary();
+	if (accept('^')) {
+		size_t second = code.size();
+		parseUnary(); // right associative, and allows negative exponents such as x^-2
+		emit(ExpressionType::Power, start, second);
+	}
+}
+
+template<typename T>
+inline void EquationParser<T>::parsePrimary() {
+	skipSpaces();
+	if (pos >= text.size()) {
+		error("Unexpected end of expression");
+	}
+	if (accept('(')) {
+		parseSum();
+		expect(')');
+		return;
+	}
+	char c = text[pos];
+	if (isdigit((unsigned char)c) || c == '.') {
+		const char* begin = text.c_str() + pos;
+		char* end;
+		T value = T(strtod(begin, &end));
+		pos += end - begin;
+		emitConstant(value);
+		return;
+	}
+
+	size_t namePos = pos;
+	std::string name = identifier();
+	if (name.empty()) {
+		error("Unexpected character");
+	}
+	if (name == "pi") return emitConstant(T(M_PI));
+	if (name == "e") return emitConstant(T(M_E));
+	if (name == "x") return code.push_back({ ExpressionType::Constant, int(Term::X), 0 });
+	if (name == "y" || name == "t") return code.push_back({ ExpressionType::Constant, int(Term::Y), 0 });
+
+	ExpressionType function = ExpressionType::Constant;
+	if (name == "sin") function = ExpressionType::Sine;
+	else if (name == "cos") function = ExpressionType::Cosine;
+	else if (name == "exp") function = ExpressionType::Exponential;
+	else if (name == "log" || name == "ln") function = ExpressionType::Logarithm;
+	else if (name == "sqrt") function = ExpressionType::SquareRoot;
+	if (function != ExpressionType::Constant) {
+		size_t start = code.size();
+		expect('(');
+		parseSum();
+		expect(')');
+		emit(function, start);
+		return;
+	}
+
+	// terms: u followed by the variables of its derivative, e.g. uxx or u_xx, or by primes for derivatives in x
+	if (name[0] == 'u') {
+		std::string variables;
+		for (size_t i = 1; i < name.size(); ++i) {
+			if (name[i] == '\'') variables += 'x';
+			else if (name[i] != '_') variables += name[i] == 't' ? 'y' : name[i];
+		}
+		if (variables.find_first_not_of("xy") == std::string::npos) {
+			if (variables.size() > 2) {
+				pos = namePos;
+				error("Only derivatives up to the second order are supported");
+			}
+			if (variables == "xy" || variables == "yx") {
+				pos = namePos;
+				error("Mixed derivatives are not supported");
+			}
+			Term terms[] = { Term::F, variables[0] == 'x' ? Term::Dx : Term::Dy, variables[0] == 'x' ? Term::Dxx : Term::Dyy };
+			parseTerm(terms[variables.size()]);
+			return;
+		}
+	}
+	pos = namePos;
+	error("Unknown name");
+}
+
+template<typename T>
+inline void EquationParser<T>::parseTerm(Term term) {
+	size_t termPos = pos;
+	if (!accept('(')) {
+		if (boundary) {
+			error("Terms of boundary conditions must give the point at which they are taken, e.g. u(0, t)");
+		}
+		code.push_back({ ExpressionType::Constant, int(term), 0 });
+		return;
+	}
+
+	// each argument is either the variable of its dimension, or a constant giving the line of a boundary condition
+	int line = -1;
+	T value = 0;
+	int arguments = 0;
+	do {
+		if (arguments == 2) {
+			error("Terms take at most two arguments, x and y");
+		}
+		skipSpaces();
+		size_t argumentPos = pos;
+		std::string name = identifier();
+		skipSpaces();
+		bool variable = (name == "x" && arguments == 0) || ((name == "y" || name == "t") && arguments == 1);
+		if (!variable || (pos < text.size() && text[pos] != ',' && text[pos] != ')')) {
+			pos = argumentPos;
+			size_t start = code.size();
+			parseSum();
+			if (!isConstant(start, code.size(), value)) {
+				pos = argumentPos;
+				error(arguments == 0 ? "Expected x or a constant" : "Expected y, t or a constant");
+			}
+			code.resize(start);
+			if (line >= 0) {
+				pos = argumentPos;
+				error("Terms can only be taken on a line, with a single constant argument");
+			}
+			line = arguments;
+		}
+		++arguments;
+	} while (accept(','));
+	expect(')');
+
+	if (!boundary) {
+		if (line >= 0) {
+			pos = termPos;
+			error("Terms of the equation are taken at every point, e.g. u(x, t)");
+		}
+	} else {
+		if (line < 0) {
+			pos = termPos;
+			error("Terms of boundary conditions must be taken at a constant point on one of their arguments, e.g. u(0, t)");
+		}
+		if (dimension >= 0 && (dimension != line || point != value)) {
+			pos = termPos;
+			error("All terms of a boundary condition must be taken on the same line");
+		}
+		dimension = line;
+		point = value;
+	}
+	code.push_back({ ExpressionType::Constant, int(term), 0 });
+}
+
+template<typename T>
+inline void EquationParser<T>::emit(ExpressionType type, size_t start, size_t second) {
+	T a = 0, b = 0;
+	bool unary = second == 0;
+	if (isConstant(start, unary ? code.size() : second, a) && (unary || isConstant(second, code.size(), b))) {
+		T value = 0;
+		switch (type) {
+		case ExpressionType::Addition: value = a + b; break;
+		case ExpressionType::Subtraction: value = a - b; break;
+		case ExpressionType::Multiplication: value = a * b; break;
+		case ExpressionType::Division: value = a / b; break;
+		case ExpressionType::Power: value = std::pow(a, b); break;
+		case ExpressionType::Sine: value = std::sin(a); break;
+		case ExpressionType::Cosine: value = std::cos(a); break;
+		case ExpressionType::Exponential: value = std::exp(a); break;
+		case ExpressionType::Logarithm: value = std::log(a); break;
+		case ExpressionType::SquareRoot: value = std::sqrt(a); break;
+		default: break;
+		}
+		code.resize(start);
+		emitConstant(value);
+		return;
+	}
+	// lhs = 0 and lhs + 0 are the same as lhs
+	if (!unary && (type == ExpressionType::Addition || type == ExpressionType::Subtraction) && isConstant(second, code.size(), b) && b == 0) {
+		code.resize(second);
+		return;
+	}
+	code.push_back({ type, -1, 0 });
+}
+
+template<typename T>
+inline bool EquationParser<T>::isConstant(size_t start, size_t end, T& value) const {
+	if (end != start + 1 || code[start].type != ExpressionType::Constant || code[start].term >= 0) return false;
+	value = code[start].value;
+	return true;
+}
+
+template<typename T>
+inline void EquationParser<T>::emitConstant(T value) {
+	code.push_back({ ExpressionType::Constant, -1, value });
+}
+
+template<typename T>
+inline void EquationParser<T>::skipSpaces() {
+	while (pos < text.size() && isspace((unsigned char)text[pos])) ++pos;
+}
+
+template<typename T>
+inline bool EquationParser<T>::accept(char c) {
+	skipSpaces();
+	if (pos < text.size() && text[pos] == c) {
+		++pos;
+		return true;
+	}
+	return false;
+}
+
+template<typename T>
+inline void EquationParser<T>::expect(char c) {
+	if (!accept(c)) {
+		char message[] = "Expected ' '";
+		message[10] = c;
+		error(message);
+	}
+}
+
+template<typename T>
+inline std::string EquationParser<T>::identifier() {
+	skipSpaces();
+	size_t start = pos;
+	while (pos < text.size() && (isalnum((unsigned char)text[pos]) || text[pos] == '_' || (text[pos] == '\'' && pos > start))) ++pos;
+	if (start < pos && isdigit((unsigned char)text[start])) {
+		pos = start;
+		return "";
+	}
+	return text.substr(start, pos - start);
+}
+
+template<typename T>
+inline void EquationParser<T>::error(const char* message) const {
+	fprintf(stderr, "%s\n%s^ %s\n", text.c_str(), std::string(pos < text.size() ? pos : text.size(), ' ').c_str(), message);
+	throw "Invalid equation";
+}
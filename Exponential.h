@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Expression.h"
+#include "Build.h"
 #include "Multiplication.h"
 
 template<typename T>
@@ -9,7 +10,7 @@ private:
 	ExpressionPtr<T> a;
 public:
 
-	Exponential(ExpressionPtr<T> a) : a(a) {}
+	Exponential(ExpressionPtr<T> a) : Expression<T>(ExpressionType::Exponential, 0, a.get()), a(a) {}
 
 	T evaluate(T x, T y) const override;
 
@@ -23,7 +24,15 @@ public:
 
 	bool isConstant() const override { return a->isConstant(); }
 
-	ExpressionPtr<T> mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+	ExpressionPtr<T> mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+
+	static const ExpressionType Type = ExpressionType::Exponential;
+
+	ExpressionType type() const override { return Type; }
+
+	int childCount() const override { return 1; }
+
+	ExpressionPtr<T> child(int i) const override { return a; }
 
 };
 #define ExponentialPtr(T, a) ExpressionPtr<T>(new Exponential<T>(a))
@@ -39,7 +48,7 @@ inline T Exponential<T>::evaluate(T x, T y) const {
 
 template<typename T>
 inline ExpressionPtr<T> Exponential<T>::derivative(int dimension) const {
-	return MultiplicationPtr(T, a->derivative(dimension), ExponentialPtr(T, a));
+	return Build::multiply(a->derivative(dimension), this->self()); // exp'(a) = a' exp(a), sharing this node
 }
 
 template<typename T>
@@ -51,11 +60,14 @@ inline ExpressionPtr<T> Exponential<T>::simplify() const {
 }
 
 template<typename T>
-inline ExpressionPtr<T> Exponential<T>::mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
+inline ExpressionPtr<T> Exponential<T>::mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
 	TREE_MUTATION();
 	auto newA = a->mutate(rng, mutationChance, treeMutationChance, grammar, false);
 	if (MUTATION) {
 		return grammar->instantiateFunction(newA, rng);
 	}
+	if (newA == a) {
+		return this->self(); // nothing changed, keep sharing the same node
+	}
 	return ExponentialPtr(T, newA);
 }
@@ -1,22 +1,52 @@
 #pragma once
 
 #include <array>
+#include <algorithm>
 #include <string>
 #include <memory>
+#include <cstdint>
+#include <cstring>
 #include <random>
+#include "Random.h"
 #include <cmath>
 
-#define TREE_MUTATION() if (abs(int(rng())) % 10000 < int(treeMutationChance * 10000)) return grammar->instantiateExpression(rng);
-#define MUTATION (abs(int(rng())) % 10000 < int(mutationChance * 10000))
-#define RAND_NEG1_1 double(abs(int(rng)) % 1000) / 500 - 0.5
+#define TREE_MUTATION() if (Random::bounded(rng, 10000) < uint32_t(treeMutationChance * 10000)) return grammar->instantiateExpression(rng);
+#define MUTATION (Random::bounded(rng, 10000) < uint32_t(mutationChance * 10000))
+#define RAND_NEG1_1 double(Random::bounded(rng, 1000)) / 500 - 0.5
 
 template<typename T>
 class GrammarDecoder;
 
+/**
+ * Identifies the concrete type of an expression node, e.g. to (de)serialize expression trees
+ */
+enum class ExpressionType : unsigned char {
+	Constant, VarX, VarY,
+	Addition, Subtraction, Multiplication, Division, Power,
+	Sine, Cosine, Exponential, Logarithm, SquareRoot
+};
+
 template<typename T>
-class Expression {
+class Expression : public std::enable_shared_from_this<Expression<T>> {
+private:
+
+	/**
+	 * Number of nodes in the tree rooted at this node, height of that tree, and structural hash of that tree
+	 * All are computed once at construction since nodes are immutable, and are shared along with the node by every tree that contains it
+	 * Values and derivatives aren't cached: candidates are scored through compiled programs (see Program), which evaluate all derivatives in one pass over blocks of points,
+	 * so derivative trees are only built to print results, and value arrays would cost a grid's worth of memory per node for nodes that are mostly scored once
+	 */
+	unsigned int nodeCount;
+	unsigned int nodeHeight;
+	uint64_t nodeHash;
+
 public:
 
+	/**
+	 * Initializes the cached size and hash of a node from its type, value (constants only) and sub-expressions (operations and functions only)
+	 */
+	Expression(ExpressionType type, T value = 0, const Expression<T>* a = nullptr, const Expression<T>* b = nullptr);
+
 	/**
 	 * Evaluates the expression at point x
 	 */
@@ -51,7 +81,50 @@ public:
 	/**
 	 * Potentially mutates the expression or one of its sub-nodes with a random probability, for use in genetic algorithms
 	 */
-	virtual const std::shared_ptr<Expression<T>> mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const = 0;
+	virtual const std::shared_ptr<Expression<T>> mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const = 0;
+
+	/**
+	 * Returns the type of the node; concrete node classes also expose it as a static member Type, so that it can be read without creating a node
+	 */
+	virtual ExpressionType type() const = 0;
+
+	/**
+	 * Returns the number of direct sub-expressions of the node (0, 1 or 2), and the sub-expression at index i
+	 */
+	virtual int childCount() const { return 0; }
+	virtual const std::shared_ptr<Expression<T>> child(int i) const { return nullptr; }
+
+	/**
+	 * Returns the value held by the node, for constants only
+	 */
+	virtual T value() const { return 0; }
+
+	/**
+	 * Returns the number of nodes in the tree rooted at this node, including itself
+	 */
+	inline unsigned int size() const { return nodeCount; }
+
+	/**
+	 * Returns the number of edges on the longest path from this node down to a leaf (0 for leaves)
+	 */
+	inline unsigned int height() const { return nodeHeight; }
+
+	/**
+	 * Returns a hash of the tree rooted at this node; structurally identical trees always have the same hash
+	 */
+	inline uint64_t hash() const { return nodeHash; }
+
+	/**
+	 * Returns whether two trees are structurally identical, i.e. made up of the same nodes with the same values
+	 */
+	bool equals(const Expression<T>& other) const;
+
+protected:
+
+	/**
+	 * Returns a shared pointer to this node, which lets unchanged nodes be reused instead of copied
+	 */
+	inline std::shared_ptr<Expression<T>> self() const { return std::const_pointer_cast<Expression<T>>(this->shared_from_this()); }
 
 };
 template<typename T>
@@ -69,8 +142,8 @@ private:
 
 public:
 
-	Constant(T v) : v(v) {}
-	Constant(int v) : v(T(v)) {}
+	Constant(T v) : Expression<T>(ExpressionType::Constant, v), v(v) {}
+	Constant(int v) : Expression<T>(ExpressionType::Constant, T(v)), v(T(v)) {}
 
 	T evaluate(T x, T y) const override;
 
@@ -84,7 +157,13 @@ public:
 
 	bool isConstant() const override { return true; }
 
-	ExpressionPtr<T> mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+	ExpressionPtr<T> mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+
+	static const ExpressionType Type = ExpressionType::Constant;
+
+	ExpressionType type() const override { return Type; }
+
+	T value() const override { return v; }
 };
 #define ConstantPtr(T, v) ExpressionPtr<T>(new Constant<T>(v))
 #define ConstantPtrf(v) ConstantPtr(float, v)
@@ -93,6 +172,48 @@ public:
 
 
 
+template<typename T>
+inline Expression<T>::Expression(ExpressionType type, T value, const Expression<T>* a, const Expression<T>* b) : nodeCount(1), nodeHeight(0) {
+	auto mix = [](uint64_t h, uint64_t x) -> uint64_t {
+		h = (h ^ x) * 0xBF58476D1CE4E5B9ull;
+		return h ^ (h >> 31);
+	};
+	nodeHash = mix(0x9E3779B97F4A7C15ull, uint64_t(type));
+	if (type == ExpressionType::Constant) {
+		uint64_t bits = 0;
+		memcpy(&bits, &value, sizeof(T) < sizeof(bits) ? sizeof(T) : sizeof(bits));
+		nodeHash = mix(nodeHash, bits);
+	}
+	if (a) {
+		nodeCount += a->nodeCount;
+		nodeHeight = std::max(nodeHeight, 1 + a->nodeHeight);
+		nodeHash = mix(nodeHash, a->nodeHash);
+	}
+	if (b) {
+		nodeCount += b->nodeCount;
+		nodeHeight = std::max(nodeHeight, 1 + b->nodeHeight);
+		nodeHash = mix(nodeHash, b->nodeHash);
+	}
+}
+
+template<typename T>
+inline bool Expression<T>::equals(const Expression<T>& other) const {
+	if (this == &other) {
+		return true; // shared sub-trees
+	}
+	if (nodeHash != other.nodeHash || nodeCount != other.nodeCount || type() != other.type() || value() != other.value()) {
+		return false;
+	}
+	for (int i = 0; i < childCount(); ++i) {
+		if (!child(i)->equals(*other.child(i))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+
 template<typename T>
 inline T Constant<T>::evaluate(T x, T y) const {
 	return v;
@@ -109,17 +230,17 @@ inline ExpressionPtr<T> Constant<T>::simplify() const {
 }
 
 template<typename T>
-inline ExpressionPtr<T> Constant<T>::mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
+inline ExpressionPtr<T> Constant<T>::mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
 	TREE_MUTATION();
 	if (MUTATION) {
 		// either modify the value by a little bit (normal distrib), or pick a new constant altogether
-		if (abs(int(rng())) % 2 == 0) {
+		if (Random::bounded(rng, 2) == 0) {
 			std::normal_distribution<T> n(0, 1);
 			return ConstantPtr(T, v + n(rng));
 		} else {
 			return grammar->instantiateConstant(rng);
 		}
 	}
-	return ConstantPtr(T, v);
+	return this->self();
 }
 
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+	// loops over arrays are also compiled for AVX2 (4 doubles at once instead of 2), and the version to use is selected when the program is loaded
+	// FMA is deliberately left out, so that results are the same on every processor
+	#define FASTMATH_KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+	#define FASTMATH_KERNEL
+#endif
+
+/// Math functions in two accuracy tiers, for evaluating programs over many points at once (see Program::evaluate)
+/// - Exact calls the standard library, and gives the same results as evaluating the points one by one
+/// - Fast uses polynomial approximations with errors of a few 1e-14 (relative for exp and pow, absolute for log, and for sin and cos of arguments up to about 1e5 in magnitude), meant for screening candidates;
+///   they are branch-free, so that loops over arrays of points can be vectorized by the compiler, and don't handle subnormal numbers
+/// The fast tier must never decide the final score of a candidate, nor whether a problem is solved (see Fitness::setAccuracy)
+
+
+namespace FastMath {
+
+	enum class Accuracy {
+		Exact,
+		Fast
+	};
+
+	namespace detail {
+
+		static const double Shifter = 6755399441055744.0; // 1.5 * 2^52: adding it rounds a double to the nearest integer, which ends up in the low bits of the sum
+		static const double Log2e = 1.4426950408889634;
+		static const double Ln2Hi = 0.693147180369123816490; // ln 2 split into a part with trailing zero bits, so that k * Ln2Hi is exact, and the rest
+		static const double Ln2Lo = 1.90821492927058770002e-10;
+		static const double TwoOverPi = 0.63661977236758134308;
+		static const double PiOver2Hi = 1.57079632673412561417; // pi / 2 split in three parts for the same reason
+		static const double PiOver2Mid = 6.07710050650619224932e-11;
+		static const double PiOver2Lo = 2.02226624879595063154e-21;
+
+		inline int64_t bits(double x) {
+			int64_t i;
+			memcpy(&i, &x, sizeof(i));
+			return i;
+		}
+
+		inline double fromBits(int64_t i) {
+			double x;
+			memcpy(&x, &i, sizeof(x));
+			return x;
+		}
+
+		// selections are made with bit masks rather than comparisons, as compilers don't vectorize floating point comparisons unless trapping math is disabled
+
+		/**
+		 * Returns all bits set if a < b (or a - b is a NaN with its sign bit set, e.g. inf - inf), no bits otherwise
+		 */
+		inline int64_t lessMask(double a, double b) {
+			return -int64_t(uint64_t(bits(a - b)) >> 63);
+		}
+
+		/**
+		 * Returns all bits set if x is negative, including -0
+		 */
+		inline int64_t signMask(double x) {
+			return -int64_t(uint64_t(bits(x)) >> 63);
+		}
+
+		/**
+		 * Returns all bits set if the magnitude of x is above the given bits, e.g. Infinity - 1 to test for infinities and NaNs
+		 */
+		inline int64_t aboveMask(double x, int64_t limit) {
+			return -int64_t(uint64_t(limit - (bits(x) & int64_t(0x7FFFFFFFFFFFFFFF))) >> 63);
+		}
+
+		inline double select(int64_t mask, double a, double b) {
+			return fromBits((bits(a) & mask) | (bits(b) & ~mask));
+		}
+
+		static const int64_t InfinityBits = 0x7FF0000000000000;
+	}
+
+	/**
+	 * e^x; overflows to infinity above ln(DBL_MAX) = 709.78 and returns 0 below -708
+	 */
+	inline double exp(double x) {
+		using namespace detail;
+		// e^x = 2^k e^r with k = round(x / ln 2) and |r| <= ln 2 / 2
+		const double MaxArgument = 709.782712893384;
+		double xc = select(lessMask(x, -708.0), -708.0, x);
+		xc = select(lessMask(MaxArgument, xc), MaxArgument, xc);
+		double t = xc * Log2e + Shifter;
+		double k = t - Shifter;
+		double r = (xc - k * Ln2Hi) - k * Ln2Lo;
+		double p = 1 + r * (1 + r * (1.0 / 2 + r * (1.0 / 6 + r * (1.0 / 24 + r * (1.0 / 120 + r * (1.0 / 720 + r * (1.0 / 5040 + r * (1.0 / 40320 + r * (1.0 / 362880 + r * (1.0 / 3628800 + r * (1.0 / 39916800)))))))))));
+		// k reaches 1024 near the overflow bound, which has no exponent of its own, so the scaling is 2 * 2^(k - 1)
+		double e = (p + p) * fromBits(int64_t(uint64_t(bits(t) - bits(Shifter) + 1022) << 52));
+		e = select(lessMask(x, -708.0), 0.0, e);
+		e = select(lessMask(MaxArgument, x), INFINITY, e);
+		return select(aboveMask(x, InfinityBits), x, e); // NaN
+	}
+
+	/**
+	 * Natural logarithm of x; NaN for negative values and -infinity for 0
+	 */
+	inline double log(double x) {
+		using namespace detail;
+		// x = m 2^e with m in [sqrt(1/2), sqrt(2)), and log(m) = 2 atanh(s) with s = (m - 1) / (m + 1), |s| <= 0.172
+		int64_t i = bits(x);
+		double e = fromBits(int64_t(0x4330000000000000) + int64_t((uint64_t(i) >> 52) & 0x7FF)) - 4503599627370496.0 - 1023; // exponent converted through the same rounding trick
+		double m = fromBits((i & int64_t(0x000FFFFFFFFFFFFF)) | int64_t(0x3FF0000000000000)); // in [1, 2)
+		int64_t high = lessMask(1.4142135623730951, m);
+		m = select(high, 0.5 * m, m);
+		e = select(high, e + 1, e);
+		double s = (m - 1) / (m + 1);
+		double s2 = s * s;
+		double p = 2 + s2 * (2.0 / 3 + s2 * (2.0 / 5 + s2 * (2.0 / 7 + s2 * (2.0 / 9 + s2 * (2.0 / 11 + s2 * (2.0 / 13 + s2 * (2.0 / 15)))))));
+		double l = e * Ln2Hi + (s * p + e * Ln2Lo);
+		l = select(aboveMask(x, InfinityBits - 1), x, l); // infinities and NaNs
+		l = select(signMask(x), NAN, l);
+		return select(aboveMask(x, 0), l, -INFINITY); // zeros;
+	}
+
+	/**
+	 * Sine and cosine of x at once
+	 */
+	inline void sincos(double x, double& sine, double& cosine) {
+		using namespace detail;
+		// x = k pi/2 + r with |r| <= pi/4, then the sine and cosine of r are swapped and negated according to the quadrant k mod 4
+		double t = x * TwoOverPi + Shifter;
+		double k = t - Shifter;
+		int64_t quadrant = bits(t) - bits(Shifter);
+		double r = ((x - k * PiOver2Hi) - k * PiOver2Mid) - k * PiOver2Lo;
+		double r2 = r * r;
+		double s = r + r * r2 * (-1.0 / 6 + r2 * (1.0 / 120 + r2 * (-1.0 / 5040 + r2 * (1.0 / 362880 + r2 * (-1.0 / 39916800 + r2 * (1.0 / 6227020800.0))))));
+		double c = 1 + r2 * (-1.0 / 2 + r2 * (1.0 / 24 + r2 * (-1.0 / 720 + r2 * (1.0 / 40320 + r2 * (-1.0 / 3628800 + r2 * (1.0 / 479001600 + r2 * (-1.0 / 87178291200.0)))))));
+		int64_t swap = -(quadrant & 1);
+		sine = fromBits(bits(select(swap, c, s)) ^ int64_t(uint64_t(quadrant & 2) << 62));
+		cosine = fromBits(bits(select(swap, s, c)) ^ int64_t(uint64_t((quadrant + 1) & 2) << 62));
+	}
+
+	/**
+	 * x^c for positive x
+	 */
+	inline double pow(double x, double c) {
+		return FastMath::exp(c * FastMath::log(x));
+	}
+
+
+	namespace detail {
+
+		// loops of the fast tier; generic versions for any floating point type, and versions for doubles that are also compiled for AVX2 where possible
+
+		template<typename T>
+		inline void expLoop(const T* x, T* out, size_t n) {
+			for (size_t i = 0; i < n; ++i) out[i] = T(FastMath::exp(double(x[i])));
+		}
+
+		template<typename T>
+		inline void logLoop(const T* x, T* out, size_t n) {
+			for (size_t i = 0; i < n; ++i) out[i] = T(FastMath::log(double(x[i])));
+		}
+
+		template<typename T>
+		inline void sincosLoop(const T* x, T* sine, T* cosine, size_t n) {
+			for (size_t i = 0; i < n; ++i) {
+				double s, c;
+				FastMath::sincos(double(x[i]), s, c);
+				sine[i] = T(s);
+				cosine[i] = T(c);
+			}
+		}
+
+		template<typename T>
+		inline void powLoop(const T* x, T c, T* out, size_t n) {
+			for (size_t i = 0; i < n; ++i) out[i] = T(FastMath::pow(double(x[i]), double(c)));
+		}
+
+		FASTMATH_KERNEL inline void expLoop(const double* x, double* out, size_t n) {
+			for (size_t i = 0; i < n; ++i) out[i] = FastMath::exp(x[i]);
+		}
+
+		FASTMATH_KERNEL inline void logLoop(const double* x, double* out, size_t n) {
+			for (size_t i = 0; i < n; ++i) out[i] = FastMath::log(x[i]);
+		}
+
+		FASTMATH_KERNEL inline void sincosLoop(const double* x, double* sine, double* cosine, size_t n) {
+			for (size_t i = 0; i < n; ++i) FastMath::sincos(x[i], sine[i], cosine[i]);
+		}
+
+		FASTMATH_KERNEL inline void powLoop(const double* x, double c, double* out, size_t n) {
+			for (size_t i = 0; i < n; ++i) out[i] = FastMath::pow(x[i], c);
+		}
+	}
+
+
+	/**
+	 * Functions over arrays of n values, in the given accuracy tier; the output may be the same array as the input
+	 */
+	template<typename T>
+	inline void exp(const T* x, T* out, size_t n, Accuracy accuracy) {
+		if (accuracy == Accuracy::Fast) {
+			detail::expLoop(x, out, n);
+		} else {
+			for (size_t i = 0; i < n; ++i) out[i] = std::exp(x[i]);
+		}
+	}
+
+	template<typename T>
+	inline void log(const T* x, T* out, size_t n, Accuracy accuracy) {
+		if (accuracy == Accuracy::Fast) {
+			detail::logLoop(x, out, n);
+		} else {
+			for (size_t i = 0; i < n; ++i) out[i] = std::log(x[i]);
+		}
+	}
+
+	template<typename T>
+	inline void sincos(const T* x, T* sine, T* cosine, size_t n, Accuracy accuracy) {
+		if (accuracy == Accuracy::Fast) {
+			detail::sincosLoop(x, sine, cosine, n);
+		} else {
+			for (size_t i = 0; i < n; ++i) {
+				sine[i] = std::sin(x[i]);
+				cosine[i] = std::cos(x[i]);
+			}
+		}
+	}
+
+	/**
+	 * x^c for an array of positive x and a single exponent
+	 */
+	template<typename T>
+	inline void pow(const T* x, T c, T* out, size_t n, Accuracy accuracy) {
+		if (accuracy == Accuracy::Fast) {
+			detail::powLoop(x, c, out, n);
+		} else {
+			for (size_t i = 0; i < n; ++i) out[i] = std::pow(x[i], c);
+		}
+	}
+
+};
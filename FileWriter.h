@@ -2,6 +2,9 @@
 
 #include <fstream>
 #include <string>
+#include <vector>
+#include <cstdio>
+#include <future>
 
 namespace FileWriter {
 
@@ -15,4 +18,157 @@ namespace FileWriter {
 		f.close();
 	}
 
+	/**
+	 * Writes binary contents to a file; the contents are written to a temporary file first, which is then moved in place of the target, such that the target is never left half-written
+	 */
+	void WriteBinary(std::string filename, const std::vector<char>& contents) {
+		std::string tmp = filename + ".tmp";
+		std::ofstream f;
+		f.open(tmp, std::ios::binary);
+		f.write(contents.data(), contents.size());
+		f.close();
+		std::remove(filename.c_str());
+		std::rename(tmp.c_str(), filename.c_str());
+	}
+
+	/**
+	 * Reads the binary contents of a file; returns false if the file could not be opened
+	 */
+	bool ReadBinary(std::string filename, std::vector<char>& contents) {
+		std::ifstream f;
+		f.open(filename, std::ios::binary);
+		if (!f.is_open()) return false;
+		contents.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	/**
+	 * Writes binary files on a background thread, one at a time
+	 * Handing a new file over while the previous one is still being written waits for the previous write to finish first
+	 */
+	class AsyncWriter {
+	private:
+		std::future<void> pending;
+		std::vector<char> contents;
+
+	public:
+
+		~AsyncWriter() { wait(); }
+
+		/**
+		 * Starts writing to the given file in the background; the contents are swapped out of the given buffer to avoid copies
+		 */
+		void write(std::string filename, std::vector<char>& buffer) {
+			wait();
+			contents.swap(buffer);
+			pending = std::async(std::launch::async, [this, filename]() { WriteBinary(filename, contents); });
+		}
+
+		/**
+		 * Blocks until the last write has completed
+		 */
+		void wait() {
+			if (pending.valid()) pending.get();
+		}
+	};
+
+
+	/**
+	 * Appends data to a file through a buffer of bounded size; full buffers are appended to the file by a background thread, while new data goes into a second buffer
+	 * Appending can be resumed from any earlier size of the file, e.g. the one recorded in a checkpoint, in which case whatever was appended after that point is discarded
+	 */
+	class AsyncAppender {
+	private:
+		std::string filename;
+		std::string buffer;
+		std::string flushing;
+		std::future<void> pending;
+		size_t capacity;
+		uint64_t flushed = 0; // number of bytes handed over to the background thread so far
+
+		/**
+		 * Starts appending the buffer to the file in the background
+		 */
+		void submit() {
+			wait();
+			flushing.swap(buffer);
+			buffer.clear();
+			flushed += flushing.size();
+			pending = std::async(std::launch::async, [this]() {
+				std::ofstream f(filename, std::ios::binary | std::ios::app);
+				f.write(flushing.data(), flushing.size());
+				if (!f) {
+					throw "Could not append to file";
+				}
+			});
+		}
+
+		void wait() {
+			if (pending.valid()) pending.get();
+		}
+
+	public:
+
+		AsyncAppender(size_t capacity = 1 << 16) : capacity(capacity) {}
+
+		~AsyncAppender() { wait(); }
+
+		/**
+		 * Starts appending to the given file, which is emptied first
+		 */
+		void open(std::string filename) {
+			wait();
+			this->filename = filename;
+			buffer.clear();
+			flushed = 0;
+			Write(filename, "");
+		}
+
+		/**
+		 * Starts appending to the given file from the given size, dropping the rest of the file
+		 */
+		void resume(std::string filename, uint64_t size) {
+			wait();
+			std::vector<char> contents;
+			if (!ReadBinary(filename, contents) || contents.size() < size) {
+				throw "File is shorter than the size to resume appending from";
+			}
+			contents.resize(size_t(size));
+			WriteBinary(filename, contents);
+			this->filename = filename;
+			buffer.clear();
+			flushed = size;
+		}
+
+		inline void append(const char* data, size_t size) {
+			buffer.append(data, size);
+			if (buffer.size() >= capacity) submit();
+		}
+		inline void append(const std::string& s) { append(s.data(), s.size()); }
+		inline void append(char c) { append(&c, 1); }
+
+		/**
+		 * Writes all appended data to the file, and blocks until it is on disk
+		 */
+		void flush() {
+			if (!buffer.empty()) submit();
+			wait();
+		}
+
+		/**
+		 * Flushes the file; the appender can then be opened again
+		 */
+		void close() {
+			flush();
+			filename.clear();
+		}
+
+		inline const std::string& getFilename() const { return filename; }
+
+		/**
+		 * Returns the size the file will have once flushed
+		 */
+		inline uint64_t size() const { return flushed + buffer.size(); }
+	};
+
 };
@@ -1,7 +1,13 @@
 ﻿#pragma once
 
 #include <functional>
+#include <algorithm>
+#include <cstdint>
 #include "Expression.h"
+#include "Program.h"
+#include "Equation.h"
+#include "Serialization.h"
+#include "Profiler.h"
 
 
 /**
@@ -23,13 +29,22 @@ struct Boundary {
 	/**
 	 * Function of the dimensional parameter (r = y for dimension = 0, r = x for dimension = 1)
 	 * If dimension = 0, i.e. p = x_0, r = y, f = f(x_0, y), df = d/dx (x_0, y), ddf = d^2/dx^2 f(x_0, y)
+	 * If dimension = 1, i.e. p = y_0, r = x, f = f(x, y_0), df = d/dy (x, y_0), ddf = d^2/dy^2 f(x, y_0)
 	 */
 	std::function<const T(const T r, const T f, const T df, const T ddf)> function;
 
+	/**
+	 * Same condition given as a compiled residual (see EquationParser), which may depend on the derivatives in both dimensions; empty when the condition is given as a function
+	 */
+	Residual<T> residual;
+
 
 	/// Default constructor
 	inline Boundary(T p, int dimension, const std::function<const T(const T r, const T f, const T df, const T ddf)> function) : p(p), dimension(dimension), function(function) {}
 
+	/// Constructor for a boundary condition given as text
+	inline Boundary(const BoundaryCondition<T>& condition) : p(condition.p), dimension(condition.dimension), residual(condition.residual) {}
+
 };
 
 
@@ -81,6 +96,11 @@ class Fitness {
 	 */
 	const std::function<const T(const FunctionParams<T> params)> function;
 
+	/**
+	 * Same equation given as a compiled residual (see EquationParser), which is evaluated over all collocation points at once; empty when the equation is given as a function
+	 */
+	Residual<T> residual;
+
 	/**
 	 * Range of points for which the functions will be evaluated
 	 */
@@ -97,6 +117,63 @@ class Fitness {
 	 */
 	std::vector<Boundary<T>> boundaries;
 
+	/**
+	 * Coordinates of the points of all boundaries one after the other, and index of each point in the grid if it is on the grid (SIZE_MAX otherwise);
+	 * boundaryStart[k] is the first point of boundary k
+	 */
+	std::vector<T> boundaryX;
+	std::vector<T> boundaryY;
+	std::vector<size_t> boundaryGridIndex;
+	std::vector<size_t> boundaryStart;
+
+	/**
+	 * Points the programs are evaluated at: first the collocation points, at which the residuals of the equation are summed, in this order,
+	 * then the points of the boundaries that aren't among them
+	 */
+	struct Collocation {
+		std::vector<T> x;
+		std::vector<T> y;
+		std::vector<size_t> indices; // index of each collocation point in the grid
+		std::vector<T> weights; // weight of each collocation point in the sum, empty if they all weigh 1
+		std::vector<size_t> boundaryPoints; // points of all boundaries one after the other, as indices into x and y
+		Residual<T> residual; // residual of the equation, with the parts that only depend on the coordinates precomputed at the collocation points
+
+		inline size_t count() const { return indices.size(); }
+	};
+
+	/**
+	 * Every point of the grid, and the points chosen by refine() when collocation is adaptive
+	 */
+	Collocation grid;
+	Collocation adaptive;
+
+	/**
+	 * Number of collocation points of adaptive collocation, 0 when it is disabled
+	 */
+	size_t collocationBudget = 0;
+
+	/**
+	 * Accuracy of the functions evaluated over the grid, and the fitness below which a fast or adaptive fitness is computed again with exact functions over the whole grid
+	 */
+	FastMath::Accuracy accuracy = FastMath::Accuracy::Exact;
+	T rescoreBelow = 0;
+
+	const T fitness(const Program<T>& f, FastMath::Accuracy accuracy, const Collocation& points) const;
+
+	/**
+	 * Evaluates the program at all points, and the residuals of the equation at the collocation points
+	 */
+	void evaluate(const Program<T>& f, FastMath::Accuracy accuracy, const Collocation& points, Jets<T>& jets, std::vector<T>& residuals) const;
+
+	void buildGrid();
+
+	/**
+	 * Returns the collocation points made of the given points of the grid, with the given weights
+	 */
+	Collocation collocate(const std::vector<size_t>& indices, const std::vector<T>& weights) const;
+
+	inline size_t gridSize() const { return size_t(domainX.numPoints) * domainY.numPoints; }
+
 public:
 
 	/**
@@ -108,67 +185,348 @@ public:
 	 * @param std::vector<Boundary<T>> boundaries					Boundary conditions
 	 */
 	Fitness(std::function<const T(const FunctionParams<T>)> fn, Domain<T> domainX, Domain<T> domainY, T lambda, std::vector<Boundary<T>> boundaries) :
-		function(fn), domainX(domainX), domainY(domainY), lambda(lambda), boundaries(boundaries) {}
+		function(fn), domainX(domainX), domainY(domainY), lambda(lambda), boundaries(boundaries) {
+		buildGrid();
+	}
+
+	/**
+	 * Constructor for an equation given as a residual, e.g. parsed from text
+	 * @param Residual<T> residual									The differential equation to compute, as a residual that evaluates to 0 where it holds
+	 */
+	Fitness(const Residual<T>& residual, Domain<T> domainX, Domain<T> domainY, T lambda, std::vector<Boundary<T>> boundaries) :
+		residual(residual), domainX(domainX), domainY(domainY), lambda(lambda), boundaries(boundaries) {
+		buildGrid();
+	}
+
+	/**
+	 * Sets the accuracy of the functions (exp, log, sin, cos, pow) evaluated over the grid, which is exact by default
+	 * With fast accuracy, candidates whose fast fitness is below rescoreBelow are evaluated again with exact functions,
+	 * so that small fitness values, and whether a problem is solved, never depend on approximations
+	 */
+	inline void setAccuracy(FastMath::Accuracy accuracy, T rescoreBelow = T(1e-3)) {
+		this->accuracy = accuracy;
+		this->rescoreBelow = rescoreBelow;
+	}
+
+	/**
+	 * Enables adaptive collocation: the equation is only evaluated at budget points of the grid, weighted so that fitness values estimate those over the whole grid
+	 * The points start out evenly spread over the grid, and are moved by refine(); as with fast accuracy, candidates whose fitness is below rescoreBelow
+	 * are evaluated again over the whole grid. A budget of 0, or of at least the size of the grid, disables adaptive collocation
+	 */
+	void setCollocationBudget(size_t budget, T rescoreBelow = T(1e-3));
+
+	/**
+	 * Moves half of the collocation points to the points of the grid where the residual of the given expression (typically the best of the population) is highest,
+	 * and spreads the other half evenly over the rest of the grid, each standing for an equal share of it
+	 * Fitness values computed before refining are estimated from other points, and should be computed again
+	 * Returns false, leaving the points unchanged, if adaptive collocation is disabled or the expression can't be evaluated
+	 */
+	bool refine(const ExpressionPtr<T>& elite);
+
+	/**
+	 * Writes the adaptive collocation points to a binary buffer, or reads them back, e.g. to checkpoint a run
+	 */
+	void saveCollocation(Serialization::BinaryWriter& writer) const;
+	void loadCollocation(Serialization::BinaryReader& reader);
 
 	/**
 	 * Computes the fitness of a expression taken with respect to the given ODE
 	 */
 	const T fitness(const ExpressionPtr<T>& f) const;
 
+	/**
+	 * Computes the fitness of a program taken with respect to the given ODE
+	 * Derivatives are evaluated alongside the program itself, so no derivative expressions need to be built
+	 */
+	const T fitness(const Program<T>& f) const;
+
+	/**
+	 * Computes the fitness of an expression over the whole grid with exact functions, whatever the accuracy and collocation points,
+	 * e.g. to compare candidates whose fitness values were estimated at different points; infinite if the expression can't be evaluated
+	 */
+	const T exactFitness(const ExpressionPtr<T>& f) const;
+
+	/**
+	 * Returns the number of points the expression is evaluated at for each fitness computation, as an estimate of the cost of the fitness function
+	 */
+	size_t cost() const;
+
 }; // class Fitness
 
 
 
+template<typename T>
+inline void Fitness<T>::buildGrid() {
+	// boundaries usually lie on the edges of the grid, whose points are then shared with the grid; other points are evaluated along with the grid
+	for (auto& b : boundaries) {
+		const Domain<T>& across = b.dimension == 0 ? domainX : domainY;
+		const Domain<T>& along = b.dimension == 0 ? domainY : domainX;
+		assert(b.dimension == 0 || b.dimension == 1);
+		assert(b.p >= across.rangeStart && b.p <= across.rangeEnd);
+		int line = -1;
+		for (int i = 0; i < across.numPoints; ++i) {
+			if (across.point(i) == b.p) line = i;
+		}
+		boundaryStart.push_back(boundaryX.size());
+		for (int i = 0; i < along.numPoints; ++i) {
+			boundaryX.push_back(b.dimension == 0 ? b.p : along.point(i));
+			boundaryY.push_back(b.dimension == 0 ? along.point(i) : b.p);
+			if (line < 0) {
+				boundaryGridIndex.push_back(SIZE_MAX);
+			} else {
+				boundaryGridIndex.push_back(b.dimension == 0 ? size_t(line) * domainY.numPoints + i : size_t(i) * domainY.numPoints + line);
+			}
+		}
+		if (!b.residual.empty()) {
+			b.residual.precompute(boundaryX.data() + boundaryStart.back(), boundaryY.data() + boundaryStart.back(), along.numPoints);
+		}
+	}
+	boundaryStart.push_back(boundaryX.size());
+
+	std::vector<size_t> indices(gridSize());
+	for (size_t i = 0; i < indices.size(); ++i) {
+		indices[i] = i;
+	}
+	grid = collocate(indices, {});
+}
+
+template<typename T>
+inline typename Fitness<T>::Collocation Fitness<T>::collocate(const std::vector<size_t>& indices, const std::vector<T>& weights) const {
+	Collocation c;
+	c.indices = indices;
+	c.weights = weights;
+	std::vector<size_t> position(gridSize(), SIZE_MAX); // position of the points of the grid among the points evaluated
+	for (size_t index : indices) {
+		position[index] = c.x.size();
+		c.x.push_back(domainX.point(int(index / domainY.numPoints)));
+		c.y.push_back(domainY.point(int(index % domainY.numPoints)));
+	}
+	for (size_t i = 0; i < boundaryX.size(); ++i) {
+		size_t index = boundaryGridIndex[i];
+		if (index != SIZE_MAX && position[index] != SIZE_MAX) {
+			c.boundaryPoints.push_back(position[index]);
+			continue;
+		}
+		if (index != SIZE_MAX) {
+			position[index] = c.x.size(); // e.g. corners shared by two boundaries
+		}
+		c.boundaryPoints.push_back(c.x.size());
+		c.x.push_back(boundaryX[i]);
+		c.y.push_back(boundaryY[i]);
+	}
+	if (!residual.empty()) {
+		c.residual = residual;
+		c.residual.precompute(c.x.data(), c.y.data(), c.count());
+	}
+	return c;
+}
+
+template<typename T>
+inline void Fitness<T>::setCollocationBudget(size_t budget, T rescoreBelow) {
+	if (budget == 0 || budget >= gridSize()) {
+		collocationBudget = 0;
+		adaptive = Collocation();
+		return;
+	}
+	collocationBudget = budget;
+	this->rescoreBelow = rescoreBelow;
+	std::vector<size_t> indices;
+	for (size_t k = 0; k < budget; ++k) {
+		indices.push_back((2 * k + 1) * gridSize() / (2 * budget));
+	}
+	adaptive = collocate(indices, std::vector<T>(budget, T(gridSize()) / budget));
+}
+
+template<typename T>
+inline bool Fitness<T>::refine(const ExpressionPtr<T>& elite) {
+	if (collocationBudget == 0 || elite == nullptr) return false;
+	thread_local Program<T> program;
+	thread_local Jets<T> jets;
+	std::vector<T> residuals;
+	program.compile(elite);
+	try {
+		evaluate(program, FastMath::Accuracy::Exact, grid, jets, residuals);
+	} catch (...) {
+		return false;
+	}
+
+	// the points with the highest residuals stand for themselves
+	size_t n = gridSize();
+	size_t focus = collocationBudget / 2;
+	std::vector<size_t> order(n);
+	for (size_t i = 0; i < n; ++i) {
+		order[i] = i;
+	}
+	auto squared = [&](size_t i) -> T {
+		T r = residuals[i] * residuals[i];
+		return r == r ? r : INFINITY; // NaNs first
+	};
+	std::nth_element(order.begin(), order.begin() + focus, order.end(), [&](size_t a, size_t b) {
+		return squared(a) > squared(b) || (squared(a) == squared(b) && a < b);
+	});
+	std::vector<T> weight(n, 0);
+	for (size_t k = 0; k < focus; ++k) {
+		weight[order[k]] = 1;
+	}
+
+	// the others are spread evenly over the rest of the grid, each standing for an equal share of it
+	std::vector<size_t> others;
+	for (size_t i = 0; i < n; ++i) {
+		if (weight[i] == 0) others.push_back(i);
+	}
+	size_t spread = collocationBudget - focus;
+	for (size_t k = 0; k < spread; ++k) {
+		weight[others[(2 * k + 1) * others.size() / (2 * spread)]] = T(others.size()) / spread;
+	}
+
+	std::vector<size_t> indices;
+	std::vector<T> weights;
+	for (size_t i = 0; i < n; ++i) {
+		if (weight[i] > 0) {
+			indices.push_back(i);
+			weights.push_back(weight[i]);
+		}
+	}
+	adaptive = collocate(indices, weights);
+	return true;
+}
+
+template<typename T>
+inline void Fitness<T>::saveCollocation(Serialization::BinaryWriter& writer) const {
+	writer.write<uint64_t>(adaptive.count());
+	for (size_t i = 0; i < adaptive.count(); ++i) {
+		writer.write<uint64_t>(adaptive.indices[i]);
+		writer.write<T>(adaptive.weights[i]);
+	}
+}
+
+template<typename T>
+inline void Fitness<T>::loadCollocation(Serialization::BinaryReader& reader) {
+	std::vector<size_t> indices(size_t(reader.read<uint64_t>()));
+	std::vector<T> weights(indices.size());
+	for (size_t i = 0; i < indices.size(); ++i) {
+		indices[i] = size_t(reader.read<uint64_t>());
+		weights[i] = reader.read<T>();
+	}
+	collocationBudget = indices.size();
+	adaptive = collocate(indices, weights);
+}
+
 template<typename T>
 inline const T Fitness<T>::fitness(const ExpressionPtr<T>& f) const {
+	thread_local Program<T> program;
+	program.compile(f);
+	return fitness(program);
+}
+
+template<typename T>
+inline const T Fitness<T>::fitness(const Program<T>& f) const {
+	if (accuracy == FastMath::Accuracy::Exact && collocationBudget == 0) {
+		return fitness(f, FastMath::Accuracy::Exact, grid);
+	}
+	T screened = fitness(f, accuracy, collocationBudget > 0 ? adaptive : grid);
+	return screened < rescoreBelow ? fitness(f, FastMath::Accuracy::Exact, grid) : screened;
+}
+
+template<typename T>
+inline const T Fitness<T>::exactFitness(const ExpressionPtr<T>& f) const {
+	thread_local Program<T> program;
+	program.compile(f);
+	try {
+		return fitness(program, FastMath::Accuracy::Exact, grid);
+	} catch (...) { // points outside of the collocation points may still divide by 0, take the log of a negative value, etc.
+		return INFINITY;
+	}
+}
+
+template<typename T>
+inline void Fitness<T>::evaluate(const Program<T>& f, FastMath::Accuracy accuracy, const Collocation& points, Jets<T>& jets, std::vector<T>& residuals) const {
+	f.evaluate(points.x.data(), points.y.data(), points.x.size(), jets, accuracy);
+	residuals.resize(points.count());
+	if (!points.residual.empty()) { // the residual is evaluated at all points at once, like the program
+		const T* terms[TermCount] = { points.x.data(), points.y.data(), jets.f.data(), jets.dx.data(), jets.dy.data(), jets.dxx.data(), jets.dyy.data() };
+		points.residual.evaluate(terms, points.count(), residuals.data(), accuracy);
+	} else {
+		for (size_t i = 0; i < points.count(); ++i) {
+			FunctionParams<T> p;
+			p.x = points.x[i];
+			p.y = points.y[i];
+			p.f = jets.f[i];
+			p.ddx = jets.dx[i];
+			p.ddy = jets.dy[i];
+			p.ddx2 = jets.dxx[i];
+			p.ddy2 = jets.dyy[i];
+			residuals[i] = function(p);
+		}
+	}
+}
+
+template<typename T>
+inline const T Fitness<T>::fitness(const Program<T>& f, FastMath::Accuracy accuracy, const Collocation& points) const {
 
-	// Compute the first and second derivatives of the expression with respect to x and y
-	ExpressionPtr<T> dFdx = f->derivative(0)->simplify();
-	ExpressionPtr<T> ddFdx2 = dFdx->derivative(0)->simplify();
-	ExpressionPtr<T> dFdy = f->derivative(1)->simplify();
-	ExpressionPtr<T> ddFdy2 = dFdy->derivative(1)->simplify();
-	
 	// Compute E(M_g), the sum of the squared evaluation of the expression with respect to the given ODE
+	// the program is evaluated once at the collocation points and the points of the boundaries that aren't among them
+	thread_local Jets<T> jets;
+	thread_local std::vector<T> residuals;
 	T e = 0;
-	for (int ix = 0; ix < domainX.numPoints; ++ix) {
-		for (int iy = 0; iy < domainY.numPoints; ++iy) {
-			FunctionParams<T> p;
-			p.x = domainX.point(ix);
-			p.y = domainY.point(iy);
-			p.f = f->evaluate(p.x, p.y);
-			p.ddx = dFdx->evaluate(p.x, p.y);
-			p.ddy = dFdy->evaluate(p.x, p.y);
-			p.ddx2 = ddFdx2->evaluate(p.x, p.y);
-			p.ddy2 = ddFdy2->evaluate(p.x, p.y);
-			T result = function(p);
-			e += result * result;
+	{
+		PROFILE_SCOPE(Grid);
+		evaluate(f, accuracy, points, jets, residuals);
+		if (points.weights.empty()) {
+			for (T result : residuals) {
+				e += result * result;
+			}
+		} else {
+			for (size_t i = 0; i < residuals.size(); ++i) {
+				e += points.weights[i] * residuals[i] * residuals[i];
+			}
 		}
 	}
 
 	// Compute the boundary conditions into the penalty
 	T p = 0;
-	for (auto& b : boundaries) {
-		switch (b.dimension) {
-		case 0: // boundary on x, i.e. b.p = x_0, and the boundary should be called for r = y, f = f(x_0, y), df = d/dx (x_0, y), ddf = d^2/dx^2 f(x_0, y)
-			assert(b.p >= domainX.rangeStart && b.p <= domainX.rangeEnd);
-			for (int iy = 0; iy < domainY.numPoints; ++iy) {
-				T y = domainY.point(iy);
-				T result = b.function(y, f->evaluate(b.p, y), dFdx->evaluate(b.p, y), ddFdx2->evaluate(b.p, y));
-				p += result * result;
-			}
-			break;
-		case 1: // boundary on y, i.e. b.p = y_0, and the boundary should be called for r = x, f = f(x, y_0), df = d/dy (x, y_0), ddf = d^2/dy^2 f(x, y_0)
-			assert(b.p >= domainY.rangeStart && b.p <= domainY.rangeEnd);
-			for (int ix = 0; ix < domainX.numPoints; ++ix) {
-				T x = domainX.point(ix);
-				T result = b.function(x, f->evaluate(x, b.p), dFdx->evaluate(x, b.p), ddFdx2->evaluate(x, b.p));
-				p += result * result;
+	{
+		PROFILE_SCOPE(Boundaries);
+		thread_local Jets<T> b;
+		b.resize(points.boundaryPoints.size());
+		for (size_t i = 0; i < points.boundaryPoints.size(); ++i) {
+			size_t k = points.boundaryPoints[i];
+			b.f[i] = jets.f[k];
+			b.dx[i] = jets.dx[k];
+			b.dy[i] = jets.dy[k];
+			b.dxx[i] = jets.dxx[k];
+			b.dyy[i] = jets.dyy[k];
+		}
+		for (size_t k = 0; k < boundaries.size(); ++k) {
+			const Boundary<T>& boundary = boundaries[k];
+			size_t start = boundaryStart[k], end = boundaryStart[k + 1];
+			if (!boundary.residual.empty()) {
+				const T* terms[TermCount] = { &boundaryX[start], &boundaryY[start], &b.f[start], &b.dx[start], &b.dy[start], &b.dxx[start], &b.dyy[start] };
+				residuals.resize(end - start);
+				boundary.residual.evaluate(terms, end - start, residuals.data(), accuracy);
+				for (T result : residuals) {
+					p += result * result;
+				}
+			} else {
+				// boundary on x: r = y, f = f(x_0, y), df = d/dx (x_0, y), ddf = d^2/dx^2 f(x_0, y); boundary on y: r = x, f = f(x, y_0), df = d/dy (x, y_0), ddf = d^2/dy^2 f(x, y_0)
+				bool onX = boundary.dimension == 0;
+				const std::vector<T>& r = onX ? boundaryY : boundaryX;
+				const std::vector<T>& df = onX ? b.dx : b.dy;
+				const std::vector<T>& ddf = onX ? b.dxx : b.dyy;
+				for (size_t i = start; i < end; ++i) {
+					T result = boundary.function(r[i], b.f[i], df[i], ddf[i]);
+					p += result * result;
+				}
 			}
-			break;
-		default: // invalid dimension
-			assert(false);
 		}
 	}
 
-	return e + lambda * p;
+	// overflows and NaNs (e.g. inf - inf) are as bad as it gets, and would otherwise break sorting by fitness
+	T total = e + lambda * p;
+	return total < INFINITY ? total : INFINITY;
+}
+
+template<typename T>
+inline size_t Fitness<T>::cost() const {
+	return (collocationBudget > 0 ? adaptive.count() : grid.count()) + boundaryX.size();
 }
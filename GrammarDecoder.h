@@ -3,6 +3,7 @@
 #include <vector>
 #include <cassert>
 #include "Expression.h"
+#include "Program.h"
 
 
 // Helper macros to set up a grammar
@@ -21,6 +22,7 @@ public:
 	virtual const ExpressionPtr<T> instantiate0Args() = 0;
 	virtual const ExpressionPtr<T> instantiate1Arg(const std::shared_ptr<Expression<T>> a) = 0;
 	virtual const ExpressionPtr<T> instantiate2Args(const std::shared_ptr<Expression<T>> a, const std::shared_ptr<Expression<T>> b) = 0;
+	virtual ExpressionType type() const = 0;
 };
 
 template<typename ChildExpression, typename T>
@@ -38,6 +40,12 @@ public:
 	const ExpressionPtr<T> instantiate2Args(const std::shared_ptr<Expression<T>> a, const std::shared_ptr<Expression<T>> b) override {
 		return nullptr;
 	}
+	/**
+	 * Returns the type of the expressions created by the element
+	 */
+	ExpressionType type() const override {
+		return ChildExpression::Type;
+	}
 }; // class GrammaticalElement0Args
 template<typename ChildExpression, typename T>
 class GrammaticalElement1Arg : public GrammaticalElement_base<T> {
@@ -54,6 +62,9 @@ public:
 	const ExpressionPtr<T> instantiate2Args(const std::shared_ptr<Expression<T>> a, const std::shared_ptr<Expression<T>> b) override {
 		return nullptr;
 	}
+	ExpressionType type() const override {
+		return ChildExpression::Type;
+	}
 }; // class GrammaticalElement1Arg
 template<typename ChildExpression, typename T>
 class GrammaticalElement2Args : public GrammaticalElement_base<T> {
@@ -70,9 +81,25 @@ public:
 	const ExpressionPtr<T> instantiate2Args(const std::shared_ptr<Expression<T>> a, const std::shared_ptr<Expression<T>> b) override {
 		return std::shared_ptr<ChildExpression>(new ChildExpression(a, b));
 	}
+	ExpressionType type() const override {
+		return ChildExpression::Type;
+	}
 }; // class GrammaticalElement2Args
 
 
+/**
+ * Records the outcome of decoding a sequence, which allows skipping the decoding when none of the genes it depends on change
+ */
+template<typename T>
+struct DecodeRecord {
+	bool valid = false; // whether the record holds the decoding of a sequence
+	bool success = false; // whether the sequence could be decoded
+	Program<T> program; // the program that was decoded, simplified, if successful
+	bool constant = false; // whether the program was constant before being simplified, which makes it invalid
+	uint64_t hash = 0; // hash of the program, if successful
+	unsigned int consumed = 0; // number of genes the program was decoded from, starting from the beginning of the sequence; genes past that point have no effect on the program
+};
+
 /**
  * Can be used to decode sequences of integers into valid mathematical expressions
  */
@@ -94,6 +121,13 @@ private:
 	const std::vector<GrammaticalElement_base<T>*> functions;
 	const std::vector<T> constants;
 
+	/**
+	 * Types of the expressions created by each element of the library, so that decoding doesn't need to go through the elements
+	 */
+	std::vector<ExpressionType> variableTypes;
+	std::vector<ExpressionType> operationTypes;
+	std::vector<ExpressionType> functionTypes;
+
 public:
 
 	/**
@@ -105,92 +139,196 @@ public:
 		const std::vector<GrammaticalElement_base<T>*>& operations,
 		const std::vector<GrammaticalElement_base<T>*>& functions,
 		const std::vector<T>& constants
-	) : maxWraparounds(maxWraparounds), variables(variables), operations(operations), functions(functions), constants(constants) {}
+	) : maxWraparounds(maxWraparounds), variables(variables), operations(operations), functions(functions), constants(constants) {
+		for (auto element : variables) variableTypes.push_back(element->type());
+		for (auto element : operations) operationTypes.push_back(element->type());
+		for (auto element : functions) functionTypes.push_back(element->type());
+	}
 
 	/**
 	 * Decodes a sequence of integers into a valid mathematical expression
 	 */
-	const ExpressionPtr<T> decode(const std::vector<unsigned int>& sequence) const;
+	template<typename Gene>
+	const ExpressionPtr<T> decode(const Gene* sequence, unsigned int length) const;
+	inline const ExpressionPtr<T> decode(const std::vector<unsigned int>& sequence) const { return decode(sequence.data(), (unsigned int)sequence.size()); }
 
 	/**
-	 * Instantiates and returns a random function/operation/var on a random probability
+	 * Decodes a sequence of integers into a program, without building the expression tree; returns false if the sequence is found invalid
+	 * The program's storage is reused, such that decoding doesn't allocate once the program has grown large enough
+	 * If given, consumed is set to the number of genes read from the start of the sequence (all of them if the pointer wrapped around)
 	 */
-	const ExpressionPtr<T> instantiateFunction(const ExpressionPtr<T> a, std::mt19937& rng) const;
-	const ExpressionPtr<T> instantiateOperation(const ExpressionPtr<T> a, const ExpressionPtr<T> b, std::mt19937& rng) const;
-	const ExpressionPtr<T> instantiateVar(std::mt19937& rng) const;
-	const ExpressionPtr<T> instantiateConstant(std::mt19937& rng) const;
-	const ExpressionPtr<T> instantiateExpression(std::mt19937& rng, int maxDepth = 3, int depth = 0) const;
-
-private:
+	template<typename Gene>
+	bool decodeProgram(const Gene* sequence, unsigned int length, Program<T>& program, unsigned int* consumed = nullptr) const;
 
 	/**
-	 * Decodes a single expression recursively; returns false if the sequence is found invalid
+	 * Decodes a sequence incrementally, given the record of a previous decoding and the position of the first gene that may have changed since
+	 * If no gene the previous program was decoded from has changed, the decoding is skipped; the record is updated to reflect the new decoding
+	 * The program is then simplified (see Program::simplify); record.constant tells whether it was constant before simplification, which is what rejects a candidate as constant
 	 */
-	bool decodeExpression(const std::vector<unsigned int>& sequence, unsigned int& ptr, unsigned int& wraps, std::shared_ptr<Expression<T>>& outExpression) const;
+	template<typename Gene>
+	bool decodeProgram(const Gene* sequence, unsigned int length, DecodeRecord<T>& record, unsigned int firstChanged) const;
 
 	/**
-	 * Decodes an operation recursively; returns false if the sequence is found invalid
-	 */
-	bool decodeOperation(const std::vector<unsigned int>& sequence, unsigned int& ptr, unsigned int& wraps, std::shared_ptr<Expression<T>>& outOperation) const;
-
-	/**
-	 * Decodes a function recursively; returns false if the sequence is found invalid
+	 * Instantiates and returns a random function/operation/var on a random probability
 	 */
-	bool decodeFunction(const std::vector<unsigned int>& sequence, unsigned int& ptr, unsigned int& wraps, std::shared_ptr<Expression<T>>& outFunction) const;
+	const ExpressionPtr<T> instantiateFunction(const ExpressionPtr<T> a, Random::Rng& rng) const;
+	const ExpressionPtr<T> instantiateOperation(const ExpressionPtr<T> a, const ExpressionPtr<T> b, Random::Rng& rng) const;
+	const ExpressionPtr<T> instantiateVar(Random::Rng& rng) const;
+	const ExpressionPtr<T> instantiateConstant(Random::Rng& rng) const;
+	const ExpressionPtr<T> instantiateExpression(Random::Rng& rng, int maxDepth = 3, int depth = 0) const;
 
-	/**
-	 * Decodes a dimensional variable (x, y, z, etc)
-	 */
-	bool decodeVariable(const std::vector<unsigned int>& sequence, unsigned int& ptr, unsigned int& wraps, std::shared_ptr<Expression<T>>& outVariable) const;
+private:
 
 	/**
-	 * Decodes a constant recursively; returns false if the sequence is found invalid
+	 * Reads the gene under the pointer and moves the pointer forward, wrapping around the sequence if needed; returns false if it wrapped around too many times
 	 */
-	bool decodeConstant(const std::vector<unsigned int>& sequence, unsigned int& ptr, unsigned int& wraps, std::shared_ptr<Expression<T>>& outConstant) const;
+	template<typename Gene>
+	inline bool read(const Gene* sequence, unsigned int length, unsigned int& ptr, unsigned int& wraps, int& head) const {
+		head = sequence[ptr];
+		++ptr;
+		if (ptr >= length) {
+			ptr = 0;
+			++wraps;
+			if (wraps >= (unsigned int)maxWraparounds) {
+				return false;
+			}
+		}
+		return true;
+	}
 
 };// class GrammarDecoder
 
 
 
 template<typename T>
-inline const ExpressionPtr<T> GrammarDecoder<T>::decode(const std::vector<unsigned int>& sequence) const {
+template<typename Gene>
+inline const ExpressionPtr<T> GrammarDecoder<T>::decode(const Gene* sequence, unsigned int length) const {
+	Program<T> program;
+	if (!decodeProgram(sequence, length, program)) return nullptr;
+	return program.toExpression();
+}
+
+template<typename T>
+template<typename Gene>
+inline bool GrammarDecoder<T>::decodeProgram(const Gene* sequence, unsigned int length, Program<T>& program, unsigned int* consumed) const {
+
+	// The grammar is walked through with an explicit stack of pending tasks rather than recursively
+	// Instructions are emitted in postfix order: operands first, then the operation or function that applies to them
+	enum Task : unsigned char {
+		DecodeExpression, // decode a full expression
+		DecodeOperator, // read the operation type, placed between an operation's two operands in the sequence, then decode the second operand
+		Emit // emit the instruction for an operation or function whose operands have all been emitted
+	};
+	struct Frame {
+		Task task;
+		ExpressionType type;
+	};
+	thread_local std::vector<Frame> stack;
+	stack.clear();
+	program.clear();
 
 	unsigned int ptr = 0;
 	unsigned int wraps = 0;
-	std::shared_ptr<Expression<T>> expression;
-	
-	// Attempt to decode the whole sequence as an overarching expression
-	if (!decodeExpression(sequence, ptr, wraps, expression)) return nullptr;
+	int head;
+	stack.push_back({ DecodeExpression, ExpressionType::Constant });
+
+	while (!stack.empty()) {
+		Frame frame = stack.back();
+		stack.pop_back();
+		switch (frame.task) {
+
+		case DecodeExpression:
+			if (!read(sequence, length, ptr, wraps, head)) return false;
+			switch (head % 4) {
+			case 0:
+				// operation - the first operand is given first, before the actual operation type
+				stack.push_back({ DecodeOperator, ExpressionType::Constant });
+				stack.push_back({ DecodeExpression, ExpressionType::Constant });
+				break;
+			case 1:
+				// function
+				if (!read(sequence, length, ptr, wraps, head)) return false;
+				stack.push_back({ Emit, functionTypes[head % functionTypes.size()] });
+				stack.push_back({ DecodeExpression, ExpressionType::Constant });
+				break;
+			case 2:
+				// digit
+				if (!read(sequence, length, ptr, wraps, head)) return false;
+				program.push(ExpressionType::Constant, constants[head % constants.size()]);
+				break;
+			case 3:
+				// x, y, z, ... (depending on dimensionality of problem)
+				if (!read(sequence, length, ptr, wraps, head)) return false;
+				program.push(variableTypes[head % variableTypes.size()]);
+				break;
+			}
+			break;
+
+		case DecodeOperator:
+			if (!read(sequence, length, ptr, wraps, head)) return false;
+			stack.push_back({ Emit, operationTypes[head % operationTypes.size()] });
+			stack.push_back({ DecodeExpression, ExpressionType::Constant });
+			break;
+
+		case Emit:
+			program.push(frame.type);
+			break;
+		}
+	}
 
-	return expression;
+	if (consumed) {
+		*consumed = wraps == 0 ? ptr : length; // wrapping around means the whole sequence was read
+	}
+	return true;
 }
 
 template<typename T>
-inline const ExpressionPtr<T> GrammarDecoder<T>::instantiateFunction(const ExpressionPtr<T> a, std::mt19937& rng) const {
-	return functions[abs(int(rng())) % functions.size()]->instantiate1Arg(a);
+template<typename Gene>
+inline bool GrammarDecoder<T>::decodeProgram(const Gene* sequence, unsigned int length, DecodeRecord<T>& record, unsigned int firstChanged) const {
+
+	// nothing the program was decoded from has changed
+	if (record.valid && firstChanged >= record.consumed) {
+		return record.success;
+	}
+
+	record.valid = true;
+	record.consumed = length;
+	record.success = decodeProgram(sequence, length, record.program, &record.consumed);
+	if (record.success) {
+		// programs are scored after simplification, as their trees used to be, so that e.g. 0 * log(x - 10) is valid everywhere
+		record.constant = record.program.isConstant();
+		record.program.simplify();
+		record.hash = record.program.hash();
+	}
+	return record.success;
+}
+
+template<typename T>
+inline const ExpressionPtr<T> GrammarDecoder<T>::instantiateFunction(const ExpressionPtr<T> a, Random::Rng& rng) const {
+	return functions[Random::bounded(rng, uint32_t(functions.size()))]->instantiate1Arg(a);
 }
 
 template<typename T>
-inline const ExpressionPtr<T> GrammarDecoder<T>::instantiateOperation(const ExpressionPtr<T> a, const ExpressionPtr<T> b, std::mt19937& rng) const {
-	return operations[abs(int(rng())) % operations.size()]->instantiate2Args(a, b);
+inline const ExpressionPtr<T> GrammarDecoder<T>::instantiateOperation(const ExpressionPtr<T> a, const ExpressionPtr<T> b, Random::Rng& rng) const {
+	return operations[Random::bounded(rng, uint32_t(operations.size()))]->instantiate2Args(a, b);
 }
 
 template<typename T>
-inline const ExpressionPtr<T> GrammarDecoder<T>::instantiateVar(std::mt19937& rng) const {
-	return variables[abs(int(rng())) % variables.size()]->instantiate0Args();
+inline const ExpressionPtr<T> GrammarDecoder<T>::instantiateVar(Random::Rng& rng) const {
+	return variables[Random::bounded(rng, uint32_t(variables.size()))]->instantiate0Args();
 }
 
 template<typename T>
-inline const ExpressionPtr<T> GrammarDecoder<T>::instantiateConstant(std::mt19937& rng) const {
-	return ConstantPtr(T, constants[abs(int(rng())) % constants.size()]);
+inline const ExpressionPtr<T> GrammarDecoder<T>::instantiateConstant(Random::Rng& rng) const {
+	return ConstantPtr(T, constants[Random::bounded(rng, uint32_t(constants.size()))]);
 }
 
 template<typename T>
-inline const ExpressionPtr<T> GrammarDecoder<T>::instantiateExpression(std::mt19937& rng, int maxDepth, int depth) const {
+inline const ExpressionPtr<T> GrammarDecoder<T>::instantiateExpression(Random::Rng& rng, int maxDepth, int depth) const {
 	if (depth >= maxDepth) { // prevent creating sub-trees too deeply nested
-		return abs(int(rng())) % 2 == 0 ? instantiateConstant(rng) : instantiateVar(rng);
+		return Random::bounded(rng, 2) == 0 ? instantiateConstant(rng) : instantiateVar(rng);
 	}
-	switch (abs(int(rng())) % 4) {
+	switch (Random::bounded(rng, 4)) {
 	case 0:
 		return instantiateConstant(rng);
 	case 1:
@@ -201,132 +339,3 @@ inline const ExpressionPtr<T> GrammarDecoder<T>::instantiateExpression(std::mt19
 		return instantiateOperation(instantiateExpression(rng, maxDepth, depth+1), instantiateExpression(rng, maxDepth, depth+1), rng);
 	}
 }
-
-template<typename T>
-inline bool GrammarDecoder<T>::decodeExpression(const std::vector<unsigned int>& sequence, unsigned int& ptr, unsigned int& wraps, std::shared_ptr<Expression<T>>& outExpression) const {
-
-	// walk through sequence
-	int head = sequence[ptr];
-	++ptr;
-	if (ptr >= sequence.size()) {
-		ptr = 0;
-		++wraps;
-		if (wraps >= maxWraparounds) {
-			return false;
-		}
-	}
-
-	switch (head % 4) {
-	case 0:
-		// operation
-		if(!decodeOperation(sequence, ptr, wraps, outExpression)) return false;
-		break;
-	case 1:
-		// function
-		if(!decodeFunction(sequence, ptr, wraps, outExpression)) return false;
-		break;
-	case 2:
-		// digit
-		if(!decodeConstant(sequence, ptr, wraps, outExpression)) return false;
-		break;
-	case 3:
-		// x, y, z, ... (depending on dimensionality of problem)
-		if (!decodeVariable(sequence, ptr, wraps, outExpression)) return false;
-		break;
-	}
-
-	return true;
-}
-
-template<typename T>
-inline bool GrammarDecoder<T>::decodeOperation(const std::vector<unsigned int>& sequence, unsigned int& ptr, unsigned int& wraps, std::shared_ptr<Expression<T>>& outOperation) const {
-
-	// obtain the two expressions to place on either side of the operation
-	std::shared_ptr<Expression<T>> a, b;
-	if (!decodeExpression(sequence, ptr, wraps, a)) return false;
-	
-	// walk through sequence - for operations, the first operand is given first (before the actual operation type)
-	int head = sequence[ptr];
-	++ptr;
-	if (ptr >= sequence.size()) {
-		ptr = 0;
-		++wraps;
-		if (wraps >= maxWraparounds) {
-			return false;
-		}
-	}
-
-	if (!decodeExpression(sequence, ptr, wraps, b)) return false;
-
-	// decode the head into one of the available operations
-	outOperation = operations[head % operations.size()]->instantiate2Args(a, b);
-	assert(outOperation);
-
-	return true;
-}
-
-template<typename T>
-inline bool GrammarDecoder<T>::decodeFunction(const std::vector<unsigned int>& sequence, unsigned int& ptr, unsigned int& wraps, std::shared_ptr<Expression<T>>& outFunction) const {
-
-	// walk through sequence
-	int head = sequence[ptr];
-	++ptr;
-	if (ptr >= sequence.size()) {
-		ptr = 0;
-		++wraps;
-		if (wraps >= maxWraparounds) {
-			return false;
-		}
-	}
-
-	// obtain the expression that lives inside the function
-	std::shared_ptr<Expression<T>> inner;
-	if (!decodeExpression(sequence, ptr, wraps, inner)) return false;
-
-	// decode the head into one of the available functions
-	outFunction = functions[head % functions.size()]->instantiate1Arg(inner);
-	assert(outFunction);
-
-	return true;
-}
-
-template<typename T>
-inline bool GrammarDecoder<T>::decodeVariable(const std::vector<unsigned int>& sequence, unsigned int& ptr, unsigned int& wraps, std::shared_ptr<Expression<T>>& outVariable) const {
-
-	// walk through sequence
-	int head = sequence[ptr];
-	++ptr;
-	if (ptr >= sequence.size()) {
-		ptr = 0;
-		++wraps;
-		if (wraps >= maxWraparounds) {
-			return false;
-		}
-	}
-
-	// decode the head into one of the available functions
-	outVariable = variables[head % variables.size()]->instantiate0Args();
-	assert(outVariable);
-
-	return true;
-}
-
-template<typename T>
-inline bool GrammarDecoder<T>::decodeConstant(const std::vector<unsigned int>& sequence, unsigned int& ptr, unsigned int& wraps, std::shared_ptr<Expression<T>>& outConstant) const {
-
-	// walk through sequence
-	int head = sequence[ptr];
-	++ptr;
-	if (ptr >= sequence.size()) {
-		ptr = 0;
-		++wraps;
-		if (wraps >= maxWraparounds) {
-			return false;
-		}
-	}
-
-	// one of the available constants
-	outConstant = ConstantPtr(T, constants[head % constants.size()]);
-
-	return true;
-}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+
+
+/**
+ * Runs a queue of independent jobs on a fixed number of worker threads
+ * Jobs are started in decreasing order of expected cost, so that the longest jobs don't end up running alone at the end while other cores sit idle
+ */
+class JobScheduler {
+private:
+
+	struct Job {
+		double cost;
+		std::function<void()> run;
+	};
+
+	std::vector<Job> jobs;
+
+public:
+
+	/**
+	 * Adds a job to the queue, along with an estimate of how long it will take to run (in any unit, as long as it is the same for all jobs)
+	 */
+	inline void add(double expectedCost, std::function<void()> job) { jobs.push_back({ expectedCost, job }); }
+
+	inline size_t size() const { return jobs.size(); }
+
+	/**
+	 * Runs all jobs in the queue using the given number of worker threads (0 to use one per hardware thread), and blocks until they have all completed
+	 * Jobs with the same expected cost run in the order they were added; exceptions thrown by a job are reported without stopping the other jobs
+	 * Returns the number of jobs that failed
+	 */
+	size_t run(unsigned int threads = 0);
+
+}; // class JobScheduler
+
+
+
+inline size_t JobScheduler::run(unsigned int threads) {
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	threads = std::min(threads, (unsigned int)jobs.size());
+
+	std::stable_sort(jobs.begin(), jobs.end(), [](const Job& a, const Job& b) -> bool {
+		return a.cost > b.cost;
+	});
+
+	// each worker takes the next job in the queue as soon as it is done with its previous one
+	std::atomic<size_t> next(0);
+	std::atomic<size_t> failed(0);
+	auto worker = [&]() {
+		for (size_t i = next++; i < jobs.size(); i = next++) {
+			try {
+				jobs[i].run();
+			} catch (const char* e) {
+				fprintf(stderr, "Job failed: %s\n", e);
+				++failed;
+			} catch (...) {
+				fprintf(stderr, "Job failed\n");
+				++failed;
+			}
+		}
+	};
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < threads; ++i) {
+		workers.emplace_back(worker);
+	}
+	for (auto& w : workers) {
+		w.join();
+	}
+	jobs.clear();
+	return failed;
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+
+
+/**
+ * JSON value parsed by JsonReader: null, boolean, number, string, array or object
+ * Members of objects are kept in the order they appear in the document
+ */
+class JsonValue {
+public:
+
+	enum class Type { Null, Boolean, Number, String, Array, Object };
+
+	Type type = Type::Null;
+	bool boolean = false;
+	double number = 0;
+	std::string string;
+	std::vector<JsonValue> elements; // elements of an array
+	std::vector<std::pair<std::string, JsonValue>> members; // members of an object
+
+	inline bool isNull() const { return type == Type::Null; }
+
+	/**
+	 * Returns the member of an object with the given name, or a null value if there is none
+	 */
+	const JsonValue& operator[](const std::string& name) const;
+
+	/**
+	 * Returns the element of an array at the given index, or a null value if there is none
+	 */
+	const JsonValue& operator[](size_t index) const;
+
+	inline size_t size() const { return type == Type::Array ? elements.size() : members.size(); }
+
+	/**
+	 * Returns the value as a number or a string, or the given default value if it is of another type
+	 */
+	inline double asNumber(double defaultValue = 0) const { return type == Type::Number ? number : defaultValue; }
+	inline std::string asString(const std::string& defaultValue = "") const { return type == Type::String ? string : defaultValue; }
+
+}; // class JsonValue
+
+
+/**
+ * Parses JSON documents, such as the results files of runs; throws on invalid documents
+ * Strings are expected to be ASCII: \u escapes of other characters are replaced by '?'
+ */
+class JsonReader {
+private:
+
+	const char* p;
+	const char* end;
+
+public:
+
+	/**
+	 * Parses a complete document
+	 */
+	static JsonValue parse(const char* data, size_t size);
+	static inline JsonValue parse(const std::string& s) { return parse(s.data(), s.size()); }
+	static inline JsonValue parse(const std::vector<char>& data) { return parse(data.data(), data.size()); }
+
+private:
+
+	JsonReader(const char* data, size_t size) : p(data), end(data + size) {}
+
+	JsonValue value();
+	std::string string();
+	void skipWhitespace();
+	void expect(const char* literal);
+
+}; // class JsonReader
+
+
+
+inline const JsonValue& JsonValue::operator[](const std::string& name) const {
+	static const JsonValue none;
+	for (auto& member : members) {
+		if (member.first == name) return member.second;
+	}
+	return none;
+}
+
+inline const JsonValue& JsonValue::operator[](size_t index) const {
+	static const JsonValue none;
+	return index < elements.size() ? elements[index] : none;
+}
+
+inline JsonValue JsonReader::parse(const char* data, size_t size) {
+	JsonReader reader(data, size);
+	JsonValue v = reader.value();
+	reader.skipWhitespace();
+	if (reader.p != reader.end) {
+		throw "Unexpected data after json document";
+	}
+	return v;
+}
+
+inline void JsonReader::skipWhitespace() {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+}
+
+inline void JsonReader::expect(const char* literal) {
+	size_t length = strlen(literal);
+	if (size_t(end - p) < length || strncmp(p, literal, length) != 0) {
+		throw "Invalid json literal";
+	}
+	p += length;
+}
+
+inline JsonValue JsonReader::value() {
+	skipWhitespace();
+	if (p >= end) {
+		throw "Unexpected end of json document";
+	}
+	JsonValue v;
+	switch (*p) {
+	case '{':
+		v.type = JsonValue::Type::Object;
+		++p;
+		skipWhitespace();
+		if (p < end && *p == '}') {
+			++p;
+			return v;
+		}
+		while (true) {
+			skipWhitespace();
+			std::string name = string();
+			skipWhitespace();
+			expect(":");
+			v.members.emplace_back(name, value());
+			skipWhitespace();
+			if (p < end && *p == ',') {
+				++p;
+			} else {
+				expect("}");
+				return v;
+			}
+		}
+	case '[':
+		v.type = JsonValue::Type::Array;
+		++p;
+		skipWhitespace();
+		if (p < end && *p == ']') {
+			++p;
+			return v;
+		}
+		while (true) {
+			v.elements.push_back(value());
+			skipWhitespace();
+			if (p < end && *p == ',') {
+				++p;
+			} else {
+				expect("]");
+				return v;
+			}
+		}
+	case '"':
+		v.type = JsonValue::Type::String;
+		v.string = string();
+		return v;
+	case 't':
+		expect("true");
+		v.type = JsonValue::Type::Boolean;
+		v.boolean = true;
+		return v;
+	case 'f':
+		expect("false");
+		v.type = JsonValue::Type::Boolean;
+		return v;
+	case 'n':
+		expect("null");
+		return v;
+	default: {
+		// strtod needs a null-terminated string, so the number is copied out first (numbers are short)
+		const char* start = p;
+		while (p < end && strchr("+-0123456789.eE", *p)) ++p;
+		std::string number(start, p);
+		char* parsed;
+		v.number = strtod(number.c_str(), &parsed);
+		if (number.empty() || *parsed != '\0') {
+			throw "Invalid json number";
+		}
+		v.type = JsonValue::Type::Number;
+		return v;
+	}
+	}
+}
+
+inline std::string JsonReader::string() {
+	expect("\"");
+	std::string s;
+	while (true) {
+		if (p >= end) {
+			throw "Unterminated json string";
+		}
+		char c = *p++;
+		if (c == '"') return s;
+		if (c != '\\') {
+			s += c;
+			continue;
+		}
+		if (p >= end) {
+			throw "Unterminated json string";
+		}
+		c = *p++;
+		switch (c) {
+		case 'n': s += '\n'; break;
+		case 'r': s += '\r'; break;
+		case 't': s += '\t'; break;
+		case 'b': s += '\b'; break;
+		case 'f': s += '\f'; break;
+		case 'u': {
+			if (end - p < 4) {
+				throw "Invalid json escape";
+			}
+			unsigned int code = (unsigned int)strtoul(std::string(p, p + 4).c_str(), nullptr, 16);
+			s += code < 0x80 ? char(code) : '?';
+			p += 4;
+			break;
+		}
+		default: s += c; // \" \\ \/
+		}
+	}
+}
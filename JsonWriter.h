@@ -0,0 +1,267 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include "FileWriter.h"
+#include "Serialization.h"
+
+
+/**
+ * Writes a JSON document to a file incrementally, without ever holding the whole document in memory
+ * Text is appended to the file through a FileWriter::AsyncAppender, i.e. written out in the background whenever its buffer is full
+ * Commas between the elements of objects and arrays are inserted automatically, and strings are escaped
+ */
+class JsonWriter {
+private:
+
+	FileWriter::AsyncAppender file;
+
+	/**
+	 * One entry per open object or array, telling whether it already holds an element (and hence whether the next one needs a comma)
+	 */
+	std::vector<char> scopes;
+
+	/**
+	 * Whether a key was just written, in which case the next value belongs to it and must not be preceded by a comma
+	 */
+	bool afterKey = false;
+
+public:
+
+	inline JsonWriter(size_t capacity = 1 << 16) : file(capacity) {}
+
+	/**
+	 * Starts writing a new document to the given file, replacing any existing file
+	 */
+	void open(const std::string& filename);
+
+	/**
+	 * Opens and closes objects and arrays
+	 */
+	void beginObject();
+	void endObject();
+	void beginArray();
+	void endArray();
+
+	/**
+	 * Writes the key of the next member of the current object
+	 */
+	JsonWriter& key(const std::string& name);
+
+	/**
+	 * Writes a value, either as an element of the current array or as the value of the last key
+	 * Non-finite numbers, which JSON cannot represent, are written as null
+	 */
+	void value(const std::string& s);
+	void value(const char* s);
+	void value(bool b);
+	void value(int i);
+	void value(unsigned int i);
+	void value(int64_t i);
+	void value(uint64_t i);
+	void value(float f);
+	void value(double d);
+	void null();
+
+	/**
+	 * Writes the complete contents of the buffer to the file, and blocks until they are on disk
+	 */
+	void flush();
+
+	/**
+	 * Flushes the document, which should be complete; the writer can then be opened again
+	 */
+	void close();
+
+	/**
+	 * Flushes the document and saves the state of the writer, such that writing can be resumed later on from this point (e.g. from a checkpoint)
+	 */
+	void save(Serialization::BinaryWriter& writer);
+
+	/**
+	 * Resumes writing a document from a state saved with save(); anything written to the file after the state was saved is discarded
+	 */
+	void load(Serialization::BinaryReader& reader);
+
+	inline bool isOpen() const { return !file.getFilename().empty(); }
+
+	/**
+	 * Returns a string escaped and quoted as a JSON string literal
+	 */
+	static std::string quote(const std::string& s);
+
+private:
+
+	/**
+	 * Inserts the comma that separates a new element from the previous one in the current object or array, if needed
+	 */
+	void separate();
+
+	/**
+	 * Writes a number with the given format, or with the fallback format if the first one does not read back as the same number (in single precision if single is true)
+	 */
+	void number(const char* format, double d, const char* fallback, bool single);
+
+}; // class JsonWriter
+
+
+
+inline void JsonWriter::open(const std::string& filename) {
+	file.open(filename);
+	scopes.clear();
+	afterKey = false;
+}
+
+inline void JsonWriter::beginObject() {
+	separate();
+	file.append('{');
+	scopes.push_back(0);
+}
+
+inline void JsonWriter::endObject() {
+	file.append('}');
+	scopes.pop_back();
+}
+
+inline void JsonWriter::beginArray() {
+	separate();
+	file.append('[');
+	scopes.push_back(0);
+}
+
+inline void JsonWriter::endArray() {
+	file.append(']');
+	scopes.pop_back();
+}
+
+inline JsonWriter& JsonWriter::key(const std::string& name) {
+	separate();
+	file.append(quote(name));
+	file.append(':');
+	afterKey = true;
+	return *this;
+}
+
+inline void JsonWriter::value(const std::string& s) {
+	separate();
+	file.append(quote(s));
+}
+
+inline void JsonWriter::value(const char* s) {
+	value(std::string(s));
+}
+
+inline void JsonWriter::value(bool b) {
+	separate();
+	file.append(b ? "true" : "false");
+}
+
+inline void JsonWriter::value(int i) {
+	separate();
+	file.append(std::to_string(i));
+}
+
+inline void JsonWriter::value(unsigned int i) {
+	separate();
+	file.append(std::to_string(i));
+}
+
+inline void JsonWriter::value(int64_t i) {
+	separate();
+	file.append(std::to_string(i));
+}
+
+inline void JsonWriter::value(uint64_t i) {
+	separate();
+	file.append(std::to_string(i));
+}
+
+inline void JsonWriter::value(float f) {
+	// shortest of the two formats that reads back as the same float, so that e.g. 0.05f is written as 0.05
+	number("%.7g", f, "%.9g", true);
+}
+
+inline void JsonWriter::value(double d) {
+	number("%.15g", d, "%.17g", false);
+}
+
+inline void JsonWriter::null() {
+	separate();
+	file.append("null");
+}
+
+inline void JsonWriter::number(const char* format, double d, const char* fallback, bool single) {
+	if (!std::isfinite(d)) {
+		null();
+		return;
+	}
+	separate();
+	char s[32];
+	snprintf(s, sizeof(s), format, d);
+	double read = strtod(s, nullptr);
+	if (single ? float(read) != float(d) : read != d) {
+		snprintf(s, sizeof(s), fallback, d);
+	}
+	file.append(s);
+}
+
+inline void JsonWriter::separate() {
+	if (afterKey) {
+		afterKey = false;
+		return;
+	}
+	if (!scopes.empty()) {
+		if (scopes.back()) file.append(',');
+		scopes.back() = 1;
+	}
+}
+
+inline void JsonWriter::flush() {
+	file.flush();
+}
+
+inline void JsonWriter::close() {
+	file.close();
+}
+
+inline void JsonWriter::save(Serialization::BinaryWriter& writer) {
+	flush();
+	writer.writeString(file.getFilename());
+	writer.write<uint64_t>(file.size());
+	writer.writeString(std::string(scopes.begin(), scopes.end()));
+	writer.write<bool>(afterKey);
+}
+
+inline void JsonWriter::load(Serialization::BinaryReader& reader) {
+	std::string filename = reader.readString();
+	uint64_t size = reader.read<uint64_t>();
+	std::string s = reader.readString();
+	scopes.assign(s.begin(), s.end());
+	afterKey = reader.read<bool>();
+	file.resume(filename, size);
+}
+
+inline std::string JsonWriter::quote(const std::string& s) {
+	std::string q = "\"";
+	for (char c : s) {
+		switch (c) {
+		case '"': q += "\\\""; break;
+		case '\\': q += "\\\\"; break;
+		case '\n': q += "\\n"; break;
+		case '\r': q += "\\r"; break;
+		case '\t': q += "\\t"; break;
+		default:
+			if ((unsigned char)c < 0x20) {
+				char u[8];
+				snprintf(u, sizeof(u), "\\u%04x", (unsigned char)c);
+				q += u;
+			} else {
+				q += c;
+			}
+		}
+	}
+	return q + "\"";
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Expression.h"
+#include "Build.h"
 #include "Multiplication.h"
 #include "Division.h"
 
@@ -10,7 +11,7 @@ private:
 	ExpressionPtr<T> a;
 public:
 
-	Logarithm(ExpressionPtr<T> a) : a(a) {}
+	Logarithm(ExpressionPtr<T> a) : Expression<T>(ExpressionType::Logarithm, 0, a.get()), a(a) {}
 
 	T evaluate(T x, T y) const override;
 
@@ -24,7 +25,15 @@ public:
 
 	bool isConstant() const override { return a->isConstant(); }
 
-	ExpressionPtr<T> mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+	ExpressionPtr<T> mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+
+	static const ExpressionType Type = ExpressionType::Logarithm;
+
+	ExpressionType type() const override { return Type; }
+
+	int childCount() const override { return 1; }
+
+	ExpressionPtr<T> child(int i) const override { return a; }
 
 };
 #define LogarithmPtr(T, a) ExpressionPtr<T>(new Logarithm<T>(a))
@@ -44,7 +53,7 @@ inline T Logarithm<T>::evaluate(T x, T y) const {
 
 template<typename T>
 inline ExpressionPtr<T> Logarithm<T>::derivative(int dimension) const {
-	return DivisionPtr(T, a->derivative(dimension), a); // ln'(f) = f' / f
+	return Build::divide(a->derivative(dimension), a); // ln'(f) = f' / f
 }
 
 template<typename T>
@@ -56,11 +65,14 @@ inline ExpressionPtr<T> Logarithm<T>::simplify() const {
 }
 
 template<typename T>
-inline ExpressionPtr<T> Logarithm<T>::mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
+inline ExpressionPtr<T> Logarithm<T>::mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
 	TREE_MUTATION();
 	auto newA = a->mutate(rng, mutationChance, treeMutationChance, grammar, false);
 	if (MUTATION) {
 		return grammar->instantiateFunction(newA, rng);
 	}
+	if (newA == a) {
+		return this->self(); // nothing changed, keep sharing the same node
+	}
 	return LogarithmPtr(T, newA);
 }
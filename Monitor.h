@@ -0,0 +1,252 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#if defined(__unix__) || defined(__APPLE__)
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#define MONITOR_SHARED_MEMORY
+#endif
+#include "RunListener.h"
+
+
+/// Live progress of the runs of a process, published into a POSIX shared memory region named /ga-ode-<pid> that the monitor tool attaches to
+/// Each run owns one slot of the region and is its only writer; slots are updated with seqlock-style writes, so that writers never wait and readers retry on torn reads
+/// Where shared memory isn't available, or the region can't be created, a warning is printed once and nothing is published
+
+
+namespace Monitor {
+
+	static const uint32_t Magic = 0x4E4D4147; // "GAMN" in little-endian order
+	static const uint32_t Version = 1;
+	static const uint32_t SlotCount = 256; // slots are reused in a round-robin fashion, so this bounds the number of runs shown, not the number of runs of the process
+
+	enum Status : uint32_t {
+		Free, // never used
+		Running,
+		Finished
+	};
+
+	/**
+	 * Progress of a run, as published in its slot
+	 */
+	struct Progress {
+		char name[48]; // name of the problem, truncated if needed
+		int32_t seed;
+		uint32_t status;
+		int32_t generation;
+		int32_t maxGeneration;
+		int32_t restarts;
+		float meanSize; // mean number of nodes of the expressions in the current generation
+		double fitness; // best fitness so far
+		uint64_t evaluations;
+		double evaluationsPerSecond; // over the last second or so
+		double seconds; // wall-clock time since the start of the run
+		double eta; // estimated number of seconds until the run stops, according to its budgets
+		char stopReason[16]; // set once the run has finished
+	};
+
+	/**
+	 * Slot of a single run: the sequence number is odd while the progress is being written
+	 */
+	struct Slot {
+		std::atomic<uint32_t> sequence;
+		Progress progress;
+	};
+
+	/**
+	 * Layout of the shared memory region
+	 */
+	struct Region {
+		uint32_t magic; // written last when creating the region, once everything else is initialized
+		uint32_t version;
+		uint32_t slotCount;
+		int32_t pid;
+		int64_t startTime; // unix time at which the region was created
+		std::atomic<uint32_t> nextSlot;
+		Slot slots[SlotCount];
+	};
+
+	/**
+	 * Returns the name of the shared memory region of a process
+	 */
+	inline std::string regionName(int pid) {
+		return "/ga-ode-" + std::to_string(pid);
+	}
+
+	/**
+	 * Publishes the progress of a run into its slot; only one thread may write to a slot
+	 */
+	inline void write(Slot& slot, const Progress& progress) {
+		uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+		slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy(&slot.progress, &progress, sizeof(Progress));
+		slot.sequence.store(sequence + 2, std::memory_order_release);
+	}
+
+	/**
+	 * Reads a consistent copy of the progress in a slot; returns false if the slot was being written each time it was read
+	 */
+	inline bool read(const Slot& slot, Progress& progress) {
+		for (int attempt = 0; attempt < 100; ++attempt) {
+			uint32_t before = slot.sequence.load(std::memory_order_acquire);
+			if (before & 1) continue;
+			memcpy(&progress, (const void*)&slot.progress, sizeof(Progress));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.sequence.load(std::memory_order_relaxed) == before) return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Shared memory region of the current process, created on first use and removed when the process exits
+	 */
+	class Publisher {
+	private:
+		Region* region = nullptr;
+
+		inline Publisher() {
+#ifdef MONITOR_SHARED_MEMORY
+			std::string name = regionName(int(getpid()));
+			int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+			if (fd < 0 || ftruncate(fd, sizeof(Region)) != 0) {
+				fprintf(stderr, "Could not create shared memory region %s for monitoring: %s\n", name.c_str(), strerror(errno));
+				if (fd >= 0) close(fd);
+				return;
+			}
+			void* p = mmap(nullptr, sizeof(Region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			close(fd);
+			if (p == MAP_FAILED) {
+				fprintf(stderr, "Could not map shared memory region %s for monitoring: %s\n", name.c_str(), strerror(errno));
+				shm_unlink(name.c_str());
+				return;
+			}
+			region = (Region*)p; // zero-filled by ftruncate, which is a valid initial state for every field
+			region->version = Version;
+			region->slotCount = SlotCount;
+			region->pid = int32_t(getpid());
+			region->startTime = time(nullptr);
+			std::atomic_thread_fence(std::memory_order_release);
+			region->magic = Magic;
+#else
+			fprintf(stderr, "Monitoring is only supported on systems with POSIX shared memory\n");
+#endif
+		}
+
+		inline ~Publisher() {
+#ifdef MONITOR_SHARED_MEMORY
+			if (region) {
+				munmap(region, sizeof(Region));
+				shm_unlink(regionName(int(getpid())).c_str());
+			}
+#endif
+		}
+
+	public:
+
+		Publisher(const Publisher&) = delete;
+		Publisher& operator=(const Publisher&) = delete;
+
+		static inline Publisher& instance() {
+			static Publisher publisher;
+			return publisher;
+		}
+
+		/**
+		 * Returns a slot for a new run, or nullptr if the region couldn't be created
+		 */
+		inline Slot* acquire() {
+			if (!region) return nullptr;
+			return &region->slots[region->nextSlot.fetch_add(1, std::memory_order_relaxed) % SlotCount];
+		}
+	};
+
+};
+
+
+
+/**
+ * Publishes the progress of a run for the monitor tool, after every generation
+ * Publishing only copies a few bytes into shared memory, without any lock or system call
+ */
+template<typename T>
+class MonitorRunLog : public RunListener<T> {
+private:
+
+	Monitor::Slot* slot = nullptr;
+	Monitor::Progress progress;
+
+	/**
+	 * Evaluations and time at the start of the window over which the evaluation rate is measured
+	 */
+	uint64_t windowEvaluations = 0;
+	double windowSeconds = 0;
+
+	void publish(const RunState<T>& state, Monitor::Status status);
+
+public:
+
+	void runStarted(const RunState<T>& state) override { publish(state, Monitor::Running); }
+	void generationDone(const RunState<T>& state) override { publish(state, Monitor::Running); }
+	void runFinished(const RunState<T>& state) override { publish(state, Monitor::Finished); }
+
+}; // class MonitorRunLog
+
+
+
+template<typename T>
+inline void MonitorRunLog<T>::publish(const RunState<T>& state, Monitor::Status status) {
+	if (!slot) { // acquired here rather than in runStarted, which isn't called when a run is resumed
+		slot = Monitor::Publisher::instance().acquire();
+		if (!slot) return;
+		memset(&progress, 0, sizeof(progress));
+		strncpy(progress.name, state.name.c_str(), sizeof(progress.name) - 1);
+		progress.seed = state.seed;
+		progress.maxGeneration = state.params.generations;
+		windowEvaluations = state.evaluations;
+		windowSeconds = state.seconds;
+	}
+
+	progress.status = status;
+	progress.generation = state.generation;
+	progress.restarts = state.restarts;
+	progress.meanSize = state.meanSize;
+	progress.fitness = double(state.fitness);
+	progress.evaluations = state.evaluations;
+	progress.seconds = state.seconds;
+	if (state.seconds - windowSeconds >= 1) {
+		progress.evaluationsPerSecond = (state.evaluations - windowEvaluations) / (state.seconds - windowSeconds);
+		windowEvaluations = state.evaluations;
+		windowSeconds = state.seconds;
+	} else if (progress.evaluationsPerSecond == 0 && state.seconds > 0) {
+		progress.evaluationsPerSecond = state.evaluations / state.seconds; // until the first window is complete
+	}
+
+	// the run stops at the first budget that runs out; stagnation can't be predicted, and is left out
+	double eta = 0;
+	if (status == Monitor::Running && state.generation > 0) {
+		eta = (state.params.generations - state.generation) * state.seconds / state.generation;
+		if (state.params.timeLimit > 0) {
+			eta = std::min(eta, std::max(0.0, state.params.timeLimit - state.seconds));
+		}
+		if (state.params.evaluationLimit > 0 && progress.evaluationsPerSecond > 0) {
+			eta = std::min(eta, std::max(0.0, (state.params.evaluationLimit - state.evaluations) / progress.evaluationsPerSecond));
+		}
+	}
+	progress.eta = eta;
+	if (status == Monitor::Finished) {
+		strncpy(progress.stopReason, state.stopReason.c_str(), sizeof(progress.stopReason) - 1);
+	}
+
+	Monitor::write(*slot, progress);
+}
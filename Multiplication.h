@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Expression.h"
+#include "Build.h"
 
 template<typename T>
 class Multiplication : public Expression<T> {
@@ -9,7 +10,7 @@ private:
 	ExpressionPtr<T> b;
 public:
 
-	Multiplication(ExpressionPtr<T> a, ExpressionPtr<T> b) : a(a), b(b) {}
+	Multiplication(ExpressionPtr<T> a, ExpressionPtr<T> b) : Expression<T>(ExpressionType::Multiplication, 0, a.get(), b.get()), a(a), b(b) {}
 
 	T evaluate(T x, T y) const override;
 
@@ -23,7 +24,15 @@ public:
 
 	bool isConstant() const override { return a->isConstant() && b->isConstant(); }
 
-	ExpressionPtr<T> mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+	ExpressionPtr<T> mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+
+	static const ExpressionType Type = ExpressionType::Multiplication;
+
+	ExpressionType type() const override { return Type; }
+
+	int childCount() const override { return 2; }
+
+	ExpressionPtr<T> child(int i) const override { return i == 0 ? a : b; }
 };
 #define MultiplicationPtr(T, a, b) ExpressionPtr<T>(new Multiplication<T>(a, b))
 #define MultiplicationPtrf(a, b) MultiplicationPtr(float, a, b)
@@ -40,9 +49,9 @@ template<typename T>
 inline ExpressionPtr<T> Multiplication<T>::derivative(int dimension) const {
 	auto aPrime = a->derivative(dimension);
 	auto bPrime = b->derivative(dimension);
-	auto aTimesBPrime = MultiplicationPtr(T, a, bPrime);
-	auto bTimesAPrime = MultiplicationPtr(T, b, aPrime);
-	return AdditionPtr(T, aTimesBPrime, bTimesAPrime);
+	auto aTimesBPrime = Build::multiply(a, bPrime);
+	auto bTimesAPrime = Build::multiply(b, aPrime);
+	return Build::add(aTimesBPrime, bTimesAPrime);
 }
 
 template<typename T>
@@ -67,7 +76,7 @@ inline ExpressionPtr<T> Multiplication<T>::simplify() const {
 }
 
 template<typename T>
-inline ExpressionPtr<T> Multiplication<T>::mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
+inline ExpressionPtr<T> Multiplication<T>::mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
 	// prevent the first multiplication at the top of the tree from mutating
 	if (!first) {
 		TREE_MUTATION();
@@ -77,5 +86,8 @@ inline ExpressionPtr<T> Multiplication<T>::mutate(std::mt19937& rng, double muta
 	if (!first && MUTATION) {
 		return grammar->instantiateOperation(newA, newB, rng);
 	}
+	if (newA == a && newB == b) {
+		return this->self(); // nothing changed, keep sharing the same node
+	}
 	return MultiplicationPtr(T, newA, newB);
 }
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <atomic>
+#if defined(__linux__)
+	#include <unistd.h>
+	#include <sys/syscall.h>
+	#include <sys/ioctl.h>
+	#include <linux/perf_event.h>
+	#include <cerrno>
+#endif
+
+
+/// Hardware performance counters of the calling thread (cycles, instructions, cache and branch misses), read through Linux's perf_event_open
+/// Used by the profiler to attribute counts to the phases of a generation when PERF_COUNTERS is defined along with PROFILE
+/// Where counters can't be opened (other platforms, virtual machines without a PMU, or perf_event_paranoid too strict), all counts stay at zero
+
+
+namespace PerfCounters {
+
+	/**
+	 * Hardware events that are counted
+	 */
+	enum Event {
+		Cycles, // CPU cycles, in user space only
+		Instructions, // retired instructions, in user space only
+		CacheMisses, // last level cache misses
+		BranchMisses, // mispredicted branches
+		EventCount
+	};
+
+	static const char* const EventNames[EventCount] = { "cycles", "instructions", "cacheMisses", "branchMisses" };
+
+	/**
+	 * Values of the counters at one point in time, along with the time they were enabled and actually counting (which differ when the kernel multiplexes counters)
+	 */
+	struct Sample {
+		uint64_t values[EventCount];
+		uint64_t enabled;
+		uint64_t running;
+	};
+
+	/**
+	 * Group of counters of the calling thread, which are read at once
+	 */
+	class Group {
+	private:
+		int leader = -1;
+		int ids[EventCount]; // position of each event in the values read from the group, or -1 if the event couldn't be opened
+		int opened = 0;
+		int fds[EventCount];
+
+	public:
+
+		inline Group() {
+			for (int i = 0; i < EventCount; ++i) ids[i] = fds[i] = -1;
+#if defined(__linux__)
+			static const uint64_t configs[EventCount] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+			std::string missing;
+			for (int i = 0; i < EventCount; ++i) {
+				perf_event_attr attr;
+				memset(&attr, 0, sizeof(attr));
+				attr.size = sizeof(attr);
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = configs[i];
+				attr.disabled = leader == -1; // the whole group is enabled at once through its leader
+				attr.exclude_kernel = 1; // allowed without privileges up to perf_event_paranoid = 2
+				attr.exclude_hv = 1;
+				attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+				int fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0)); // this thread, any cpu
+				if (fd < 0) {
+					if (leader == -1) {
+						warn(std::string("Hardware performance counters unavailable (perf_event_open: ") + strerror(errno) + "), their counts will be zero");
+						return;
+					}
+					missing += std::string(missing.empty() ? "" : ", ") + EventNames[i];
+					continue;
+				}
+				if (leader == -1) leader = fd;
+				fds[i] = fd;
+				ids[i] = opened++;
+			}
+			if (!missing.empty()) {
+				warn("Hardware events not supported by this machine: " + missing + ", their counts will be zero");
+			}
+			ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+			warn("Hardware performance counters are only supported on Linux, their counts will be zero");
+#endif
+		}
+
+		inline ~Group() {
+#if defined(__linux__)
+			for (int i = 0; i < EventCount; ++i) {
+				if (fds[i] >= 0) close(fds[i]);
+			}
+#endif
+		}
+
+		Group(const Group&) = delete;
+		Group& operator=(const Group&) = delete;
+
+		inline bool available() const { return leader != -1; }
+
+		/**
+		 * Reads all counters at once; counters that aren't available read as zero
+		 */
+		inline Sample read() const {
+			Sample sample;
+			memset(&sample, 0, sizeof(sample));
+#if defined(__linux__)
+			if (leader == -1) return sample;
+			uint64_t data[3 + EventCount]; // number of events, time enabled, time running, then the value of each event
+			if (::read(leader, data, sizeof(data)) < ssize_t(3 * sizeof(uint64_t))) return sample;
+			sample.enabled = data[1];
+			sample.running = data[2];
+			for (int i = 0; i < EventCount; ++i) {
+				if (ids[i] >= 0) sample.values[i] = data[3 + ids[i]];
+			}
+#endif
+			return sample;
+		}
+
+	private:
+
+		/**
+		 * Reports once per process why counters are missing, so that zero counts aren't mistaken for measurements
+		 */
+		static inline void warn(const std::string& message) {
+			static std::atomic<bool> warned(false);
+			if (!warned.exchange(true)) {
+				fprintf(stderr, "%s\n", message.c_str());
+			}
+		}
+	};
+
+	/**
+	 * Returns the counters of the calling thread, which are opened on first use
+	 */
+	inline const Group& local() {
+		thread_local Group group;
+		return group;
+	}
+
+	/**
+	 * Adds the counts between two samples to the given totals, scaling them up if the counters only ran part of the time
+	 */
+	inline void accumulate(const Sample& start, const Sample& end, uint64_t* totals) {
+		uint64_t enabled = end.enabled - start.enabled;
+		uint64_t running = end.running - start.running;
+		double scale = running > 0 && running < enabled ? double(enabled) / running : 1;
+		for (int i = 0; i < EventCount; ++i) {
+			totals[i] += uint64_t(scale * (end.values[i] - start.values[i]));
+		}
+	}
+
+};
@@ -3,23 +3,34 @@
 #include <cassert>
 #include <vector>
 #include <algorithm>
-#include <random>
+#include <cstring>
+#include <unordered_map>
 #include "GrammarDecoder.h"
 #include "Fitness.h"
 #include "Expression.h"
+#include "Serialization.h"
+#include "DuplicatePolicy.h"
+#include "Profiler.h"
 
-#define RAND abs(int(rng()))
+#define RAND(n) Random::bounded(rng, n)
 
 
+/**
+ * Type used to store individual genes; genes are always smaller than the population's maxGeneValue, which cannot exceed 256
+ */
+typedef unsigned char Gene;
+
 /**
  * Represents a single chromosome (i.e. individual) in the population
  */
 template<typename T>
 struct Chromosome {
-	std::vector<unsigned int> genes; // individual genes that make up the chromosome
-	std::shared_ptr<Expression<T>> expression = nullptr; // the expression represented by the chromosome
+	Gene* genes = nullptr; // individual genes that make up the chromosome, as a view onto one row of the population's gene matrix
+	std::shared_ptr<Expression<T>> expression = nullptr; // the expression represented by the chromosome; only built on demand for the top performer, as fitness is computed from the decoded program
 	T fitness = INFINITY; // last fitness value computed for the chromosome
 	bool parent = false; // whether the chromosome was a parent in the given generation
+	DecodeRecord<T> record; // record of the last decoding of the genes, holding the decoded program
+	unsigned int firstChanged = 0; // position of the first gene that may have changed since the last decoding
 };
 
 /**
@@ -33,7 +44,7 @@ private:
 	/**
 	 * Random number generator to use for the population
 	 */
-	std::mt19937 rng;
+	Random::Rng rng;
 
 	/**
 	 * Gives the number of generations that the population has gone through
@@ -50,6 +61,11 @@ private:
 	 */
 	float mutationRate;
 
+	/**
+	 * Samples the gaps between mutated genes; a gene is re-assigned with the same probability as a draw of RAND(100000) > mutationRate * 100000
+	 */
+	Random::SkipSampler mutationSampler;
+
 	/**
 	 * Portion of the population that will be shuffled completely
 	 */
@@ -60,6 +76,11 @@ private:
 	 */
 	int maxGeneValue;
 
+	/**
+	 * Number of genes in each chromosome
+	 */
+	unsigned int geneCount;
+
 	/**
 	 * Fitness function, which encodes the problem at hand
 	 */
@@ -75,28 +96,126 @@ private:
 	 */
 	std::vector<Chromosome<T>> chromosomes;
 
+	/**
+	 * Genes of all chromosomes, stored contiguously as a row-major matrix with one row of geneCount genes per chromosome
+	 * Rows never move: sorting the population only reorders the chromosomes that point to them
+	 */
+	std::vector<Gene> geneMatrix;
+
+	/**
+	 * How to deal with chromosomes whose expression is identical to that of another chromosome in the same generation
+	 */
+	DuplicatePolicy duplicatePolicy = DuplicatePolicy::Share;
+
+	/**
+	 * Index of the first chromosome found for each program hash in the current generation
+	 */
+	std::unordered_map<uint64_t, size_t> firstCopies;
+
+	/**
+	 * Proportion of chromosomes whose expression was a copy of another one's in the last generation
+	 */
+	float duplicateRatio = 0;
+
+	/**
+	 * Mean number of nodes of the valid expressions of the last generation
+	 */
+	float meanSize = 0;
+
+	/**
+	 * Number of times the fitness function was computed since the population was created
+	 */
+	uint64_t evaluations = 0;
+
+	/**
+	 * Whether the fitness function changed since the fitness values of the chromosomes were computed, in which case they are all computed again
+	 */
+	bool fitnessOutdated = false;
+
 public:
 
 	/**
 	 * Default constructor; initializes the population with random values for all of the genes
+	 * Populations built with the same seed but different streams draw from independent random sequences, e.g. to run several islands from one seed
 	 */
-	Population(unsigned int n, unsigned int geneCount, float replicationRate, float mutationRate, float randomMonsters, const Fitness<T>* fitnessFunction, const GrammarDecoder<T>* decoder, unsigned int seed = 0, unsigned int maxGeneValue = 255);
+	Population(unsigned int n, unsigned int geneCount, float replicationRate, float mutationRate, float randomMonsters, const Fitness<T>* fitnessFunction, const GrammarDecoder<T>* decoder, unsigned int seed = 0, unsigned int maxGeneValue = 255, unsigned int stream = 0);
 
 	/**
 	 * Run through a single generation of the population
 	 */
 	const Chromosome<T>* nextGeneration();
 
+private:
+
+	/**
+	 * Computes the fitness of a chromosome from its decoded program
+	 */
+	void evaluate(Chromosome<T>& ch);
+
+	/**
+	 * Makes a child inherit the decoded program and fitness of the parent its genes were copied from, up to the given position
+	 */
+	void inherit(Chromosome<T>& child, const Chromosome<T>& parent, unsigned int firstChanged) const;
+
+public:
+
+	/**
+	 * Writes the full state of the population (generation counter, random number generator and genes) to a binary buffer
+	 */
+	void save(Serialization::BinaryWriter& writer) const;
+
+	/**
+	 * Restores the state of the population from a binary buffer created by save(); the population must have been constructed with the same size parameters
+	 * Running nextGeneration() after a call to load() continues exactly as the saved population would have
+	 */
+	void load(Serialization::BinaryReader& reader);
+
+	/**
+	 * Returns the number of generations that the population has gone through
+	 */
+	inline int getGeneration() const { return generation; }
+
+	/**
+	 * Sets how to deal with chromosomes whose expression is identical to that of another chromosome in the same generation
+	 */
+	inline void setDuplicatePolicy(DuplicatePolicy policy) { duplicatePolicy = policy; }
+
+	/**
+	 * Makes the next generation compute the fitness of every chromosome again, e.g. after the collocation points of the fitness function were refined
+	 */
+	inline void invalidateFitness() { fitnessOutdated = true; }
+
+	/**
+	 * Returns the proportion of chromosomes whose expression was a copy of another one's in the last generation
+	 */
+	inline float getDuplicateRatio() const { return duplicateRatio; }
+
+	/**
+	 * Returns the mean number of nodes of the valid expressions in the last generation
+	 */
+	inline float getMeanSize() const { return meanSize; }
+
+	/**
+	 * Returns the number of times the fitness function was computed since the population was created (or loaded)
+	 */
+	inline uint64_t getEvaluations() const { return evaluations; }
+
+	/**
+	 * Returns the chromosomes of the population: after a generation has run, the best ones replicated from it followed by their offspring
+	 */
+	inline const std::vector<Chromosome<T>>& getChromosomes() const { return chromosomes; }
+
 };
 
 
 
 
 template<typename T>
-inline Population<T>::Population(unsigned int n, unsigned int geneCount, float replicationRate, float mutationRate, float randomMonsters, const Fitness<T>* fitnessFunction, const GrammarDecoder<T>* decoder, unsigned int seed, unsigned int maxGeneValue) :
-				replicationRate(replicationRate), mutationRate(mutationRate), randomMonsters(randomMonsters), fitnessFunction(fitnessFunction), decoder(decoder), maxGeneValue(maxGeneValue) {
+inline Population<T>::Population(unsigned int n, unsigned int geneCount, float replicationRate, float mutationRate, float randomMonsters, const Fitness<T>* fitnessFunction, const GrammarDecoder<T>* decoder, unsigned int seed, unsigned int maxGeneValue, unsigned int stream) :
+				replicationRate(replicationRate), mutationRate(mutationRate), mutationSampler((99999 - int(mutationRate * 100000)) / 100000.0),
+				randomMonsters(randomMonsters), maxGeneValue(maxGeneValue), geneCount(geneCount), fitnessFunction(fitnessFunction), decoder(decoder) {
 
-	rng = std::mt19937(seed);
+	rng = Random::Rng(seed, stream);
 
 	assert(n >= 2);
 	assert(geneCount >= 2);
@@ -104,14 +223,16 @@ inline Population<T>::Population(unsigned int n, unsigned int geneCount, float r
 	assert(mutationRate > 0 && mutationRate < 1);
 	assert(fitnessFunction);
 	assert(decoder);
+	assert(maxGeneValue >= 1 && maxGeneValue <= 256);
 
 	// Initialize population with random genes
 	chromosomes = std::vector<Chromosome<T>>(n);
+	geneMatrix = std::vector<Gene>(size_t(n) * geneCount);
+	for (size_t i = 0; i < geneMatrix.size(); ++i) {
+		geneMatrix[i] = RAND(maxGeneValue);
+	}
 	for (int i = 0; i < n; ++i) {
-		chromosomes[i].genes = std::vector<unsigned int>(geneCount);
-		for (int j = 0; j < geneCount; ++j) {
-			chromosomes[i].genes[j] = RAND % maxGeneValue;
-		}
+		chromosomes[i].genes = &geneMatrix[size_t(i) * geneCount];
 	}
 
 }
@@ -122,26 +243,72 @@ inline const Chromosome<T>* Population<T>::nextGeneration() {
 	++generation;
 
 	// Decode chromosomes and compute each one's fitness
-	for (auto& ch : chromosomes) {
+	firstCopies.clear();
+	size_t duplicates = 0;
+	for (size_t i = 0; i < chromosomes.size(); ++i) {
+		Chromosome<T>& ch = chromosomes[i];
 		ch.parent = false;
-		ch.expression = decoder->decode(ch.genes);
-		if (ch.expression == nullptr || ch.expression->isConstant()) {
-			ch.fitness = INFINITY; // invalid expression, definitely don't want to keep this one
-		} else {
-			try {
-				ch.expression = ch.expression->simplify();
-				ch.fitness = fitnessFunction->fitness(ch.expression);
-			} catch (...) { // handle invalid expressions with /0, log(-1), etc.
+		bool changed = !ch.record.valid || ch.firstChanged < ch.record.consumed;
+		if (changed) {
+			PROFILE_SCOPE(Decode);
+			decoder->decodeProgram(ch.genes, geneCount, ch.record, ch.firstChanged);
+			ch.expression = nullptr;
+		}
+		ch.firstChanged = geneCount;
+
+		// look for a chromosome with the same expression earlier in the generation
+		if (duplicatePolicy != DuplicatePolicy::Keep && ch.record.success) {
+			auto firstCopy = firstCopies.find(ch.record.hash);
+			if (firstCopy == firstCopies.end()) {
+				firstCopies.emplace(ch.record.hash, i);
+			} else if (chromosomes[firstCopy->second].record.program == ch.record.program) {
+				++duplicates;
+				if (duplicatePolicy == DuplicatePolicy::Share) {
+					ch.fitness = chromosomes[firstCopy->second].fitness;
+					continue;
+				}
+				// replace the copy with a new random chromosome
+				for (size_t j = 0; j < geneCount; ++j) {
+					ch.genes[j] = RAND(maxGeneValue);
+				}
+				PROFILE_SCOPE(Decode);
+				decoder->decodeProgram(ch.genes, geneCount, ch.record, 0);
 				ch.expression = nullptr;
-				ch.fitness = INFINITY;
+				changed = true;
 			}
 		}
+
+		if (changed || fitnessOutdated) { // otherwise, none of the genes the program was decoded from changed, so its fitness is still up to date
+			evaluate(ch);
+		}
 	}
+	fitnessOutdated = false;
+	duplicateRatio = float(duplicates) / chromosomes.size();
+	size_t sizes = 0, valid = 0;
+	for (const Chromosome<T>& ch : chromosomes) {
+		if (ch.record.success) {
+			sizes += ch.record.program.size();
+			++valid;
+		}
+	}
+	meanSize = valid > 0 ? float(sizes) / valid : 0;
 
 	// Sort by fitness - best chromosomes at the top, worst at the end
-	std::sort(chromosomes.begin(), chromosomes.end(), [&](const Chromosome<T>& a, const Chromosome<T>& b) -> bool {
-		return a.fitness < b.fitness;
-	});
+	{
+		PROFILE_SCOPE(Sort);
+		std::sort(chromosomes.begin(), chromosomes.end(), [&](const Chromosome<T>& a, const Chromosome<T>& b) -> bool {
+			return a.fitness < b.fitness;
+		});
+	}
+
+	// Build the expression of the top performer, which is the only one that gets printed out
+	Chromosome<T>& top = chromosomes[0];
+	if (top.expression == nullptr && top.record.success) {
+		PROFILE_SCOPE(Simplify);
+		top.expression = top.record.program.toExpression()->simplify();
+	}
+
+	PROFILE_SCOPE(Breed);
 
 	unsigned int parentCount = int(replicationRate * chromosomes.size());
 	unsigned int monsterCount = int(randomMonsters * chromosomes.size());
@@ -161,17 +328,19 @@ inline const Chromosome<T>* Population<T>::nextGeneration() {
 			// for each chromosome between parent1 and parent2, there's a 50-50 chance that they will replace parent2
 			// this mimics the exact behaviour described in the original paper, without the hassle of splitting the population into K groups
 			// the parents are always the top performer and the best performer out of a random half of the full population
-			if (RAND % 2 == 0) {
+			if (RAND(2) == 0) {
 				parent2 = &chromosomes[j];
 				break;
 			}
 		}
 		// set up crossover; child 1 will get the first n genes from parent 1 and the last bit from parent 2, and inversely for chromosome 2
-		int crossoverPosition = 1 + RAND % (parent1->genes.size() - 1);
-		for (size_t j = 0; j < parent1->genes.size(); ++j) {
-			child1->genes[j] = (j < crossoverPosition ? parent1 : parent2)->genes[j];
-			child2->genes[j] = (j < crossoverPosition ? parent2 : parent1)->genes[j];
-		}
+		int crossoverPosition = 1 + RAND(geneCount - 1);
+		memcpy(child1->genes, parent1->genes, crossoverPosition);
+		memcpy(child1->genes + crossoverPosition, parent2->genes + crossoverPosition, geneCount - crossoverPosition);
+		memcpy(child2->genes, parent2->genes, crossoverPosition);
+		memcpy(child2->genes + crossoverPosition, parent1->genes + crossoverPosition, geneCount - crossoverPosition);
+		inherit(*child1, *parent1, crossoverPosition);
+		inherit(*child2, *parent2, crossoverPosition);
 		// mark parents as not being allowed to mutate
 		parent1->parent = true;
 		parent2->parent = true;
@@ -179,17 +348,23 @@ inline const Chromosome<T>* Population<T>::nextGeneration() {
 
 	// Create "monsters", i.e. completely random chromosomes
 	for (size_t i = parentCount; i < parentCount + monsterCount; ++i) {
-		for (size_t j = 0; j < chromosomes[i].genes.size(); ++j) {
-			chromosomes[i].genes[j] = RAND % maxGeneValue;
+		Gene* genes = chromosomes[i].genes;
+		for (size_t j = 0; j < geneCount; ++j) {
+			genes[j] = RAND(maxGeneValue);
 		}
+		chromosomes[i].firstChanged = 0;
 	}
 
 	// Create mutations
 	for (auto& ch : chromosomes) {
 		if (ch.parent) continue; // parents aren't allowed to mutate, which ensures we keep them in the pool for the next generation as-is
-		for (size_t i = 0; i < ch.genes.size(); ++i) {
-			if (RAND % 100000 > int(mutationRate * 100000)) {
-				ch.genes[i] = RAND % maxGeneValue; // randomly re-assign this gene
+		Gene* genes = ch.genes;
+		// jump straight from one mutated gene to the next
+		for (uint64_t i = mutationSampler.next(rng); i < geneCount; i += 1 + mutationSampler.next(rng)) {
+			Gene gene = RAND(maxGeneValue); // randomly re-assign this gene
+			if (gene != genes[i]) {
+				genes[i] = gene;
+				if (i < ch.firstChanged) ch.firstChanged = (unsigned int)i;
 			}
 		}
 	}
@@ -198,4 +373,58 @@ inline const Chromosome<T>* Population<T>::nextGeneration() {
 	return &chromosomes[0];
 }
 
+template<typename T>
+inline void Population<T>::evaluate(Chromosome<T>& ch) {
+	if (!ch.record.success || ch.record.constant) {
+		ch.fitness = INFINITY; // invalid expression, definitely don't want to keep this one
+		PROFILE_COUNT(Invalid, 1);
+	} else {
+		++evaluations;
+		PROFILE_COUNT(Evaluations, 1);
+		PROFILE_COUNT(Nodes, ch.record.program.size());
+		try {
+			ch.fitness = fitnessFunction->fitness(ch.record.program);
+		} catch (...) { // handle invalid expressions with /0, log(-1), etc.
+			ch.fitness = INFINITY;
+			PROFILE_COUNT(Exceptions, 1);
+		}
+	}
+}
+
+template<typename T>
+inline void Population<T>::inherit(Chromosome<T>& child, const Chromosome<T>& parent, unsigned int firstChanged) const {
+	child.expression = parent.expression;
+	child.fitness = parent.fitness;
+	child.record = parent.record;
+	child.firstChanged = firstChanged;
+}
+
+template<typename T>
+inline void Population<T>::save(Serialization::BinaryWriter& writer) const {
+	writer.write<int>(generation);
+	writer.writeRng(rng);
+	writer.write<unsigned int>((unsigned int)chromosomes.size());
+	writer.write<unsigned int>(geneCount);
+	// rows are written in the current order of the chromosomes
+	for (auto& ch : chromosomes) {
+		writer.writeBytes(ch.genes, geneCount * sizeof(Gene));
+	}
+}
+
+template<typename T>
+inline void Population<T>::load(Serialization::BinaryReader& reader) {
+	generation = reader.read<int>();
+	reader.readRng(rng);
+	unsigned int n = reader.read<unsigned int>();
+	unsigned int geneCount = reader.read<unsigned int>();
+	if (n != chromosomes.size() || geneCount != this->geneCount) {
+		throw "Population checkpoint does not match the population's parameters";
+	}
+	for (size_t i = 0; i < chromosomes.size(); ++i) {
+		chromosomes[i].genes = &geneMatrix[i * geneCount];
+		chromosomes[i].record.valid = false;
+		reader.readBytes(chromosomes[i].genes, geneCount * sizeof(Gene));
+	}
+}
+
 #undef RAND
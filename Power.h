@@ -1,16 +1,89 @@
 #pragma once
 
 #include "Expression.h"
+#include "Build.h"
 #include "Multiplication.h"
 
+
+/**
+ * How a power is computed, depending on its exponent
+ * Small integer exponents are computed by repeated multiplication, which is also defined for negative bases (and for zero with non-negative exponents),
+ * and half-integer exponents from a square root; any other exponent goes through pow() and requires a positive base
+ */
+enum class PowerKernel : unsigned char {
+	General, Integer, HalfInteger
+};
+
+/**
+ * Largest magnitude of the exponents that are computed by repeated multiplication
+ */
+static const int MaxIntegerExponent = 64;
+
+/**
+ * Returns the kernel used to compute powers with the given constant exponent
+ */
+template<typename T>
+inline PowerKernel powerKernel(T c) {
+	if (!(std::abs(c) <= MaxIntegerExponent)) return PowerKernel::General; // also excludes NaNs
+	if (c == std::floor(c)) return PowerKernel::Integer;
+	if (2 * c == std::floor(2 * c)) return PowerKernel::HalfInteger;
+	return PowerKernel::General;
+}
+
+/**
+ * Returns a^n for an integer n, by repeated squaring; 0^n is infinite for negative n
+ */
+template<typename T>
+inline T integerPower(T a, int n) {
+	T base = n < 0 ? 1 / a : a;
+	unsigned int m = n < 0 ? -n : n;
+	T result = 1;
+	while (m) {
+		if (m & 1) result *= base;
+		base *= base;
+		m >>= 1;
+	}
+	return result;
+}
+
+/**
+ * Computes integerPower(a[i], n) for count values at once, with the same multiplications, using base as scratch space
+ */
+template<typename T>
+inline void integerPowers(const T* a, int n, T* out, T* base, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		base[i] = n < 0 ? 1 / a[i] : a[i];
+		out[i] = 1;
+	}
+	for (unsigned int m = n < 0 ? -n : n; m; m >>= 1) {
+		if (m & 1) {
+			for (size_t i = 0; i < count; ++i) out[i] *= base[i];
+		}
+		for (size_t i = 0; i < count; ++i) base[i] *= base[i];
+	}
+}
+
+
 template<typename T>
 class Power : public Expression<T> {
 private:
 	ExpressionPtr<T> a;
 	ExpressionPtr<T> b;
+
+	/**
+	 * Kernel and value of the exponent, decided once at construction when the exponent doesn't depend on x or y
+	 */
+	PowerKernel kernel = PowerKernel::General;
+	T exponent = 0;
+
+	/**
+	 * Returns whether the expression doesn't depend on x or y, and thus has the same value at every point
+	 */
+	static bool uniform(const Expression<T>* e);
+
 public:
 
-	Power(ExpressionPtr<T> a, ExpressionPtr<T> b) : a(a), b(b) {}
+	Power(ExpressionPtr<T> a, ExpressionPtr<T> b);
 
 	T evaluate(T x, T y) const override;
 
@@ -24,7 +97,15 @@ public:
 
 	bool isConstant() const override { return a->isConstant(); }
 
-	ExpressionPtr<T> mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+	ExpressionPtr<T> mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+
+	static const ExpressionType Type = ExpressionType::Power;
+
+	ExpressionType type() const override { return Type; }
+
+	int childCount() const override { return 2; }
+
+	ExpressionPtr<T> child(int i) const override { return i == 0 ? a : b; }
 
 };
 #define PowerPtr(T, a, b) ExpressionPtr<T>(new Power<T>(a, b))
@@ -33,14 +114,51 @@ public:
 
 
 
+template<typename T>
+inline Power<T>::Power(ExpressionPtr<T> a, ExpressionPtr<T> b) : Expression<T>(ExpressionType::Power, 0, a.get(), b.get()), a(a), b(b) {
+	// isConstant() can't tell, as powers with a constant base such as 2^x count as constant, so the exponent is searched for variables;
+	// other exponents are left to pow()
+	if (b && uniform(b.get())) {
+		try {
+			exponent = b->evaluate(0, 0);
+			kernel = powerKernel(exponent);
+		} catch (...) {
+			// invalid exponents such as log(-1) throw again when the power is evaluated
+		}
+	}
+}
+
+template<typename T>
+inline bool Power<T>::uniform(const Expression<T>* e) {
+	if (e->type() == ExpressionType::VarX || e->type() == ExpressionType::VarY) return false;
+	for (int i = 0; i < e->childCount(); ++i) {
+		if (!uniform(e->child(i).get())) return false;
+	}
+	return true;
+}
+
 template<typename T>
 inline T Power<T>::evaluate(T x, T y) const {
 	T inner = a->evaluate(x, y);
-	T outer = b->evaluate(x, y);
-	if (inner <= 0) {
-		throw NAN;
+	switch (kernel) {
+	case PowerKernel::Integer:
+		if (inner == 0 && exponent < 0) {
+			throw NAN;
+		}
+		return integerPower(inner, int(exponent));
+	case PowerKernel::HalfInteger:
+		if (inner <= 0) {
+			throw NAN;
+		}
+		return integerPower(inner, int(std::floor(exponent))) * sqrt(inner);
+	default: {
+		T outer = b->evaluate(x, y);
+		if (inner <= 0) {
+			throw NAN;
+		}
+		return pow(inner, outer);
+	}
 	}
-	return pow(inner, outer);
 }
 
 template<typename T>
@@ -48,9 +166,9 @@ inline ExpressionPtr<T> Power<T>::derivative(int dimension) const {
 	if (!b->isConstant()) { // we don't allow non-constant exponents
 		return DivisionPtr(T, ConstantPtr(T, 1), ConstantPtr(T, 0)); // return 1/0 as the derivative, which will mark the expression as invalid if we evaluate it
 	}
-	// d/dx f(x)^c = c * f(x)^(c-1) * f'(x)
+	// d/dx f(x)^c = c * f(x)^(c-1) * f'(x), where the power with exponent c - 1 gets the same kernel as this one
 	T c = b->evaluate(0, 0);
-	return MultiplicationPtr(T, MultiplicationPtr(T, ConstantPtr(T, c), a->derivative(dimension)), PowerPtr(T, a, ConstantPtr(T, c-1)));
+	return Build::multiply(Build::multiply(ConstantPtr(T, c), a->derivative(dimension)), Build::power(a, ConstantPtr(T, c-1)));
 }
 
 template<typename T>
@@ -68,12 +186,15 @@ inline ExpressionPtr<T> Power<T>::simplify() const {
 }
 
 template<typename T>
-inline ExpressionPtr<T> Power<T>::mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
+inline ExpressionPtr<T> Power<T>::mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
 	TREE_MUTATION();
 	auto newA = a->mutate(rng, mutationChance, treeMutationChance, grammar, false);
 	auto newB = b->mutate(rng, mutationChance, treeMutationChance, grammar, false);
 	if (MUTATION) {
 		return grammar->instantiateOperation(newA, newB, rng);
 	}
+	if (newA == a && newB == b) {
+		return this->self(); // nothing changed, keep sharing the same node
+	}
 	return PowerPtr(T, newA, newB);
 }
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#ifndef M_PI
+	#define M_PI 3.14159265359
+#endif
+#include "Vars.h"
+#include "Addition.h"
+#include "Multiplication.h"
+#include "Division.h"
+#include "Subtraction.h"
+#include "Trig.h"
+#include "Exponential.h"
+#include "Logarithm.h"
+#include "SquareRoot.h"
+#include "Power.h"
+#include "GrammarDecoder.h"
+#include "ExampleODEs.h"
+#include "ExamplePDEs.h"
+
+
+
+Fitness<double> heatPde(double tMax) {
+	// exact solution:
+	// u(x, t) = e^{- pi^2 t} sin(pi x)
+	return Fitness<double>(
+		[](FunctionParams<double> p) -> const double {
+			return p.ddx2 - p.ddy; // d^2/dx^2 u = d/dt u
+		},
+		Domain<double>(0, 1, 50), Domain<double>(0, tMax, 50), 100,
+		{
+			Boundary<double>(0, 0, [](double t, double f, double dfdx, double ddfdx) -> double {
+				return -f; // u(0, t) = 0
+			}),
+			Boundary<double>(1, 0, [](double t, double f, double dfdx, double ddfdx) -> double {
+				return -f; // u(L, t) = 0
+			}),
+			Boundary<double>(0, 1, [](double x, double f, double dfdt, double ddfdt) -> double {
+				return f - sin(M_PI * x); // u(x, 0) = sin(pi x)
+			})
+		}
+	);
+}
+
+Fitness<double> heatPdeNoPi(double tMax) {
+	// exact solution:
+	// u(x, t) = e^{-t} sin(x)
+	return Fitness<double>(
+		[](FunctionParams<double> p) -> const double {
+			return p.ddx2 - p.ddy;
+		},
+		Domain<double>(0, M_PI, 50), Domain<double>(0, tMax, 50), 100,
+		{
+			Boundary<double>(0, 0, [](double t, double f, double dfdx, double ddfdx) -> double {
+				return -f; // u(0, t) = 0
+			}),
+			Boundary<double>(M_PI, 0, [](double t, double f, double dfdx, double ddfdx) -> double {
+				return -f; // u(pi, t) = 0
+			}),
+			Boundary<double>(0, 1, [](double x, double f, double dfdt, double ddfdt) -> double {
+				return f - sin(x); // u(x, 0) = sin(x)
+			})
+		}
+	);
+}
+
+
+
+/**
+ * Problem that can be solved, identified by its name
+ */
+struct Problem {
+	std::string name;
+	Fitness<double> fitness;
+	bool twoDimensional; // whether the solution is a function of both x and y, or of x only
+	int seed; // seed of the first run of the problem, the following runs use the next seeds
+};
+
+
+
+/**
+ * Creates the grammar that solutions are built from - two different variants for 1D problems (ODEs) and 2D problems (PDEs)
+ */
+GrammarDecoder<double>* createDecoder(bool twoDimensional) {
+	std::vector<GrammaticalElement_base<double>*> variables = {
+		Gd(VarX)
+	};
+	if (twoDimensional) {
+		variables.push_back(Gd(VarY));
+	}
+	std::vector<GrammaticalElement_base<double>*> operations = {
+		G2d(Addition),
+		G2d(Subtraction),
+		G2d(Multiplication),
+		G2d(Division),
+		G2d(Power)
+	};
+	std::vector<GrammaticalElement_base<double>*> functions = {
+		G1d(Sine),
+		G1d(Cosine),
+		G1d(Exponential),
+		G1d(Logarithm),
+		// G1d(SquareRoot) <- not including sqrt() in the grammar since it's not quite general enough, we already have powers so it's possible to obtain ^0.5 anyways
+	};
+	std::vector<double> constants = {
+		-1, 0, 1, 2, 3, M_PI, 4, 5, 6, 7, 8, 9, 10
+	};
+	return new GrammarDecoder<double>(0, variables, operations, functions, constants);
+}
+
+
+/**
+ * Returns all problems that can be solved: example ODEs, NLODEs and PDEs from the original paper, and the 1D temporal heat equation
+ */
+std::vector<Problem> getProblems() {
+	std::vector<Problem> problems;
+	for (int i = 1; i <= 9; ++i) {
+		problems.push_back({ "ODE" + std::to_string(i), getExampleODE(i), false, i });
+	}
+	for (int i = 1; i <= 4; ++i) {
+		problems.push_back({ "NLODE" + std::to_string(i), getExampleNLODE(i), false, i });
+	}
+	for (int i = 1; i <= 6; ++i) {
+		problems.push_back({ "PDE" + std::to_string(i), getExamplePDE(i), true, i });
+	}
+	problems.push_back({ "Heat", heatPde(1), true, 1337 });
+	problems.push_back({ "Heat[-pi]", heatPdeNoPi(1), true, 1337 });
+	return problems;
+}
+
+
+/**
+ * Loads a problem from a text file with one "key: value" pair per line (# starts a comment), e.g.
+ *   name: Wave
+ *   equation: uxx - utt = 0
+ *   x: 0, 1, 50			(start, end and number of points of the domain on x)
+ *   t: 0, 1, 50			(same on y, which can also be called t; without it the problem is an ODE in x)
+ *   lambda: 100			(weight of the boundary conditions, 100 by default)
+ *   boundary: u(0, t) = 0	(one line per boundary condition)
+ *   seed: 1				(seed of the first run, 1 by default)
+ * The name defaults to the name of the file without its extension; equations and boundary conditions are described in EquationParser
+ */
+Problem loadProblem(const std::string& filename) {
+	std::ifstream file(filename);
+	if (!file.is_open()) {
+		fprintf(stderr, "Could not open problem file %s\n", filename.c_str());
+		throw "Could not open problem file";
+	}
+	auto trim = [](const std::string& s) -> std::string {
+		size_t start = s.find_first_not_of(" \t\r\n");
+		if (start == std::string::npos) return "";
+		return s.substr(start, s.find_last_not_of(" \t\r\n") - start + 1);
+	};
+	double rangeStart[2] = { 0, 0 }, rangeEnd[2] = { 1, 0 }; // domains on x and y, by default those of Domain and EMPTY
+	int numPoints[2] = { 10, 1 };
+	auto invalid = [&](const std::string& line, const char* message) {
+		fprintf(stderr, "Invalid line in %s: %s (%s)\n", filename.c_str(), line.c_str(), message);
+		throw "Invalid problem file";
+	};
+	auto integer = [&](const std::string& line, const std::string& value) -> int {
+		char* end;
+		errno = 0;
+		long result = strtol(value.c_str(), &end, 10);
+		if (value.empty() || *end != 0 || errno == ERANGE || result < INT_MIN || result > INT_MAX) invalid(line, "expected an integer");
+		return int(result);
+	};
+	auto domain = [&](const std::string& line, const std::string& value, int dimension) {
+		// start, end and optionally the number of points, which are constant expressions such as pi / 2
+		std::vector<std::string> parts;
+		size_t start = 0;
+		for (size_t comma; (comma = value.find(',', start)) != std::string::npos; start = comma + 1) {
+			parts.push_back(value.substr(start, comma - start));
+		}
+		parts.push_back(value.substr(start));
+		if (parts.size() < 2 || parts.size() > 3) invalid(line, "expected start, end, points");
+		rangeStart[dimension] = EquationParser<double>::constant(parts[0]);
+		rangeEnd[dimension] = EquationParser<double>::constant(parts[1]);
+		if (rangeStart[dimension] == rangeEnd[dimension]) invalid(line, "a domain needs distinct start and end");
+		numPoints[dimension] = parts.size() == 3 ? integer(line, trim(parts[2])) : 10;
+		if (numPoints[dimension] < 2) invalid(line, "a domain needs at least 2 points");
+	};
+
+	std::string name = filename.substr(filename.find_last_of("/\\") == std::string::npos ? 0 : filename.find_last_of("/\\") + 1);
+	name = name.substr(0, name.find('.'));
+	Residual<double> residual;
+	bool twoDimensional = false;
+	double lambda = 100;
+	std::vector<BoundaryCondition<double>> conditions;
+	int seed = 1;
+
+	std::string line;
+	while (std::getline(file, line)) {
+		line = trim(line.substr(0, line.find('#')));
+		if (line.empty()) continue;
+		size_t colon = line.find(':');
+		if (colon == std::string::npos) invalid(line, "expected key: value");
+		std::string key = trim(line.substr(0, colon));
+		std::string value = trim(line.substr(colon + 1));
+		if (key == "name") name = value;
+		else if (key == "equation") residual = EquationParser<double>::equation(value);
+		else if (key == "x") domain(line, value, 0);
+		else if (key == "y" || key == "t") {
+			domain(line, value, 1);
+			twoDimensional = true;
+		}
+		else if (key == "lambda") lambda = EquationParser<double>::constant(value);
+		else if (key == "boundary") conditions.push_back(EquationParser<double>::boundaryCondition(value));
+		else if (key == "seed") seed = integer(line, value);
+		else invalid(line, "unknown key");
+	}
+
+	if (residual.empty()) {
+		fprintf(stderr, "No equation in %s\n", filename.c_str());
+		throw "Invalid problem file";
+	}
+	if (!twoDimensional && (residual.uses(Term::Y) || residual.uses(Term::Dy) || residual.uses(Term::Dyy))) {
+		fprintf(stderr, "The equation in %s depends on y, but no domain is given on y\n", filename.c_str());
+		throw "Invalid problem file";
+	}
+
+	std::vector<Boundary<double>> boundaries;
+	for (auto& condition : conditions) {
+		const Residual<double>& r = condition.residual;
+		int d = condition.dimension;
+		if (!twoDimensional && (d == 1 || r.uses(Term::Y) || r.uses(Term::Dy) || r.uses(Term::Dyy))) {
+			fprintf(stderr, "A boundary condition in %s depends on y, but no domain is given on y\n", filename.c_str());
+			throw "Invalid problem file";
+		}
+		if (condition.p < std::min(rangeStart[d], rangeEnd[d]) || condition.p > std::max(rangeStart[d], rangeEnd[d])) {
+			fprintf(stderr, "A boundary condition in %s is outside of the domain\n", filename.c_str());
+			throw "Invalid problem file";
+		}
+		boundaries.push_back(Boundary<double>(condition));
+	}
+
+	Domain<double> domainX(rangeStart[0], rangeEnd[0], numPoints[0]), domainY(rangeStart[1], rangeEnd[1], numPoints[1]);
+	return { name, Fitness<double>(residual, domainX, domainY, lambda, boundaries), twoDimensional, seed };
+}
+
+
+/**
+ * Returns whether a problem is selected by the given name (e.g. ODE3) or family (e.g. PDE for all PDEs)
+ */
+bool isSelected(const Problem& problem, const std::string& selection) {
+	if (problem.name == selection) return true;
+	return problem.name.compare(0, selection.size(), selection) == 0 && problem.name.find_first_not_of("0123456789", selection.size()) == std::string::npos;
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include "PerfCounters.h"
+
+
+/// Low-overhead instrumentation of the phases of a generation, enabled by defining PROFILE
+/// Timers and counters accumulate into statistics local to the calling thread, which the thread collects once per generation with Profiler::take()
+/// Without PROFILE, the PROFILE_SCOPE and PROFILE_COUNT macros expand to nothing and the statistics are never filled in
+/// Defining PERF_COUNTERS as well counts hardware events (cycles, instructions, cache and branch misses) in each phase, at the cost of two system calls per timed scope
+
+
+namespace Profiler {
+
+	/**
+	 * Phases of a generation that are timed
+	 */
+	enum Phase {
+		Decode, // decoding genes into programs (grammar-based population), or compiling trees into programs (tree population)
+		Grid, // evaluating programs on the collocation points of the domain
+		Boundaries, // evaluating programs on the boundaries
+		Sort, // sorting the population by fitness
+		Breed, // creating the next generation: replication, crossover, mutation and random individuals
+		Simplify, // building the simplified expression of the top performer (grammar-based population)
+		PhaseCount
+	};
+
+	/**
+	 * Events that are counted
+	 */
+	enum Counter {
+		Evaluations, // fitness computations
+		Invalid, // candidates rejected without computing their fitness (invalid or constant expressions)
+		Exceptions, // fitness computations that threw
+		Nodes, // total number of instructions of the programs whose fitness was computed
+		CounterCount
+	};
+
+	static const char* const PhaseNames[PhaseCount] = { "decode", "grid", "boundaries", "sort", "breed", "simplify" };
+	static const char* const CounterNames[CounterCount] = { "evaluations", "invalid", "exceptions", "nodes" };
+
+	/**
+	 * Time spent in each phase, number of times each phase was entered, and counted events
+	 */
+	struct Stats {
+		double seconds[PhaseCount];
+		uint64_t calls[PhaseCount];
+		uint64_t counters[CounterCount];
+		uint64_t events[PhaseCount][PerfCounters::EventCount]; // hardware events counted in each phase (only filled in if PERF_COUNTERS is defined)
+
+		inline Stats() { clear(); }
+
+		inline void clear() { memset(this, 0, sizeof(Stats)); }
+
+		inline Stats& operator+=(const Stats& other) {
+			for (int i = 0; i < PhaseCount; ++i) {
+				seconds[i] += other.seconds[i];
+				calls[i] += other.calls[i];
+				for (int j = 0; j < PerfCounters::EventCount; ++j) {
+					events[i][j] += other.events[i][j];
+				}
+			}
+			for (int i = 0; i < CounterCount; ++i) {
+				counters[i] += other.counters[i];
+			}
+			return *this;
+		}
+
+		/**
+		 * Returns whether anything was recorded, i.e. whether profiling is enabled and at least one phase ran
+		 */
+		inline bool empty() const {
+			for (int i = 0; i < PhaseCount; ++i) {
+				if (calls[i] > 0) return false;
+			}
+			return true;
+		}
+
+		/**
+		 * Returns whether hardware events were counted, i.e. whether PERF_COUNTERS is defined and the counters are available
+		 */
+		inline bool hasEvents() const {
+			for (int i = 0; i < PhaseCount; ++i) {
+				if (events[i][PerfCounters::Cycles] > 0) return true;
+			}
+			return false;
+		}
+
+		/**
+		 * Returns the number of occurrences of a hardware event over all phases
+		 */
+		inline uint64_t totalEvents(PerfCounters::Event event) const {
+			uint64_t total = 0;
+			for (int i = 0; i < PhaseCount; ++i) total += events[i][event];
+			return total;
+		}
+
+		inline double totalSeconds() const {
+			double total = 0;
+			for (int i = 0; i < PhaseCount; ++i) total += seconds[i];
+			return total;
+		}
+	};
+
+	/**
+	 * Returns the statistics accumulated by the calling thread
+	 */
+	inline Stats& local() {
+		thread_local Stats stats;
+		return stats;
+	}
+
+	/**
+	 * Returns the statistics accumulated by the calling thread since the last call, and resets them
+	 */
+	inline Stats take() {
+		Stats stats = local();
+		local().clear();
+		return stats;
+	}
+
+	/**
+	 * Adds the time elapsed between its construction and its destruction to a phase, along with the hardware events counted meanwhile if PERF_COUNTERS is defined
+	 */
+	class ScopedTimer {
+	private:
+		Phase phase;
+		std::chrono::steady_clock::time_point start;
+#ifdef PERF_COUNTERS
+		PerfCounters::Sample startEvents;
+#endif
+
+	public:
+		inline ScopedTimer(Phase phase) : phase(phase) {
+#ifdef PERF_COUNTERS
+			startEvents = PerfCounters::local().read();
+#endif
+			start = std::chrono::steady_clock::now();
+		}
+
+		inline ~ScopedTimer() {
+			Stats& stats = local();
+			stats.seconds[phase] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			++stats.calls[phase];
+#ifdef PERF_COUNTERS
+			PerfCounters::accumulate(startEvents, PerfCounters::local().read(), stats.events[phase]);
+#endif
+		}
+	};
+
+};
+
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifdef PROFILE
+	/**
+	 * Times the rest of the enclosing scope as part of the given phase
+	 */
+	#define PROFILE_SCOPE(phase) Profiler::ScopedTimer PROFILE_CONCAT(profileTimer, __LINE__)(Profiler::phase)
+	/**
+	 * Adds n to the given counter
+	 */
+	#define PROFILE_COUNT(counter, n) (Profiler::local().counters[Profiler::counter] += (n))
+#else
+	#define PROFILE_SCOPE(phase)
+	#define PROFILE_COUNT(counter, n)
+#endif
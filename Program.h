@@ -0,0 +1,807 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "Expression.h"
+#include "Vars.h"
+#include "Addition.h"
+#include "Subtraction.h"
+#include "Multiplication.h"
+#include "Division.h"
+#include "Power.h"
+#include "Trig.h"
+#include "Exponential.h"
+#include "Logarithm.h"
+#include "SquareRoot.h"
+#include "FastMath.h"
+
+
+/**
+ * Creates a new expression node of the given type, with the given value (constants only) and sub-expressions (operations and functions only)
+ */
+template<typename T>
+inline std::shared_ptr<Expression<T>> makeExpression(ExpressionType type, T value, const std::shared_ptr<Expression<T>>& a = nullptr, const std::shared_ptr<Expression<T>>& b = nullptr) {
+	switch (type) {
+	case ExpressionType::Constant: return ConstantPtr(T, value);
+	case ExpressionType::VarX: return VarXPtr(T);
+	case ExpressionType::VarY: return VarYPtr(T);
+	case ExpressionType::Addition: return AdditionPtr(T, a, b);
+	case ExpressionType::Subtraction: return SubtractionPtr(T, a, b);
+	case ExpressionType::Multiplication: return MultiplicationPtr(T, a, b);
+	case ExpressionType::Division: return DivisionPtr(T, a, b);
+	case ExpressionType::Power: return PowerPtr(T, a, b);
+	case ExpressionType::Sine: return SinePtr(T, a);
+	case ExpressionType::Cosine: return CosinePtr(T, a);
+	case ExpressionType::Exponential: return ExponentialPtr(T, a);
+	case ExpressionType::Logarithm: return LogarithmPtr(T, a);
+	case ExpressionType::SquareRoot: return SquareRootPtr(T, a);
+	}
+	return nullptr;
+}
+
+/**
+ * Returns the number of operands taken by an expression node of the given type
+ */
+inline int operandCount(ExpressionType type) {
+	switch (type) {
+	case ExpressionType::Constant:
+	case ExpressionType::VarX:
+	case ExpressionType::VarY:
+		return 0;
+	case ExpressionType::Sine:
+	case ExpressionType::Cosine:
+	case ExpressionType::Exponential:
+	case ExpressionType::Logarithm:
+	case ExpressionType::SquareRoot:
+		return 1;
+	default:
+		return 2;
+	}
+}
+
+
+/**
+ * Single instruction of a program
+ */
+template<typename T>
+struct Instruction {
+	ExpressionType type;
+	T value; // value pushed by constants, unused otherwise
+};
+
+/**
+ * Value of an expression at a point along with its first and second derivatives with respect to x and y
+ */
+template<typename T>
+struct Jet {
+	T f;
+	T dx;
+	T dy;
+	T dxx;
+	T dyy;
+};
+
+/**
+ * Values and derivatives of an expression at many points, stored as one array per component
+ */
+template<typename T>
+struct Jets {
+	std::vector<T> f;
+	std::vector<T> dx;
+	std::vector<T> dy;
+	std::vector<T> dxx;
+	std::vector<T> dyy;
+
+	inline void resize(size_t n) {
+		f.resize(n);
+		dx.resize(n);
+		dy.resize(n);
+		dxx.resize(n);
+		dyy.resize(n);
+	}
+
+	inline size_t size() const { return f.size(); }
+};
+
+
+/**
+ * Flat representation of an expression as a sequence of instructions in postfix order, operating on a stack
+ * Programs can be evaluated, along with their derivatives, without building an expression tree, and reuse their storage when cleared
+ */
+template<typename T>
+class Program {
+private:
+
+	std::vector<Instruction<T>> instructions;
+
+public:
+
+	inline void clear() { instructions.clear(); }
+	inline void push(ExpressionType type, T value = 0) { instructions.push_back({ type, value }); }
+	inline size_t size() const { return instructions.size(); }
+	inline bool empty() const { return instructions.empty(); }
+	inline const Instruction<T>& operator[](size_t i) const { return instructions[i]; }
+
+	/**
+	 * Returns whether the program is constant, following the same rules as Expression::isConstant
+	 */
+	bool isConstant() const;
+
+	/**
+	 * Returns a hash of the instructions; identical programs always have the same hash
+	 */
+	uint64_t hash() const;
+
+	/**
+	 * Returns whether two programs have exactly the same instructions
+	 */
+	bool operator==(const Program<T>& other) const;
+
+	/**
+	 * Evaluates the program at point (x, y), along with its first and second derivatives with respect to x and y
+	 * Throws in the same cases as evaluating the equivalent expression and its derivatives would (division by zero, log of a non-positive value, etc.)
+	 */
+	Jet<T> evaluate(T x, T y) const;
+
+	/**
+	 * Evaluates the program at count points (x[i], y[i]) at once, along with its derivatives, and stores them into jets
+	 * Points are processed in blocks, each instruction being applied to a whole block before moving on to the next one, which lets the compiler vectorize the loops
+	 * With exact accuracy, results are identical to evaluating each point separately; with fast accuracy, functions are approximated (see FastMath)
+	 * Throws if the program is invalid at any of the points
+	 */
+	void evaluate(const T* x, const T* y, size_t count, Jets<T>& jets, FastMath::Accuracy accuracy = FastMath::Accuracy::Exact) const;
+
+	/**
+	 * Builds the expression tree represented by the program
+	 */
+	std::shared_ptr<Expression<T>> toExpression() const;
+
+	/**
+	 * Compiles an expression tree into a program, replacing the contents of the program
+	 */
+	void compile(const std::shared_ptr<Expression<T>>& expression);
+
+	/**
+	 * Simplifies the program in place, with the same rules as Expression::simplify(): operations and functions of constants are folded, and 0 and 1 operands are eliminated where neutral or absorbing,
+	 * along with the other operand where it is absorbed (e.g. 0 * log(x - 10) becomes 0, and (x - 5)^0 becomes 1), so that a simplified program is valid wherever the simplified tree is
+	 * Unlike simplify(), constant sub-programs that don't reduce to a single constant (powers with a constant base, see Power::isConstant) are left as they are,
+	 * and nothing is folded into a non-finite value or an invalid power, so that evaluating the program rejects it as it would reject the original one
+	 */
+	void simplify();
+
+private:
+
+	/**
+	 * Number of points evaluated together by the batched evaluation
+	 */
+	static const size_t BlockSize = 64;
+
+	void evaluateBlock(const T* x, const T* y, size_t n, T* f, T* dx, T* dy, T* dxx, T* dyy, FastMath::Accuracy accuracy) const;
+
+	void compileNode(const std::shared_ptr<Expression<T>>& expression);
+
+}; // class Program
+
+
+
+template<typename T>
+inline bool Program<T>::isConstant() const {
+	thread_local std::vector<bool> stack;
+	stack.clear();
+	for (const Instruction<T>& instruction : instructions) {
+		switch (operandCount(instruction.type)) {
+		case 0:
+			stack.push_back(instruction.type == ExpressionType::Constant);
+			break;
+		case 1:
+			break; // functions are constant if their operand is
+		default: {
+			bool b = stack.back();
+			stack.pop_back();
+			if (instruction.type != ExpressionType::Power) { // powers only depend on their base (see Power::isConstant)
+				stack.back() = stack.back() && b;
+			}
+		}
+		}
+	}
+	return stack.back();
+}
+
+template<typename T>
+inline uint64_t Program<T>::hash() const {
+	// mixes instruction types and the bits of constant values one after the other; each step has to spread every input bit over the whole hash,
+	// otherwise programs that only differ by the order of their constants (e.g. 1 * -1 and -1 * 1) collide
+	auto mix = [](uint64_t h, uint64_t x) -> uint64_t {
+		h = (h ^ x) * 0xBF58476D1CE4E5B9ull;
+		return h ^ (h >> 31);
+	};
+	uint64_t h = 0x9E3779B97F4A7C15ull;
+	for (const Instruction<T>& instruction : instructions) {
+		h = mix(h, uint64_t(instruction.type));
+		if (instruction.type == ExpressionType::Constant) {
+			uint64_t bits = 0;
+			memcpy(&bits, &instruction.value, sizeof(T) < sizeof(bits) ? sizeof(T) : sizeof(bits));
+			h = mix(h, bits);
+		}
+	}
+	return h;
+}
+
+template<typename T>
+inline bool Program<T>::operator==(const Program<T>& other) const {
+	if (instructions.size() != other.instructions.size()) return false;
+	for (size_t i = 0; i < instructions.size(); ++i) {
+		if (instructions[i].type != other.instructions[i].type || instructions[i].value != other.instructions[i].value) return false;
+	}
+	return true;
+}
+
+template<typename T>
+inline Jet<T> Program<T>::evaluate(T x, T y) const {
+	// each stack entry also remembers whether it is constant, as derivatives of powers are only defined for constant exponents,
+	// and whether it is uniform, i.e. free of variables and thus the same at every point, unlike constant powers such as 2^x (see Power::isConstant)
+	struct Entry {
+		Jet<T> j;
+		bool constant;
+		bool uniform;
+	};
+	thread_local std::vector<Entry> stack;
+	stack.resize(instructions.size() + 1);
+	Entry* top = stack.data() - 1;
+
+	for (const Instruction<T>& instruction : instructions) {
+		switch (instruction.type) {
+		case ExpressionType::Constant:
+			*++top = { { instruction.value, 0, 0, 0, 0 }, true, true };
+			break;
+		case ExpressionType::VarX:
+			*++top = { { x, 1, 0, 0, 0 }, false, false };
+			break;
+		case ExpressionType::VarY:
+			*++top = { { y, 0, 1, 0, 0 }, false, false };
+			break;
+
+		case ExpressionType::Addition:
+		case ExpressionType::Subtraction: {
+			const Jet<T>& b = top->j;
+			bool constant = top->constant;
+			bool uniform = top->uniform;
+			--top;
+			Jet<T>& a = top->j;
+			T s = instruction.type == ExpressionType::Addition ? 1 : -1;
+			a = { a.f + s * b.f, a.dx + s * b.dx, a.dy + s * b.dy, a.dxx + s * b.dxx, a.dyy + s * b.dyy };
+			top->constant = top->constant && constant;
+			top->uniform = top->uniform && uniform;
+			break;
+		}
+		case ExpressionType::Multiplication: {
+			const Jet<T> b = top->j;
+			bool constant = top->constant;
+			bool uniform = top->uniform;
+			--top;
+			Jet<T>& a = top->j;
+			a = {
+				a.f * b.f,
+				a.dx * b.f + a.f * b.dx,
+				a.dy * b.f + a.f * b.dy,
+				a.dxx * b.f + 2 * a.dx * b.dx + a.f * b.dxx,
+				a.dyy * b.f + 2 * a.dy * b.dy + a.f * b.dyy
+			};
+			top->constant = top->constant && constant;
+			top->uniform = top->uniform && uniform;
+			break;
+		}
+		case ExpressionType::Division: {
+			const Jet<T> b = top->j;
+			bool constant = top->constant;
+			bool uniform = top->uniform;
+			--top;
+			Jet<T>& a = top->j;
+			if (b.f == 0) {
+				throw NAN;
+			}
+			// q = a / b, q' = (a' - q b') / b, q'' = (a'' - 2 q' b' - q b'') / b
+			T q = a.f / b.f;
+			T qx = (a.dx - q * b.dx) / b.f;
+			T qy = (a.dy - q * b.dy) / b.f;
+			a = { q, qx, qy, (a.dxx - 2 * qx * b.dx - q * b.dxx) / b.f, (a.dyy - 2 * qy * b.dy - q * b.dyy) / b.f };
+			top->constant = top->constant && constant;
+			top->uniform = top->uniform && uniform;
+			break;
+		}
+		case ExpressionType::Power: {
+			const Jet<T> b = top->j;
+			bool constant = top->constant;
+			bool uniform = top->uniform;
+			--top;
+			Jet<T>& a = top->j;
+			if (!constant) { // we don't allow non-constant exponents, as they have no derivative (see Power::derivative)
+				throw NAN;
+			}
+			// d/dx a^c = c a^(c-1) a', d^2/dx^2 a^c = c (c-1) a^(c-2) a'^2 + c a^(c-1) a''
+			// the exponent gets the same kernel as in the Power node, if it is uniform (see Power::Power)
+			T c = b.f;
+			PowerKernel kernel = uniform ? powerKernel(c) : PowerKernel::General;
+			top->uniform = top->uniform && uniform;
+			T p0, p1, p2;
+			if (kernel == PowerKernel::Integer) {
+				int e = int(c);
+				if (e < 0 && a.f == 0) {
+					throw NAN;
+				}
+				// a^(c-1) and a^(c-2) may be infinite at 0 for small exponents, where their coefficient is 0
+				if (e >= 2) {
+					p2 = integerPower(a.f, e - 2);
+					p1 = p2 * a.f;
+					p0 = p1 * a.f;
+				} else if (e >= 0) {
+					p0 = e == 1 ? a.f : 1;
+					p1 = e == 1 ? 1 : 0;
+					p2 = 0;
+				} else {
+					p0 = integerPower(a.f, e);
+					p1 = p0 / a.f;
+					p2 = p1 / a.f;
+				}
+			} else {
+				if (a.f <= 0) {
+					throw NAN;
+				}
+				p1 = kernel == PowerKernel::HalfInteger ? integerPower(a.f, int(std::floor(c)) - 1) * sqrt(a.f) : pow(a.f, c - 1);
+				p0 = p1 * a.f;
+				p2 = p1 / a.f;
+			}
+			a = { p0, c * p1 * a.dx, c * p1 * a.dy, c * (c - 1) * p2 * a.dx * a.dx + c * p1 * a.dxx, c * (c - 1) * p2 * a.dy * a.dy + c * p1 * a.dyy };
+			break;
+		}
+
+		case ExpressionType::Sine: {
+			Jet<T>& a = top->j;
+			T s = sin(a.f), c = cos(a.f);
+			a = { s, c * a.dx, c * a.dy, c * a.dxx - s * a.dx * a.dx, c * a.dyy - s * a.dy * a.dy };
+			break;
+		}
+		case ExpressionType::Cosine: {
+			Jet<T>& a = top->j;
+			T s = sin(a.f), c = cos(a.f);
+			a = { c, -s * a.dx, -s * a.dy, -s * a.dxx - c * a.dx * a.dx, -s * a.dyy - c * a.dy * a.dy };
+			break;
+		}
+		case ExpressionType::Exponential: {
+			Jet<T>& a = top->j;
+			T e = exp(a.f);
+			a = { e, e * a.dx, e * a.dy, e * (a.dxx + a.dx * a.dx), e * (a.dyy + a.dy * a.dy) };
+			break;
+		}
+		case ExpressionType::Logarithm: {
+			Jet<T>& a = top->j;
+			if (a.f <= 0) {
+				throw NAN;
+			}
+			T lx = a.dx / a.f, ly = a.dy / a.f;
+			a = { log(a.f), lx, ly, a.dxx / a.f - lx * lx, a.dyy / a.f - ly * ly };
+			break;
+		}
+		case ExpressionType::SquareRoot: {
+			Jet<T>& a = top->j;
+			if (a.f <= 0) {
+				throw NAN;
+			}
+			// s^2 = a, so s' = a' / 2s and s'' = (a'' - 2 s'^2) / 2s
+			T s = sqrt(a.f);
+			T sx = a.dx / (2 * s), sy = a.dy / (2 * s);
+			a = { s, sx, sy, (a.dxx - 2 * sx * sx) / (2 * s), (a.dyy - 2 * sy * sy) / (2 * s) };
+			break;
+		}
+		}
+	}
+
+	return top->j;
+}
+
+template<typename T>
+inline void Program<T>::evaluate(const T* x, const T* y, size_t count, Jets<T>& jets, FastMath::Accuracy accuracy) const {
+	jets.resize(count);
+	for (size_t start = 0; start < count; start += BlockSize) {
+		size_t n = count - start < BlockSize ? count - start : BlockSize; // not std::min, which would need BlockSize to be defined out of the class
+		evaluateBlock(x + start, y + start, n, jets.f.data() + start, jets.dx.data() + start, jets.dy.data() + start, jets.dxx.data() + start, jets.dyy.data() + start, accuracy);
+	}
+}
+
+template<typename T>
+inline void Program<T>::evaluateBlock(const T* x, const T* y, size_t n, T* f, T* dx, T* dy, T* dxx, T* dyy, FastMath::Accuracy accuracy) const {
+	// same stack machine and formulas as the single point evaluation, with each entry holding a whole block of points
+	struct Entry {
+		T f[BlockSize];
+		T dx[BlockSize];
+		T dy[BlockSize];
+		T dxx[BlockSize];
+		T dyy[BlockSize];
+		bool constant;
+		bool uniform; // same meaning as in the single point evaluation
+	};
+	thread_local std::vector<Entry> stack;
+	if (stack.size() < instructions.size() + 1) stack.resize(instructions.size() + 1);
+	Entry* top = stack.data() - 1;
+	T u[BlockSize], v[BlockSize], w[BlockSize]; // results of function calls
+
+	auto invalid = [n](const T* values) {
+		bool any = false;
+		for (size_t i = 0; i < n; ++i) any |= values[i] <= 0;
+		return any;
+	};
+
+	for (const Instruction<T>& instruction : instructions) {
+		switch (instruction.type) {
+		case ExpressionType::Constant:
+			++top;
+			for (size_t i = 0; i < n; ++i) {
+				top->f[i] = instruction.value;
+				top->dx[i] = top->dy[i] = top->dxx[i] = top->dyy[i] = 0;
+			}
+			top->constant = true;
+			top->uniform = true;
+			break;
+		case ExpressionType::VarX:
+		case ExpressionType::VarY: {
+			++top;
+			bool isX = instruction.type == ExpressionType::VarX;
+			for (size_t i = 0; i < n; ++i) {
+				top->f[i] = isX ? x[i] : y[i];
+				top->dx[i] = isX ? 1 : 0;
+				top->dy[i] = isX ? 0 : 1;
+				top->dxx[i] = top->dyy[i] = 0;
+			}
+			top->constant = false;
+			top->uniform = false;
+			break;
+		}
+
+		case ExpressionType::Addition:
+		case ExpressionType::Subtraction: {
+			const Entry& b = *top;
+			Entry& a = *--top;
+			T s = instruction.type == ExpressionType::Addition ? 1 : -1;
+			for (size_t i = 0; i < n; ++i) {
+				a.f[i] = a.f[i] + s * b.f[i];
+				a.dx[i] = a.dx[i] + s * b.dx[i];
+				a.dy[i] = a.dy[i] + s * b.dy[i];
+				a.dxx[i] = a.dxx[i] + s * b.dxx[i];
+				a.dyy[i] = a.dyy[i] + s * b.dyy[i];
+			}
+			a.constant = a.constant && b.constant;
+			a.uniform = a.uniform && b.uniform;
+			break;
+		}
+		case ExpressionType::Multiplication: {
+			const Entry& b = *top;
+			Entry& a = *--top;
+			for (size_t i = 0; i < n; ++i) {
+				T af = a.f[i], adx = a.dx[i], ady = a.dy[i];
+				a.f[i] = af * b.f[i];
+				a.dx[i] = adx * b.f[i] + af * b.dx[i];
+				a.dy[i] = ady * b.f[i] + af * b.dy[i];
+				a.dxx[i] = a.dxx[i] * b.f[i] + 2 * adx * b.dx[i] + af * b.dxx[i];
+				a.dyy[i] = a.dyy[i] * b.f[i] + 2 * ady * b.dy[i] + af * b.dyy[i];
+			}
+			a.constant = a.constant && b.constant;
+			a.uniform = a.uniform && b.uniform;
+			break;
+		}
+		case ExpressionType::Division: {
+			const Entry& b = *top;
+			Entry& a = *--top;
+			bool zero = false;
+			for (size_t i = 0; i < n; ++i) zero |= b.f[i] == 0;
+			if (zero) {
+				throw NAN;
+			}
+			for (size_t i = 0; i < n; ++i) {
+				T q = a.f[i] / b.f[i];
+				T qx = (a.dx[i] - q * b.dx[i]) / b.f[i];
+				T qy = (a.dy[i] - q * b.dy[i]) / b.f[i];
+				a.f[i] = q;
+				a.dx[i] = qx;
+				a.dy[i] = qy;
+				a.dxx[i] = (a.dxx[i] - 2 * qx * b.dx[i] - q * b.dxx[i]) / b.f[i];
+				a.dyy[i] = (a.dyy[i] - 2 * qy * b.dy[i] - q * b.dyy[i]) / b.f[i];
+			}
+			a.constant = a.constant && b.constant;
+			a.uniform = a.uniform && b.uniform;
+			break;
+		}
+		case ExpressionType::Power: {
+			const Entry& b = *top;
+			Entry& a = *--top;
+			if (!b.constant) {
+				throw NAN;
+			}
+			// same kernels as the single point evaluation; a uniform exponent is the same at every point
+			T* p0 = w;
+			T* p1 = u;
+			T* p2 = v;
+			PowerKernel kernel = b.uniform ? powerKernel(b.f[0]) : PowerKernel::General;
+			if (kernel == PowerKernel::Integer) {
+				int e = int(b.f[0]);
+				if (e < 0) {
+					bool zero = false;
+					for (size_t i = 0; i < n; ++i) zero |= a.f[i] == 0;
+					if (zero) {
+						throw NAN;
+					}
+				}
+				if (e >= 2) {
+					integerPowers(a.f, e - 2, p2, p0, n);
+					for (size_t i = 0; i < n; ++i) {
+						p1[i] = p2[i] * a.f[i];
+						p0[i] = p1[i] * a.f[i];
+					}
+				} else if (e >= 0) {
+					for (size_t i = 0; i < n; ++i) {
+						p0[i] = e == 1 ? a.f[i] : 1;
+						p1[i] = e == 1 ? 1 : 0;
+						p2[i] = 0;
+					}
+				} else {
+					integerPowers(a.f, e, p0, p1, n);
+					for (size_t i = 0; i < n; ++i) {
+						p1[i] = p0[i] / a.f[i];
+						p2[i] = p1[i] / a.f[i];
+					}
+				}
+			} else {
+				if (invalid(a.f)) {
+					throw NAN;
+				}
+				if (kernel == PowerKernel::HalfInteger) {
+					integerPowers(a.f, int(std::floor(b.f[0])) - 1, p1, p0, n);
+					for (size_t i = 0; i < n; ++i) p1[i] *= sqrt(a.f[i]);
+				} else if (b.uniform) {
+					FastMath::pow(a.f, b.f[0] - 1, p1, n, accuracy);
+				} else { // constant exponents that aren't uniform may still vary, see Power::isConstant
+					for (size_t i = 0; i < n; ++i) {
+						p1[i] = accuracy == FastMath::Accuracy::Fast ? T(FastMath::pow(double(a.f[i]), double(b.f[i] - 1))) : pow(a.f[i], b.f[i] - 1);
+					}
+				}
+				for (size_t i = 0; i < n; ++i) {
+					p0[i] = p1[i] * a.f[i];
+					p2[i] = p1[i] / a.f[i];
+				}
+			}
+			for (size_t i = 0; i < n; ++i) {
+				T c = b.f[i];
+				T adx = a.dx[i], ady = a.dy[i];
+				a.f[i] = p0[i];
+				a.dx[i] = c * p1[i] * adx;
+				a.dy[i] = c * p1[i] * ady;
+				a.dxx[i] = c * (c - 1) * p2[i] * adx * adx + c * p1[i] * a.dxx[i];
+				a.dyy[i] = c * (c - 1) * p2[i] * ady * ady + c * p1[i] * a.dyy[i];
+			}
+			a.uniform = a.uniform && b.uniform;
+			break;
+		}
+
+		case ExpressionType::Sine:
+		case ExpressionType::Cosine: {
+			Entry& a = *top;
+			FastMath::sincos(a.f, u, v, n, accuracy);
+			bool sine = instruction.type == ExpressionType::Sine;
+			for (size_t i = 0; i < n; ++i) {
+				T s = u[i], c = v[i];
+				T adx = a.dx[i], ady = a.dy[i];
+				if (sine) {
+					a.f[i] = s;
+					a.dx[i] = c * adx;
+					a.dy[i] = c * ady;
+					a.dxx[i] = c * a.dxx[i] - s * adx * adx;
+					a.dyy[i] = c * a.dyy[i] - s * ady * ady;
+				} else {
+					a.f[i] = c;
+					a.dx[i] = -s * adx;
+					a.dy[i] = -s * ady;
+					a.dxx[i] = -s * a.dxx[i] - c * adx * adx;
+					a.dyy[i] = -s * a.dyy[i] - c * ady * ady;
+				}
+			}
+			break;
+		}
+		case ExpressionType::Exponential: {
+			Entry& a = *top;
+			FastMath::exp(a.f, u, n, accuracy);
+			for (size_t i = 0; i < n; ++i) {
+				T e = u[i];
+				a.f[i] = e;
+				a.dxx[i] = e * (a.dxx[i] + a.dx[i] * a.dx[i]);
+				a.dyy[i] = e * (a.dyy[i] + a.dy[i] * a.dy[i]);
+				a.dx[i] = e * a.dx[i];
+				a.dy[i] = e * a.dy[i];
+			}
+			break;
+		}
+		case ExpressionType::Logarithm: {
+			Entry& a = *top;
+			if (invalid(a.f)) {
+				throw NAN;
+			}
+			FastMath::log(a.f, u, n, accuracy);
+			for (size_t i = 0; i < n; ++i) {
+				T lx = a.dx[i] / a.f[i], ly = a.dy[i] / a.f[i];
+				a.dxx[i] = a.dxx[i] / a.f[i] - lx * lx;
+				a.dyy[i] = a.dyy[i] / a.f[i] - ly * ly;
+				a.dx[i] = lx;
+				a.dy[i] = ly;
+				a.f[i] = u[i];
+			}
+			break;
+		}
+		case ExpressionType::SquareRoot: {
+			Entry& a = *top;
+			if (invalid(a.f)) {
+				throw NAN;
+			}
+			for (size_t i = 0; i < n; ++i) {
+				T s = sqrt(a.f[i]);
+				T sx = a.dx[i] / (2 * s), sy = a.dy[i] / (2 * s);
+				a.f[i] = s;
+				a.dx[i] = sx;
+				a.dy[i] = sy;
+				a.dxx[i] = (a.dxx[i] - 2 * sx * sx) / (2 * s);
+				a.dyy[i] = (a.dyy[i] - 2 * sy * sy) / (2 * s);
+			}
+			break;
+		}
+		}
+	}
+
+	for (size_t i = 0; i < n; ++i) {
+		f[i] = top->f[i];
+		dx[i] = top->dx[i];
+		dy[i] = top->dy[i];
+		dxx[i] = top->dxx[i];
+		dyy[i] = top->dyy[i];
+	}
+}
+
+template<typename T>
+inline std::shared_ptr<Expression<T>> Program<T>::toExpression() const {
+	std::vector<std::shared_ptr<Expression<T>>> stack;
+	for (const Instruction<T>& instruction : instructions) {
+		switch (operandCount(instruction.type)) {
+		case 0:
+			stack.push_back(makeExpression<T>(instruction.type, instruction.value));
+			break;
+		case 1:
+			stack.back() = makeExpression<T>(instruction.type, 0, stack.back());
+			break;
+		default: {
+			auto b = stack.back();
+			stack.pop_back();
+			stack.back() = makeExpression<T>(instruction.type, 0, stack.back(), b);
+		}
+		}
+	}
+	return stack.empty() ? nullptr : stack.back();
+}
+
+template<typename T>
+inline void Program<T>::compile(const std::shared_ptr<Expression<T>>& expression) {
+	clear();
+	compileNode(expression);
+}
+
+template<typename T>
+inline void Program<T>::simplify() {
+	// instructions are rewritten from left to right into the same storage, which never grows since every rule shortens the program or keeps its length
+	// starts holds the position where each operand on the stack begins in the rewritten program
+	thread_local std::vector<size_t> starts;
+	starts.clear();
+	size_t w = 0;
+	auto constant = [&](size_t start, size_t end, T& value) {
+		if (end - start != 1 || instructions[start].type != ExpressionType::Constant) return false;
+		value = instructions[start].value;
+		return true;
+	};
+	auto fold = [&](size_t start, T value) {
+		instructions[start] = { ExpressionType::Constant, value };
+		w = start + 1;
+	};
+	auto dropFirst = [&](size_t aStart, size_t bStart) { // replaces an operation with its second operand
+		std::copy(instructions.begin() + bStart, instructions.begin() + w, instructions.begin() + aStart);
+		w -= bStart - aStart;
+	};
+
+	for (size_t r = 0; r < instructions.size(); ++r) {
+		Instruction<T> instruction = instructions[r];
+		switch (operandCount(instruction.type)) {
+		case 0:
+			starts.push_back(w);
+			instructions[w++] = instruction;
+			break;
+
+		case 1: {
+			size_t aStart = starts.back();
+			T va = 0, v = 0;
+			if (constant(aStart, w, va)) {
+				switch (instruction.type) {
+				case ExpressionType::Sine: v = sin(va); break;
+				case ExpressionType::Cosine: v = cos(va); break;
+				case ExpressionType::Exponential: v = exp(va); break;
+				case ExpressionType::Logarithm: v = log(va); break;
+				default: v = sqrt(va); break;
+				}
+				if (std::isfinite(v)) {
+					fold(aStart, v);
+					break;
+				}
+			}
+			instructions[w++] = instruction;
+			break;
+		}
+
+		default: {
+			size_t bStart = starts.back();
+			starts.pop_back();
+			size_t aStart = starts.back();
+			T va = 0, vb = 0, v = 0;
+			bool ca = constant(aStart, bStart, va), cb = constant(bStart, w, vb);
+			if (ca && cb) {
+				switch (instruction.type) {
+				case ExpressionType::Addition: v = va + vb; break;
+				case ExpressionType::Subtraction: v = va - vb; break;
+				case ExpressionType::Multiplication: v = va * vb; break;
+				case ExpressionType::Division: v = va / vb; break;
+				default: v = pow(va, vb); break;
+				}
+				if (std::isfinite(v)) {
+					fold(aStart, v);
+				} else {
+					instructions[w++] = instruction;
+				}
+				break;
+			}
+			switch (instruction.type) {
+			case ExpressionType::Addition:
+				if (ca && va == 0) dropFirst(aStart, bStart);
+				else if (cb && vb == 0) w = bStart;
+				else instructions[w++] = instruction;
+				break;
+			case ExpressionType::Subtraction:
+				if (ca && va == 0) { // 0 - b becomes -1 * b
+					instructions[aStart].value = -1;
+					instructions[w++] = { ExpressionType::Multiplication, 0 };
+				} else if (cb && vb == 0) w = bStart;
+				else instructions[w++] = instruction;
+				break;
+			case ExpressionType::Multiplication:
+				if ((ca && va == 0) || (cb && vb == 0)) fold(aStart, 0);
+				else if (ca && va == 1) dropFirst(aStart, bStart);
+				else if (cb && vb == 1) w = bStart;
+				else instructions[w++] = instruction;
+				break;
+			case ExpressionType::Division:
+				if (ca && va == 0) fold(aStart, 0);
+				else if (cb && vb == 1) w = bStart;
+				else instructions[w++] = instruction;
+				break;
+			default:
+				if (cb && vb == 0) fold(aStart, 1);
+				else if (cb && vb == 1) w = bStart;
+				else instructions[w++] = instruction;
+				break;
+			}
+		}
+		}
+	}
+	instructions.resize(w);
+}
+
+template<typename T>
+inline void Program<T>::compileNode(const std::shared_ptr<Expression<T>>& expression) {
+	for (int i = 0; i < expression->childCount(); ++i) {
+		compileNode(expression->child(i));
+	}
+	push(expression->type(), expression->value());
+}
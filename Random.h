@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <cmath>
+
+
+/// Random number generators and sampling helpers used throughout the genetic algorithms
+/// All generators satisfy the standard UniformRandomBitGenerator requirements, are trivially copyable (so their state can be checkpointed as raw bytes),
+/// and can be split into independent, reproducible streams derived from a single seed, e.g. one per worker or island
+
+
+namespace Random {
+
+	/**
+	 * SplitMix64 step, used to expand a single seed into the full state of a generator
+	 */
+	inline uint64_t splitMix64(uint64_t& x) {
+		uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+
+	/**
+	 * xoshiro256++ generator (Blackman & Vigna), with a period of 2^256 - 1
+	 * Streams are obtained by jumping ahead 2^128 steps per stream index, so that streams never overlap in practice
+	 */
+	class Xoshiro256pp {
+	private:
+		uint64_t s[4];
+
+		static inline uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+	public:
+		typedef uint64_t result_type;
+
+		inline Xoshiro256pp(uint64_t seed = 0, uint64_t stream = 0) { this->seed(seed, stream); }
+
+		/**
+		 * Re-seeds the generator, placing it at the start of the given stream
+		 */
+		inline void seed(uint64_t seed, uint64_t stream = 0) {
+			for (int i = 0; i < 4; ++i) {
+				s[i] = splitMix64(seed);
+			}
+			for (uint64_t i = 0; i < stream; ++i) {
+				jump();
+			}
+		}
+
+		inline uint64_t operator()() {
+			uint64_t result = rotl(s[0] + s[3], 23) + s[0];
+			uint64_t t = s[1] << 17;
+			s[2] ^= s[0];
+			s[3] ^= s[1];
+			s[1] ^= s[2];
+			s[0] ^= s[3];
+			s[2] ^= t;
+			s[3] = rotl(s[3], 45);
+			return result;
+		}
+
+		/**
+		 * Advances the generator by 2^128 steps
+		 */
+		inline void jump() {
+			static const uint64_t polynomial[] = { 0x180EC6D33CFD0ABAull, 0xD5A61266F0C9392Cull, 0xA9582618E03FC9AAull, 0x39ABDC4529B1661Cull };
+			uint64_t t[4] = { 0, 0, 0, 0 };
+			for (uint64_t p : polynomial) {
+				for (int b = 0; b < 64; ++b) {
+					if (p & (uint64_t(1) << b)) {
+						for (int i = 0; i < 4; ++i) t[i] ^= s[i];
+					}
+					(*this)();
+				}
+			}
+			for (int i = 0; i < 4; ++i) s[i] = t[i];
+		}
+
+		static constexpr uint64_t min() { return 0; }
+		static constexpr uint64_t max() { return std::numeric_limits<uint64_t>::max(); }
+	};
+
+
+	/**
+	 * PCG32 generator (O'Neill, XSH-RR variant), with 64 bits of state and 32-bit outputs
+	 * Streams are selected through the increment of the underlying LCG, which gives 2^63 distinct sequences
+	 */
+	class Pcg32 {
+	private:
+		uint64_t state;
+		uint64_t increment;
+
+	public:
+		typedef uint32_t result_type;
+
+		inline Pcg32(uint64_t seed = 0, uint64_t stream = 0) { this->seed(seed, stream); }
+
+		/**
+		 * Re-seeds the generator, placing it at the start of the given stream
+		 */
+		inline void seed(uint64_t seed, uint64_t stream = 0) {
+			state = 0;
+			increment = (stream << 1) | 1;
+			(*this)();
+			state += splitMix64(seed);
+			(*this)();
+		}
+
+		inline uint32_t operator()() {
+			uint64_t old = state;
+			state = old * 6364136223846793005ull + increment;
+			uint32_t xorShifted = uint32_t(((old >> 18) ^ old) >> 27);
+			uint32_t rot = uint32_t(old >> 59);
+			return (xorShifted >> rot) | (xorShifted << ((32 - rot) & 31));
+		}
+
+		static constexpr uint32_t min() { return 0; }
+		static constexpr uint32_t max() { return std::numeric_limits<uint32_t>::max(); }
+	};
+
+
+	/**
+	 * Generator used by the genetic algorithms; define RNG_PCG32 to use PCG32 instead of xoshiro256++
+	 */
+#ifdef RNG_PCG32
+	typedef Pcg32 Rng;
+#else
+	typedef Xoshiro256pp Rng;
+#endif
+
+
+	/**
+	 * Returns 32 random bits, taken from the high bits of the generator's output, which are the strongest ones
+	 */
+	template<typename G>
+	inline uint32_t bits32(G& rng) {
+		return uint32_t(uint64_t(rng()) >> (std::numeric_limits<typename G::result_type>::digits - 32));
+	}
+
+	/**
+	 * Returns a uniformly distributed integer in [0, n), n > 0, without the bias of `rng() % n` (Lemire's multiply-and-reject method)
+	 */
+	template<typename G>
+	inline uint32_t bounded(G& rng, uint32_t n) {
+		uint64_t m = uint64_t(bits32(rng)) * n;
+		uint32_t low = uint32_t(m);
+		if (low < n) {
+			uint32_t threshold = uint32_t(-n) % n;
+			while (low < threshold) {
+				m = uint64_t(bits32(rng)) * n;
+				low = uint32_t(m);
+			}
+		}
+		return uint32_t(m >> 32);
+	}
+
+	/**
+	 * Returns a uniformly distributed real number in [0, 1)
+	 */
+	template<typename G>
+	inline double uniform(G& rng) {
+		uint64_t a = bits32(rng) >> 5, b = bits32(rng) >> 6; // 27 + 26 = 53 bits, the precision of a double
+		return double((a << 26) | b) / 9007199254740992.0;
+	}
+
+
+	/**
+	 * Samples the gaps between successive events of a sequence of independent trials that each succeed with the same probability
+	 * Jumping from one event to the next costs one draw per event rather than one per trial, which makes rare events (e.g. mutations) cheap to simulate
+	 */
+	class SkipSampler {
+	private:
+		double logFailure; // log of the probability of a trial failing
+		double probability;
+
+	public:
+
+		/**
+		 * Gap returned when events never happen; small enough that adding it to an index never overflows
+		 */
+		static const uint64_t Never = uint64_t(1) << 62;
+
+		inline SkipSampler(double probability = 0) : logFailure(log1p(-probability)), probability(probability) {}
+
+		/**
+		 * Returns the number of failed trials before the next successful one, following a geometric distribution
+		 */
+		template<typename G>
+		inline uint64_t next(G& rng) const {
+			if (probability <= 0) return Never;
+			if (probability >= 1) return 0;
+			double gap = floor(log(1 - uniform(rng)) / logFailure);
+			return gap < double(Never) ? uint64_t(gap) : Never;
+		}
+	};
+
+};
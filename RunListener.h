@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <cmath>
+#include "Expression.h"
+#include "Config.h"
+#include "Serialization.h"
+#include "Profiler.h"
+
+
+/**
+ * State of a run of the genetic algorithm, as seen by its listeners
+ */
+template<typename T>
+struct RunState {
+	std::string name; // name of the problem, possibly with the index of its parameter set
+	int seed = 0;
+	RunParameters params;
+	int64_t startTime = 0; // unix time at which the run started
+	int generation = 0; // current generation, starting at 1
+	T fitness = INFINITY; // best fitness found so far
+	std::shared_ptr<Expression<T>> expression = nullptr; // best expression found so far
+	bool improved = false; // whether the best fitness improved in the current generation
+	float duplicateRatio = 0; // fraction of duplicates in the current generation
+	float meanSize = 0; // mean number of nodes of the expressions in the current generation
+	uint64_t evaluations = 0; // number of fitness evaluations since the start of the run
+	int restarts = 0; // number of times the population was restarted after stagnating
+	double seconds = 0; // wall-clock time since the start of the run
+	Profiler::Stats profile; // time spent in each phase of the current generation, and events counted during it (only filled in if PROFILE is defined)
+	Profiler::Stats totalProfile; // sum of the profiles of all generations since the start of the run
+	std::string stopReason; // why the run stopped: solved, generations, time, evaluations or stagnation, or interrupted for logs of unfinished runs (only set once the run has finished)
+};
+
+
+/**
+ * Receives the progress of a run of the genetic algorithm, e.g. to log it
+ * Listeners that keep state of their own can save it along with the run's checkpoints, so that they can carry on when the run is resumed
+ */
+template<typename T>
+class RunListener {
+public:
+
+	virtual ~RunListener() {}
+
+	/**
+	 * Called once before the first generation of a run (but not when the run is resumed from a checkpoint)
+	 */
+	virtual void runStarted(const RunState<T>& state) {}
+
+	/**
+	 * Called after every generation
+	 */
+	virtual void generationDone(const RunState<T>& state) {}
+
+	/**
+	 * Called once when the run has finished, whatever the reason
+	 */
+	virtual void runFinished(const RunState<T>& state) {}
+
+	/**
+	 * Saves and restores the listener's own state along with the run's checkpoints
+	 */
+	virtual void save(Serialization::BinaryWriter& writer) {}
+	virtual void load(Serialization::BinaryReader& reader) {}
+
+}; // class RunListener
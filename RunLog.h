@@ -0,0 +1,437 @@
+#pragma once
+
+#include <string>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include "RunListener.h"
+#include "JsonWriter.h"
+
+
+/**
+ * Logs a run to the console: each new best fit if the run is verbose, and the best solution once the run has finished, along with its derivatives
+ */
+template<typename T>
+class ConsoleRunLog : public RunListener<T> {
+public:
+
+	void generationDone(const RunState<T>& state) override {
+		if (state.improved && state.params.verbose) {
+			printf("%s \tGen. %d, \tfitness %f, \tduplicates %.1f%%, \tf(x, y) = %s\n", state.name.c_str(), state.generation, state.fitness, 100 * state.duplicateRatio, state.expression->toString().c_str());
+		}
+	}
+
+	void runFinished(const RunState<T>& state) override {
+		auto& bestExpression = state.expression;
+		if (!bestExpression) {
+			printf("Could not solve %s, null result.\n\n", state.name.c_str());
+			return;
+		}
+		printf("\nFinished solving %s (seed %d) in %d generations (%s): \tfitness %f, \tf(x, y) = %s\n\n", state.name.c_str(), state.seed, state.generation, state.stopReason.c_str(), state.fitness, bestExpression->toString().c_str());
+		printf("d/dx f(x, y) = %s\n", bestExpression->derivative(0)->simplify()->toString().c_str());
+		printf("d/dy f(x, y) = %s\n", bestExpression->derivative(1)->simplify()->toString().c_str());
+		printf("d^2/dx^2 f(x, y) = %s\n", bestExpression->derivative(0)->derivative(0)->simplify()->toString().c_str());
+		printf("d^2/dy^2 f(x, y) = %s\n\n", bestExpression->derivative(1)->derivative(1)->simplify()->toString().c_str());
+	}
+
+}; // class ConsoleRunLog
+
+
+
+/**
+ * Logs a run to results/<name>_<seed>_<time>.json, in the format read by index.html:
+ * the parameters of the run, followed by one entry per generation in which a new best fit was found, and the outcome of the run along with the duplicate ratio of every generation
+ * Entries are streamed to the file as they are found, so the file never needs to be held in memory and survives (truncated) if the run is interrupted
+ */
+template<typename T>
+class JsonRunLog : public RunListener<T> {
+private:
+
+	JsonWriter json;
+
+	/**
+	 * File to write to, or empty to use the default name
+	 */
+	std::string filename;
+
+	/**
+	 * Duplicate ratio of each generation so far, written once the run has finished as the array of entries is still open until then
+	 */
+	std::vector<float> duplicateRatios;
+
+public:
+
+	JsonRunLog(const std::string& filename = "") : filename(filename) {}
+
+	void runStarted(const RunState<T>& state) override;
+	void generationDone(const RunState<T>& state) override;
+	void runFinished(const RunState<T>& state) override;
+	void save(Serialization::BinaryWriter& writer) override;
+	void load(Serialization::BinaryReader& reader) override;
+
+}; // class JsonRunLog
+
+
+
+template<typename T>
+inline void JsonRunLog<T>::runStarted(const RunState<T>& state) {
+	json.open(filename.empty() ? "results/" + state.name + "_" + std::to_string(state.seed) + "_" + std::to_string(state.startTime) + ".json" : filename);
+	json.beginObject();
+	json.key("time").value(state.startTime);
+	json.key("seed").value(state.seed);
+	json.key("problem").value(state.name);
+	json.key("useTrees").value(state.params.useTrees);
+	json.key("populationSize").value(state.params.populationSize);
+	json.key("replicationRate").value(state.params.replicationRate);
+	json.key("mutationRate").value(state.params.mutationRate);
+	json.key("maxGeneration").value(state.params.generations);
+	if (state.params.useTrees) {
+		json.key("replicationBias").value(state.params.replicationBias);
+		json.key("treeMutationRate").value(state.params.treeMutationRate);
+		json.key("crossoverRate").value(state.params.crossoverRate);
+	} else {
+		json.key("chromosomeSize").value(state.params.chromosomeSize);
+		json.key("randomRate").value(state.params.randomRate);
+	}
+	json.key("generations").beginArray();
+}
+
+template<typename T>
+inline void JsonRunLog<T>::generationDone(const RunState<T>& state) {
+	duplicateRatios.push_back(state.duplicateRatio);
+	// one entry each time a new best fit is found
+	if (!state.improved) return;
+	json.beginObject();
+	json.key("generation").value(state.generation);
+	json.key("fitness").value(state.fitness);
+	json.key("duplicates").value(state.duplicateRatio);
+	json.key("expression").value(state.expression->toString());
+	json.key("jsExpression").value(state.expression->toJsString());
+	json.endObject();
+}
+
+template<typename T>
+inline void JsonRunLog<T>::runFinished(const RunState<T>& state) {
+	json.endArray();
+	json.key("duplicateRatios").beginArray();
+	for (float ratio : duplicateRatios) {
+		json.value(ratio);
+	}
+	json.endArray();
+	json.key("stopReason").value(state.stopReason);
+	json.key("lastGeneration").value(state.generation);
+	json.key("seconds").value(state.seconds);
+	json.key("evaluations").value(state.evaluations);
+	json.key("restarts").value(state.restarts);
+	if (!state.totalProfile.empty()) {
+		json.key("profile").beginObject();
+		for (int i = 0; i < Profiler::PhaseCount; ++i) {
+			json.key(Profiler::PhaseNames[i]).beginObject();
+			json.key("seconds").value(state.totalProfile.seconds[i]);
+			json.key("calls").value(state.totalProfile.calls[i]);
+			if (state.totalProfile.hasEvents()) {
+				const uint64_t* events = state.totalProfile.events[i];
+				for (int j = 0; j < PerfCounters::EventCount; ++j) {
+					json.key(PerfCounters::EventNames[j]).value(events[j]);
+				}
+				json.key("ipc").value(events[PerfCounters::Cycles] > 0 ? double(events[PerfCounters::Instructions]) / events[PerfCounters::Cycles] : 0.0);
+			}
+			json.endObject();
+		}
+		for (int i = 0; i < Profiler::CounterCount; ++i) {
+			json.key(Profiler::CounterNames[i]).value(state.totalProfile.counters[i]);
+		}
+		json.endObject();
+	}
+	json.endObject();
+	json.close();
+}
+
+template<typename T>
+inline void JsonRunLog<T>::save(Serialization::BinaryWriter& writer) {
+	json.save(writer);
+	writer.write<uint32_t>(uint32_t(duplicateRatios.size()));
+	for (float ratio : duplicateRatios) {
+		writer.write<float>(ratio);
+	}
+}
+
+template<typename T>
+inline void JsonRunLog<T>::load(Serialization::BinaryReader& reader) {
+	json.load(reader);
+	duplicateRatios.resize(reader.read<uint32_t>());
+	for (float& ratio : duplicateRatios) {
+		ratio = reader.read<float>();
+	}
+}
+
+
+
+/**
+ * Prints the profile of a run to the console: a summary of each generation if the run is verbose, and the breakdown of the whole run once it has finished
+ */
+template<typename T>
+class ConsoleProfileLog : public RunListener<T> {
+public:
+
+	void generationDone(const RunState<T>& state) override {
+		if (!state.params.verbose || state.profile.empty()) return;
+		const Profiler::Stats& s = state.profile;
+		std::string line = state.name + " \tGen. " + std::to_string(state.generation) + ", \tms:";
+		for (int i = 0; i < Profiler::PhaseCount; ++i) {
+			char phase[64];
+			snprintf(phase, sizeof(phase), " %s %.2f", Profiler::PhaseNames[i], 1000 * s.seconds[i]);
+			line += phase;
+		}
+		char counters[128];
+		snprintf(counters, sizeof(counters), ", \t%llu evaluations (%llu invalid, %llu exceptions), \t%.1f nodes/evaluation",
+			(unsigned long long)s.counters[Profiler::Evaluations], (unsigned long long)s.counters[Profiler::Invalid], (unsigned long long)s.counters[Profiler::Exceptions],
+			double(s.counters[Profiler::Nodes]) / std::max<uint64_t>(1, s.counters[Profiler::Evaluations]));
+		std::string events;
+		if (s.hasEvents()) {
+			char buffer[160];
+			uint64_t cycles = s.totalEvents(PerfCounters::Cycles);
+			snprintf(buffer, sizeof(buffer), ", \t%.1f Mcycles, IPC %.2f, %llu cache misses, %llu branch misses",
+				cycles / 1e6, double(s.totalEvents(PerfCounters::Instructions)) / cycles,
+				(unsigned long long)s.totalEvents(PerfCounters::CacheMisses), (unsigned long long)s.totalEvents(PerfCounters::BranchMisses));
+			events = buffer;
+		}
+		printf("%s%s%s\n", line.c_str(), counters, events.c_str());
+	}
+
+	void runFinished(const RunState<T>& state) override {
+		const Profiler::Stats& s = state.totalProfile;
+		if (s.empty()) return;
+		double total = s.totalSeconds();
+		std::string report = "Profile of " + state.name + " (seed " + std::to_string(state.seed) + "), " + std::to_string(state.generation) + " generations:\n";
+		for (int i = 0; i < Profiler::PhaseCount; ++i) {
+			char phase[128];
+			snprintf(phase, sizeof(phase), "  %-12s %10.3f s  %5.1f%%  %12llu calls\n", Profiler::PhaseNames[i], s.seconds[i], total > 0 ? 100 * s.seconds[i] / total : 0.0, (unsigned long long)s.calls[i]);
+			report += phase;
+		}
+		for (int i = 0; i < Profiler::CounterCount; ++i) {
+			char counter[128];
+			snprintf(counter, sizeof(counter), "  %-12s %12llu\n", Profiler::CounterNames[i], (unsigned long long)s.counters[i]);
+			report += counter;
+		}
+		if (s.hasEvents()) {
+			char header[128];
+			snprintf(header, sizeof(header), "  %-12s %14s %14s %6s %14s %14s\n", "", "cycles", "instructions", "IPC", "cache misses", "branch misses");
+			report += header;
+			for (int i = 0; i < Profiler::PhaseCount; ++i) {
+				const uint64_t* events = s.events[i];
+				char phase[160];
+				snprintf(phase, sizeof(phase), "  %-12s %14llu %14llu %6.2f %14llu %14llu\n", Profiler::PhaseNames[i],
+					(unsigned long long)events[PerfCounters::Cycles], (unsigned long long)events[PerfCounters::Instructions],
+					events[PerfCounters::Cycles] > 0 ? double(events[PerfCounters::Instructions]) / events[PerfCounters::Cycles] : 0.0,
+					(unsigned long long)events[PerfCounters::CacheMisses], (unsigned long long)events[PerfCounters::BranchMisses]);
+				report += phase;
+			}
+		}
+		printf("%s\n", report.c_str()); // printed at once, so that reports of parallel runs don't interleave
+	}
+
+}; // class ConsoleProfileLog
+
+
+
+/**
+ * Logs a run to results/<name>_<seed>_<time>.runlog, in a compact append-only binary format that can be converted to json with runlog2json:
+ * - a header with the magic number, the format version, the start time, the seed and the parameters of the run, and the name of the problem
+ * - one generation record each time a new best fit is found, made of a fixed-size part ending with the size of the expression, followed by the expression in the prefix encoding of Serialization::writeExpression
+ * - one duplicates record for each other generation, with the generation and its duplicate ratio (since version 2)
+ * - an end record with the outcome of the run (missing if the run was interrupted)
+ * A record cut short because the run crashed while it was being written is ignored when the log is read
+ * Numbers are stored in the byte order of the machine, as in checkpoints
+ */
+template<typename T>
+class BinaryRunLog : public RunListener<T> {
+private:
+
+	FileWriter::AsyncAppender file;
+
+	/**
+	 * Buffer in which records are assembled before being appended to the file
+	 */
+	Serialization::BinaryWriter record;
+
+	void append() {
+		file.append(record.data().data(), record.data().size());
+		record.data().clear();
+	}
+
+public:
+
+	static const uint32_t Magic = 0x4C524147; // "GARL" in little-endian order
+	static const uint32_t Version = 2;
+	static const unsigned char GenerationRecord = 'G';
+	static const unsigned char DuplicatesRecord = 'D';
+	static const unsigned char EndRecord = 'E';
+
+	void runStarted(const RunState<T>& state) override;
+	void generationDone(const RunState<T>& state) override;
+	void runFinished(const RunState<T>& state) override;
+
+	void save(Serialization::BinaryWriter& writer) override {
+		file.flush();
+		writer.writeString(file.getFilename());
+		writer.write<uint64_t>(file.size());
+	}
+
+	void load(Serialization::BinaryReader& reader) override {
+		std::string filename = reader.readString();
+		file.resume(filename, reader.read<uint64_t>());
+	}
+
+}; // class BinaryRunLog
+
+
+/**
+ * Replays a run logged by BinaryRunLog into a listener, as if the run was happening (e.g. into a JsonRunLog to convert it to json)
+ * The listener's runFinished is called with the stop reason "interrupted" if the log has no end record
+ * Throws if the data is not a valid run log
+ */
+template<typename T>
+void replayRunLog(const std::vector<char>& data, RunListener<T>& listener);
+
+
+
+template<typename T> const uint32_t BinaryRunLog<T>::Magic;
+template<typename T> const uint32_t BinaryRunLog<T>::Version;
+template<typename T> const unsigned char BinaryRunLog<T>::GenerationRecord;
+template<typename T> const unsigned char BinaryRunLog<T>::DuplicatesRecord;
+template<typename T> const unsigned char BinaryRunLog<T>::EndRecord;
+
+template<typename T>
+inline void BinaryRunLog<T>::runStarted(const RunState<T>& state) {
+	file.open("results/" + state.name + "_" + std::to_string(state.seed) + "_" + std::to_string(state.startTime) + ".runlog");
+	record.write<uint32_t>(Magic);
+	record.write<uint32_t>(Version);
+	record.write<int64_t>(state.startTime);
+	record.write<int32_t>(state.seed);
+	record.write<bool>(state.params.useTrees);
+	record.write<int32_t>(state.params.populationSize);
+	record.write<int32_t>(state.params.generations);
+	record.write<float>(state.params.replicationRate);
+	record.write<float>(state.params.mutationRate);
+	record.write<float>(state.params.randomRate);
+	record.write<int32_t>(state.params.chromosomeSize);
+	record.write<int32_t>(state.params.replicationBias);
+	record.write<float>(state.params.treeMutationRate);
+	record.write<float>(state.params.crossoverRate);
+	record.writeString(state.name);
+	append();
+}
+
+template<typename T>
+inline void BinaryRunLog<T>::generationDone(const RunState<T>& state) {
+	if (!state.improved) {
+		record.write<unsigned char>(DuplicatesRecord);
+		record.write<int32_t>(state.generation);
+		record.write<float>(state.duplicateRatio);
+		append();
+		return;
+	}
+	record.write<unsigned char>(GenerationRecord);
+	record.write<int32_t>(state.generation);
+	record.write<double>(double(state.fitness));
+	record.write<float>(state.duplicateRatio);
+	record.write<uint64_t>(state.evaluations);
+	record.write<double>(state.seconds);
+	size_t sizeOffset = record.data().size();
+	record.write<uint32_t>(0);
+	Serialization::writeExpression<T>(record, state.expression);
+	uint32_t expressionSize = uint32_t(record.data().size() - sizeOffset - sizeof(uint32_t));
+	memcpy(&record.data()[sizeOffset], &expressionSize, sizeof(uint32_t));
+	append();
+}
+
+template<typename T>
+inline void BinaryRunLog<T>::runFinished(const RunState<T>& state) {
+	record.write<unsigned char>(EndRecord);
+	record.write<int32_t>(state.generation);
+	record.write<uint64_t>(state.evaluations);
+	record.write<int32_t>(state.restarts);
+	record.write<double>(state.seconds);
+	record.writeString(state.stopReason);
+	append();
+	file.close();
+}
+
+template<typename T>
+inline void replayRunLog(const std::vector<char>& data, RunListener<T>& listener) {
+	Serialization::BinaryReader reader(data);
+	if (reader.read<uint32_t>() != BinaryRunLog<T>::Magic) {
+		throw "Not a run log";
+	}
+	uint32_t version = reader.read<uint32_t>();
+	if (version < 1 || version > BinaryRunLog<T>::Version) { // version 1 only lacks duplicates records
+		throw "Unsupported run log version";
+	}
+	RunState<T> state;
+	state.startTime = reader.read<int64_t>();
+	state.seed = reader.read<int32_t>();
+	state.params.useTrees = reader.read<bool>();
+	state.params.populationSize = reader.read<int32_t>();
+	state.params.generations = reader.read<int32_t>();
+	state.params.replicationRate = reader.read<float>();
+	state.params.mutationRate = reader.read<float>();
+	state.params.randomRate = reader.read<float>();
+	state.params.chromosomeSize = reader.read<int32_t>();
+	state.params.replicationBias = reader.read<int32_t>();
+	state.params.treeMutationRate = reader.read<float>();
+	state.params.crossoverRate = reader.read<float>();
+	state.name = reader.readString();
+	listener.runStarted(state);
+
+	state.stopReason = "interrupted";
+	while (!reader.atEnd()) {
+		unsigned char type = reader.read<unsigned char>();
+		if (type == BinaryRunLog<T>::GenerationRecord) {
+			const size_t FixedSize = sizeof(int32_t) + sizeof(double) + sizeof(float) + sizeof(uint64_t) + sizeof(double) + sizeof(uint32_t);
+			if (reader.remaining() < FixedSize) break;
+			int generation = reader.read<int32_t>();
+			T fitness = T(reader.read<double>());
+			float duplicateRatio = reader.read<float>();
+			uint64_t evaluations = reader.read<uint64_t>();
+			double seconds = reader.read<double>();
+			if (reader.remaining() < reader.read<uint32_t>()) break;
+			state.generation = generation;
+			state.fitness = fitness;
+			state.duplicateRatio = duplicateRatio;
+			state.evaluations = evaluations;
+			state.seconds = seconds;
+			state.expression = Serialization::readExpression<T>(reader);
+			state.improved = true;
+			listener.generationDone(state);
+		} else if (type == BinaryRunLog<T>::DuplicatesRecord) {
+			const size_t FixedSize = sizeof(int32_t) + sizeof(float);
+			if (reader.remaining() < FixedSize) break;
+			state.generation = reader.read<int32_t>();
+			state.duplicateRatio = reader.read<float>();
+			state.improved = false;
+			listener.generationDone(state);
+		} else if (type == BinaryRunLog<T>::EndRecord) {
+			const size_t FixedSize = sizeof(int32_t) + sizeof(uint64_t) + sizeof(int32_t) + sizeof(double) + sizeof(unsigned int);
+			if (reader.remaining() < FixedSize) break;
+			int generation = reader.read<int32_t>();
+			uint64_t evaluations = reader.read<uint64_t>();
+			int restarts = reader.read<int32_t>();
+			double seconds = reader.read<double>();
+			unsigned int length = reader.read<unsigned int>();
+			if (reader.remaining() < length) break;
+			std::string stopReason(length, '\0');
+			reader.readBytes(&stopReason[0], length);
+			state.generation = generation;
+			state.evaluations = evaluations;
+			state.restarts = restarts;
+			state.seconds = seconds;
+			state.stopReason = stopReason;
+			break;
+		} else {
+			throw "Invalid record in run log";
+		}
+	}
+	listener.runFinished(state);
+}
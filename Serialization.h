@@ -0,0 +1,155 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <type_traits>
+#include "Expression.h"
+#include "Random.h"
+#include "Program.h"
+
+
+/// Compact binary (de)serialization utilities, used to checkpoint populations
+
+
+namespace Serialization {
+
+	/**
+	 * Token written in place of an expression node to denote a null expression
+	 */
+	const unsigned char NullExpression = 0xFF;
+
+	/**
+	 * Accumulates binary data into a contiguous buffer
+	 */
+	class BinaryWriter {
+	private:
+		std::vector<char> buffer;
+
+	public:
+
+		/**
+		 * Writes raw bytes at the end of the buffer
+		 */
+		inline void writeBytes(const void* data, size_t size) {
+			size_t offset = buffer.size();
+			buffer.resize(offset + size);
+			if (size > 0) memcpy(&buffer[offset], data, size);
+		}
+
+		/**
+		 * Writes a trivially copyable value as-is
+		 */
+		template<typename V>
+		inline void write(const V& v) {
+			static_assert(std::is_trivially_copyable<V>::value, "Only trivially copyable values can be written directly");
+			writeBytes(&v, sizeof(V));
+		}
+
+		/**
+		 * Writes a length-prefixed string
+		 */
+		inline void writeString(const std::string& s) {
+			write<unsigned int>((unsigned int)s.size());
+			writeBytes(s.data(), s.size());
+		}
+
+		/**
+		 * Writes the full internal state of a random number generator
+		 */
+		inline void writeRng(const Random::Rng& rng) {
+			write<Random::Rng>(rng); // generators are plain arrays of integers, so their state is written as-is
+		}
+
+		inline const std::vector<char>& data() const { return buffer; }
+		inline std::vector<char>& data() { return buffer; }
+
+	}; // class BinaryWriter
+
+	/**
+	 * Reads binary data back from a buffer created by a BinaryWriter
+	 * Throws when attempting to read past the end of the buffer
+	 */
+	class BinaryReader {
+	private:
+		const char* buffer;
+		size_t size;
+		size_t offset = 0;
+
+	public:
+
+		inline BinaryReader(const std::vector<char>& data) : buffer(data.data()), size(data.size()) {}
+
+		inline void readBytes(void* data, size_t count) {
+			if (offset + count > size) {
+				throw "Unexpected end of binary data";
+			}
+			if (count > 0) memcpy(data, buffer + offset, count);
+			offset += count;
+		}
+
+		template<typename V>
+		inline V read() {
+			static_assert(std::is_trivially_copyable<V>::value, "Only trivially copyable values can be read directly");
+			V v;
+			readBytes(&v, sizeof(V));
+			return v;
+		}
+
+		inline std::string readString() {
+			unsigned int length = read<unsigned int>();
+			std::string s(length, '\0');
+			readBytes(&s[0], length);
+			return s;
+		}
+
+		inline void readRng(Random::Rng& rng) {
+			rng = read<Random::Rng>();
+		}
+
+		inline bool atEnd() const { return offset >= size; }
+
+		inline size_t remaining() const { return size - offset; }
+
+	}; // class BinaryReader
+
+
+	/**
+	 * Writes an expression tree in prefix order: one type byte per node, followed by the raw value for constants
+	 */
+	template<typename T>
+	void writeExpression(BinaryWriter& writer, const std::shared_ptr<Expression<T>>& expression) {
+		if (expression == nullptr) {
+			writer.write<unsigned char>(NullExpression);
+			return;
+		}
+		writer.write<unsigned char>((unsigned char)expression->type());
+		if (expression->type() == ExpressionType::Constant) {
+			writer.write<T>(expression->value());
+		}
+		for (int i = 0; i < expression->childCount(); ++i) {
+			writeExpression<T>(writer, expression->child(i));
+		}
+	}
+
+	/**
+	 * Reads back an expression tree written by writeExpression
+	 */
+	template<typename T>
+	std::shared_ptr<Expression<T>> readExpression(BinaryReader& reader) {
+		unsigned char type = reader.read<unsigned char>();
+		if (type == NullExpression) {
+			return nullptr;
+		}
+		if (type > (unsigned char)ExpressionType::SquareRoot) {
+			throw "Invalid expression type in binary data";
+		}
+		ExpressionType expressionType = ExpressionType(type);
+		T value = expressionType == ExpressionType::Constant ? reader.read<T>() : 0;
+		std::shared_ptr<Expression<T>> a, b;
+		if (operandCount(expressionType) > 0) a = readExpression<T>(reader);
+		if (operandCount(expressionType) > 1) b = readExpression<T>(reader);
+		return makeExpression<T>(expressionType, value, a, b);
+	}
+
+};
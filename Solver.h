@@ -0,0 +1,268 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include "Population.h"
+#include "TreePopulation.h"
+#include "FileWriter.h"
+#include "Serialization.h"
+#include "Config.h"
+#include "RunLog.h"
+#include "Monitor.h"
+
+
+typedef std::vector<std::unique_ptr<RunListener<double>>> RunListeners;
+
+
+/**
+ * Returns the listeners that log a run according to its parameters: to the console, and to json files, binary logs and the monitor if enabled
+ */
+RunListeners createListeners(const RunParameters& params) {
+	RunListeners listeners;
+	listeners.emplace_back(new ConsoleRunLog<double>());
+	if (params.json) {
+		listeners.emplace_back(new JsonRunLog<double>());
+	}
+	if (params.binaryLog) {
+		listeners.emplace_back(new BinaryRunLog<double>());
+	}
+	if (params.monitor) {
+		listeners.emplace_back(new MonitorRunLog<double>());
+	}
+#ifdef PROFILE
+	listeners.emplace_back(new ConsoleProfileLog<double>());
+#endif
+	return listeners;
+}
+
+
+/**
+ * Runs the genetic algorithm until the problem is solved or one of the budgets (generations, time, evaluations, stagnation) runs out, notifying the listeners of its progress
+ * create(stream) returns a new population using the given random stream; a new stream is used each time the population is restarted after stagnating
+ * fitness is the fitness function of the populations, whose collocation points are refined during the run if adaptive collocation is enabled
+ * Returns the final state of the run
+ */
+template<typename F>
+RunState<double> evolve(F create, Fitness<double>& fitness, const std::string& name, int seed, const RunParameters& params, const RunListeners& listeners) {
+
+	RunState<double> state;
+	state.name = name;
+	state.seed = seed;
+	state.params = params;
+	state.startTime = time(nullptr);
+	state.stopReason = "generations";
+
+	auto population = create(state.restarts);
+	population->setDuplicatePolicy(params.duplicatePolicy);
+
+
+	// Iterate over generations
+	Profiler::take(); // drop whatever this thread recorded before the run, e.g. during a previous run
+	int firstGen = 1;
+	int lastImprovement = 0; // last generation in which the best fitness improved, or in which the population was restarted
+	uint64_t pastEvaluations = 0; // fitness evaluations of the populations discarded by restarts, or done before resuming
+	double pastSeconds = 0; // time spent before resuming
+	auto start = std::chrono::steady_clock::now();
+	auto elapsedSeconds = [&]() -> double {
+		return pastSeconds + std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	};
+
+
+	// resume from the last checkpoint of the run, if it was interrupted
+	// checkpoints start with the parameters that shape the run (all but its outputs), as one left by a run with other parameters can't be resumed
+	std::string checkpointFile = "results/" + name + "_" + std::to_string(seed) + ".checkpoint";
+	FileWriter::AsyncWriter checkpointWriter;
+	std::vector<char> checkpoint;
+	Serialization::BinaryWriter parameters;
+	parameters.write<bool>(params.useTrees);
+	parameters.write<int>(params.populationSize);
+	parameters.write<int>(params.generations);
+	parameters.write<float>(params.replicationRate);
+	parameters.write<float>(params.mutationRate);
+	parameters.write<float>(params.randomRate);
+	parameters.write<int>(params.chromosomeSize);
+	parameters.write<int>(params.replicationBias);
+	parameters.write<float>(params.treeMutationRate);
+	parameters.write<float>(params.crossoverRate);
+	parameters.write<CrossoverMode>(params.crossoverMode);
+	parameters.write<unsigned int>(params.crossoverMaxDepth);
+	parameters.write<DuplicatePolicy>(params.duplicatePolicy);
+	parameters.write<int>(params.checkpointInterval);
+	parameters.write<double>(params.timeLimit);
+	parameters.write<double>(params.evaluationLimit);
+	parameters.write<int>(params.stagnationLimit);
+	parameters.write<bool>(params.restartOnStagnation);
+	parameters.write<bool>(params.fastMath);
+	parameters.write<int>(params.collocationPoints);
+	parameters.write<int>(params.refineInterval);
+	std::string parameterBytes(parameters.data().begin(), parameters.data().end());
+	bool resume = params.checkpointInterval > 0 && FileWriter::ReadBinary(checkpointFile, checkpoint);
+	if (resume) {
+		Serialization::BinaryReader reader(checkpoint);
+		std::string stored(parameterBytes.size(), '\0');
+		resume = reader.remaining() >= sizeof(unsigned int) + stored.size() && reader.read<unsigned int>() == stored.size();
+		if (resume) {
+			reader.readBytes(&stored[0], stored.size());
+			resume = stored == parameterBytes;
+		}
+		if (!resume) {
+			fprintf(stderr, "Ignoring the checkpoint of %s (seed %d), which was made with other parameters\n", name.c_str(), seed);
+			std::remove(checkpointFile.c_str());
+		}
+	}
+	if (resume) {
+		Serialization::BinaryReader reader(checkpoint);
+		reader.readString(); // parameters, checked above
+		firstGen = reader.read<int>() + 1;
+		state.restarts = reader.read<int>();
+		lastImprovement = reader.read<int>();
+		pastEvaluations = reader.read<uint64_t>();
+		pastSeconds = reader.read<double>();
+		state.totalProfile = reader.read<Profiler::Stats>();
+		state.fitness = reader.read<double>();
+		state.expression = Serialization::readExpression<double>(reader);
+		for (auto& listener : listeners) {
+			listener->load(reader);
+		}
+		if (state.restarts > 0) {
+			population = create(state.restarts);
+			population->setDuplicatePolicy(params.duplicatePolicy);
+		}
+		population->load(reader);
+		if (params.collocationPoints > 0) {
+			fitness.loadCollocation(reader);
+		}
+		printf("Resuming %s (seed %d) from generation %d\n", name.c_str(), seed, firstGen);
+	} else {
+		for (auto& listener : listeners) {
+			listener->runStarted(state);
+		}
+	}
+
+
+	for (state.generation = firstGen; state.generation <= params.generations; ++state.generation) {
+		int gen = state.generation;
+		auto top = population->nextGeneration();
+		state.profile = Profiler::take();
+		state.totalProfile += state.profile;
+		ExpressionPtr<double> elite = top ? top->expression : nullptr; // top belongs to the population, which a restart discards
+		// with adaptive collocation or fast accuracy, fitness values above the rescoring threshold are estimates at points that change with every refinement,
+		// so the best candidate is scored exactly over the whole grid before it is compared with the best fit of the run
+		double eliteFitness = top ? top->fitness : INFINITY;
+		if (top && (params.collocationPoints > 0 || params.fastMath)) {
+			eliteFitness = fitness.exactFitness(elite);
+		}
+		state.improved = eliteFitness < state.fitness;
+		if (state.improved) {
+			state.fitness = eliteFitness;
+			state.expression = elite;
+			lastImprovement = gen;
+		}
+		state.duplicateRatio = population->getDuplicateRatio();
+		state.meanSize = population->getMeanSize();
+		state.evaluations = pastEvaluations + population->getEvaluations();
+		state.seconds = elapsedSeconds();
+		for (auto& listener : listeners) {
+			listener->generationDone(state);
+		}
+
+		// stop once the problem is solved or a budget is exhausted
+		if (eliteFitness < 1e-7) {
+			state.stopReason = "solved";
+			break;
+		}
+		if (params.timeLimit > 0 && state.seconds >= params.timeLimit) {
+			state.stopReason = "time";
+			break;
+		}
+		if (params.evaluationLimit > 0 && state.evaluations >= params.evaluationLimit) {
+			state.stopReason = "evaluations";
+			break;
+		}
+		if (params.stagnationLimit > 0 && gen - lastImprovement >= params.stagnationLimit) {
+			if (!params.restartOnStagnation) {
+				state.stopReason = "stagnation";
+				break;
+			}
+			// start over from a new random population, keeping the best fit found so far
+			pastEvaluations += population->getEvaluations();
+			population = create(++state.restarts);
+			population->setDuplicatePolicy(params.duplicatePolicy);
+			lastImprovement = gen;
+			if (params.verbose) {
+				printf("%s \tGen. %d, \tno improvement in %d generations, restarting (%d)\n", name.c_str(), gen, params.stagnationLimit, state.restarts);
+			}
+		}
+
+		// move the collocation points toward where the best candidate is furthest from solving the equation; the fitness values computed so far estimated it elsewhere
+		if (params.collocationPoints > 0 && params.refineInterval > 0 && gen % params.refineInterval == 0 && fitness.refine(elite)) {
+			population->invalidateFitness();
+		}
+
+		// save the state of the run in the background every so often
+		if (params.checkpointInterval > 0 && gen % params.checkpointInterval == 0 && gen < params.generations) {
+			Serialization::BinaryWriter writer;
+			writer.writeString(parameterBytes);
+			writer.write<int>(gen);
+			writer.write<int>(state.restarts);
+			writer.write<int>(lastImprovement);
+			writer.write<uint64_t>(pastEvaluations + population->getEvaluations());
+			writer.write<double>(elapsedSeconds());
+			writer.write<Profiler::Stats>(state.totalProfile);
+			writer.write<double>(state.fitness);
+			Serialization::writeExpression<double>(writer, state.expression);
+			for (auto& listener : listeners) {
+				listener->save(writer);
+			}
+			population->save(writer);
+			if (params.collocationPoints > 0) {
+				fitness.saveCollocation(writer);
+			}
+			checkpointWriter.write(checkpointFile, writer.data());
+		}
+	}
+	state.generation = std::min(state.generation, params.generations);
+	state.evaluations = pastEvaluations + population->getEvaluations();
+	state.seconds = elapsedSeconds();
+	for (auto& listener : listeners) {
+		listener->runFinished(state);
+	}
+
+	// the run is complete, its checkpoint is not needed anymore
+	if (params.checkpointInterval > 0) {
+		checkpointWriter.wait();
+		std::remove(checkpointFile.c_str());
+	}
+
+
+	return state;
+}
+
+
+/**
+ * Solves an ODE/PDE given its fitness function and a grammatical decoder, with the given seed and parameters, and returns the final state of the run
+ */
+RunState<double> solve(std::string name, const Fitness<double>& problemFitness, GrammarDecoder<double>* decoder, int seed, const RunParameters& params, const RunListeners& listeners) {
+	Fitness<double> fitnessFunction = problemFitness; // problems are shared between runs, which may not all use the same accuracy
+	if (params.fastMath) {
+		fitnessFunction.setAccuracy(FastMath::Accuracy::Fast);
+	}
+	if (params.collocationPoints > 0) {
+		fitnessFunction.setCollocationBudget(params.collocationPoints);
+	}
+	if (params.useTrees) {
+		return evolve([&](unsigned int stream) {
+			std::unique_ptr<TreePopulation<double>> population(new TreePopulation<double>(params.populationSize, params.replicationRate, params.replicationBias, params.mutationRate, params.treeMutationRate, params.randomRate, &fitnessFunction, decoder, seed, stream));
+			population->setCrossover(params.crossoverRate, params.crossoverMode, params.crossoverMaxDepth);
+			return population;
+		}, fitnessFunction, name, seed, params, listeners);
+	} else {
+		return evolve([&](unsigned int stream) {
+			return std::unique_ptr<Population<double>>(new Population<double>(params.populationSize, params.chromosomeSize, params.replicationRate, params.mutationRate, params.randomRate, &fitnessFunction, decoder, seed, 255, stream));
+		}, fitnessFunction, name, seed, params, listeners);
+	}
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Expression.h"
+#include "Build.h"
 #include "Multiplication.h"
 #include "Division.h"
 
@@ -10,7 +11,7 @@ private:
 	ExpressionPtr<T> a;
 public:
 
-	SquareRoot(ExpressionPtr<T> a) : a(a) {}
+	SquareRoot(ExpressionPtr<T> a) : Expression<T>(ExpressionType::SquareRoot, 0, a.get()), a(a) {}
 
 	T evaluate(T x, T y) const override;
 
@@ -24,7 +25,15 @@ public:
 
 	bool isConstant() const override { return a->isConstant(); }
 
-	ExpressionPtr<T> mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+	ExpressionPtr<T> mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+
+	static const ExpressionType Type = ExpressionType::SquareRoot;
+
+	ExpressionType type() const override { return Type; }
+
+	int childCount() const override { return 1; }
+
+	ExpressionPtr<T> child(int i) const override { return a; }
 
 };
 #define SquareRootPtr(T, a) ExpressionPtr<T>(new SquareRoot<T>(a))
@@ -45,7 +54,7 @@ inline T SquareRoot<T>::evaluate(T x, T y) const {
 template<typename T>
 inline ExpressionPtr<T> SquareRoot<T>::derivative(int dimension) const {
 	// d/dx sqrt(f(x)) = f'(x) / (2sqrt(f(x)))
-	return DivisionPtr(T, a->derivative(dimension), MultiplicationPtr(T, ConstantPtr(T, 2), SquareRootPtr(T, a)));
+	return Build::divide(a->derivative(dimension), Build::multiply(ConstantPtr(T, 2), this->self()));
 }
 
 template<typename T>
@@ -57,11 +66,14 @@ inline ExpressionPtr<T> SquareRoot<T>::simplify() const {
 }
 
 template<typename T>
-inline ExpressionPtr<T> SquareRoot<T>::mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
+inline ExpressionPtr<T> SquareRoot<T>::mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
 	TREE_MUTATION();
 	auto newA = a->mutate(rng, mutationChance, treeMutationChance, grammar, false);
 	if (MUTATION) {
 		return grammar->instantiateFunction(newA, rng);
 	}
+	if (newA == a) {
+		return this->self(); // nothing changed, keep sharing the same node
+	}
 	return SquareRootPtr(T, newA);
 }
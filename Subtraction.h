@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Expression.h"
+#include "Build.h"
 #include "Multiplication.h"
 
 template<typename T>
@@ -10,7 +11,7 @@ private:
 	ExpressionPtr<T> b;
 public:
 
-	Subtraction(ExpressionPtr<T> a, ExpressionPtr<T> b) : a(a), b(b) {}
+	Subtraction(ExpressionPtr<T> a, ExpressionPtr<T> b) : Expression<T>(ExpressionType::Subtraction, 0, a.get(), b.get()), a(a), b(b) {}
 
 	T evaluate(T x, T y) const override;
 
@@ -24,7 +25,15 @@ public:
 
 	bool isConstant() const override { return a->isConstant() && b->isConstant(); }
 
-	ExpressionPtr<T> mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+	ExpressionPtr<T> mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+
+	static const ExpressionType Type = ExpressionType::Subtraction;
+
+	ExpressionType type() const override { return Type; }
+
+	int childCount() const override { return 2; }
+
+	ExpressionPtr<T> child(int i) const override { return i == 0 ? a : b; }
 };
 #define SubtractionPtr(T, a, b) ExpressionPtr<T>(new Subtraction<T>(a, b))
 #define SubtractionPtrf(a, b) SubtractionPtr(float, a, b)
@@ -41,7 +50,7 @@ template<typename T>
 inline ExpressionPtr<T> Subtraction<T>::derivative(int dimension) const {
 	auto aPrime = a->derivative(dimension);
 	auto bPrime = b->derivative(dimension);
-	return SubtractionPtr(T, aPrime, bPrime);
+	return Build::subtract(aPrime, bPrime);
 }
 
 template<typename T>
@@ -63,12 +72,15 @@ inline ExpressionPtr<T> Subtraction<T>::simplify() const {
 }
 
 template<typename T>
-inline ExpressionPtr<T> Subtraction<T>::mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
+inline ExpressionPtr<T> Subtraction<T>::mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
 	TREE_MUTATION();
 	auto newA = a->mutate(rng, mutationChance, treeMutationChance, grammar, first);
 	auto newB = b->mutate(rng, mutationChance, treeMutationChance, grammar, first);
 	if (MUTATION) {
 		return grammar->instantiateOperation(newA, newB, rng);
 	}
+	if (newA == a && newB == b) {
+		return this->self(); // nothing changed, keep sharing the same node
+	}
 	return SubtractionPtr(T, newA, newB);
 }
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "Expression.h"
+#include "Program.h"
+#include "Random.h"
+
+
+/**
+ * How the sub-trees exchanged by crossover are chosen
+ */
+enum class CrossoverMode {
+	Subtree, // any sub-tree of the donor can replace any sub-tree of the receiver
+	SizeFair // the sub-tree taken from the donor has at most 1 + 2x as many nodes as the one it replaces, which keeps trees from bloating
+};
+
+
+/**
+ * Recombines expression trees by grafting a random sub-tree of one parent (the donor) in place of a random sub-tree of another (the receiver)
+ * Crossover points are picked uniformly by preorder index, excluding the roots, and reached by walking down using the size of each sub-tree
+ * Only the path from the root of the receiver to the crossover point is rebuilt; everything else is shared with the parents
+ */
+template<typename T>
+class TreeCrossover {
+private:
+
+	CrossoverMode mode;
+
+	/**
+	 * Maximum height of the trees created by crossover, or 0 for no limit
+	 */
+	unsigned int maxDepth;
+
+	/**
+	 * Number of pairs of crossover points to try before giving up, when they have to satisfy the size or depth constraints
+	 */
+	static const int Attempts = 10;
+
+public:
+
+	TreeCrossover(CrossoverMode mode = CrossoverMode::SizeFair, unsigned int maxDepth = 0) : mode(mode), maxDepth(maxDepth) {}
+
+	/**
+	 * Returns a new tree made of the receiver with one of its sub-trees replaced by a sub-tree of the donor; both parents are left untouched
+	 * Returns the receiver itself if no valid pair of crossover points was found
+	 */
+	std::shared_ptr<Expression<T>> cross(const std::shared_ptr<Expression<T>>& receiver, const std::shared_ptr<Expression<T>>& donor, Random::Rng& rng) const;
+
+	/**
+	 * Returns the node at the given preorder index of a tree, and optionally its depth in the tree
+	 */
+	static std::shared_ptr<Expression<T>> nodeAt(const std::shared_ptr<Expression<T>>& root, unsigned int index, unsigned int* depth = nullptr);
+
+	/**
+	 * Returns a copy of a tree in which the node at the given preorder index is replaced by another sub-tree
+	 */
+	static std::shared_ptr<Expression<T>> replaceAt(const std::shared_ptr<Expression<T>>& root, unsigned int index, const std::shared_ptr<Expression<T>>& replacement);
+
+};
+
+
+
+template<typename T>
+inline std::shared_ptr<Expression<T>> TreeCrossover<T>::cross(const std::shared_ptr<Expression<T>>& receiver, const std::shared_ptr<Expression<T>>& donor, Random::Rng& rng) const {
+	if (receiver->size() < 2 || donor->size() < 2) {
+		return receiver;
+	}
+	for (int attempt = 0; attempt < Attempts; ++attempt) {
+		unsigned int depth;
+		unsigned int i = 1 + Random::bounded(rng, receiver->size() - 1);
+		auto removed = nodeAt(receiver, i, &depth);
+		auto inserted = nodeAt(donor, 1 + Random::bounded(rng, donor->size() - 1));
+		if (mode == CrossoverMode::SizeFair && inserted->size() > 1 + 2 * removed->size()) {
+			continue;
+		}
+		if (maxDepth > 0 && depth + inserted->height() > maxDepth) {
+			continue;
+		}
+		return replaceAt(receiver, i, inserted);
+	}
+	return receiver;
+}
+
+template<typename T>
+inline std::shared_ptr<Expression<T>> TreeCrossover<T>::nodeAt(const std::shared_ptr<Expression<T>>& root, unsigned int index, unsigned int* depth) {
+	std::shared_ptr<Expression<T>> node = root;
+	unsigned int d = 0;
+	while (index > 0) {
+		--index; // skip the current node, the remaining index is relative to its first child
+		for (int i = 0; i < node->childCount(); ++i) {
+			std::shared_ptr<Expression<T>> child = node->child(i);
+			if (index < child->size()) {
+				node = child;
+				break;
+			}
+			index -= child->size();
+		}
+		++d;
+	}
+	if (depth) *depth = d;
+	return node;
+}
+
+template<typename T>
+inline std::shared_ptr<Expression<T>> TreeCrossover<T>::replaceAt(const std::shared_ptr<Expression<T>>& root, unsigned int index, const std::shared_ptr<Expression<T>>& replacement) {
+	if (index == 0) {
+		return replacement;
+	}
+	std::shared_ptr<Expression<T>> children[2];
+	unsigned int offset = 1;
+	for (int i = 0; i < root->childCount(); ++i) {
+		children[i] = root->child(i);
+		unsigned int size = children[i]->size();
+		if (index >= offset && index < offset + size) {
+			children[i] = replaceAt(children[i], index - offset, replacement);
+		}
+		offset += size;
+	}
+	return makeExpression<T>(root->type(), root->value(), children[0], children[1]);
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <random>
+#include "Expression.h"
+#include "Program.h"
+#include "GrammarDecoder.h"
+#include "Random.h"
+
+
+/**
+ * Applies random mutations to expression trees, with the same per-node probabilities as Expression::mutate:
+ * every node but the root is replaced by a new random sub-tree with probability treeMutationChance, and otherwise has its own operation,
+ * function, variable or constant replaced with probability mutationChance (nodes inside a replaced sub-tree are not considered)
+ * Instead of drawing random numbers at every node, the mutator samples the gaps between mutation events along the preorder indices of the nodes,
+ * and walks straight down to the affected nodes using the size of each sub-tree; unaffected sub-trees are shared with the original tree
+ */
+template<typename T>
+class TreeMutator {
+private:
+
+	const GrammarDecoder<T>* grammar;
+	Random::SkipSampler pointSampler;
+	Random::SkipSampler treeSampler;
+
+	/**
+	 * Preorder indices of the next node to be replaced by a new sub-tree, and of the next node to receive a point mutation
+	 */
+	uint64_t nextTree;
+	uint64_t nextPoint;
+
+public:
+
+	TreeMutator(double mutationChance = 0, double treeMutationChance = 0, const GrammarDecoder<T>* grammar = nullptr);
+
+	/**
+	 * Returns a mutated version of the given expression tree, which is left untouched
+	 */
+	std::shared_ptr<Expression<T>> mutate(const std::shared_ptr<Expression<T>>& expression, Random::Rng& rng);
+
+private:
+
+	std::shared_ptr<Expression<T>> mutateNode(const std::shared_ptr<Expression<T>>& node, uint64_t index, Random::Rng& rng);
+
+};
+
+
+
+template<typename T>
+inline TreeMutator<T>::TreeMutator(double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar) :
+			// probabilities are rounded the same way as in the MUTATION and TREE_MUTATION() macros
+			grammar(grammar), pointSampler(int(mutationChance * 10000) / 10000.0), treeSampler(int(treeMutationChance * 10000) / 10000.0) {
+}
+
+template<typename T>
+inline std::shared_ptr<Expression<T>> TreeMutator<T>::mutate(const std::shared_ptr<Expression<T>>& expression, Random::Rng& rng) {
+	// the root (index 0) never mutates
+	nextTree = 1 + treeSampler.next(rng);
+	nextPoint = 1 + pointSampler.next(rng);
+	return mutateNode(expression, 0, rng);
+}
+
+template<typename T>
+inline std::shared_ptr<Expression<T>> TreeMutator<T>::mutateNode(const std::shared_ptr<Expression<T>>& node, uint64_t index, Random::Rng& rng) {
+	uint64_t end = index + node->size();
+	if (nextTree >= end && nextPoint >= end) {
+		return node; // no mutation in this sub-tree
+	}
+
+	if (nextTree == index) {
+		// replace the whole sub-tree; as trials are independent, the next events can be sampled from the end of the sub-tree onwards
+		nextTree = end + treeSampler.next(rng);
+		if (nextPoint < end) {
+			nextPoint = end + pointSampler.next(rng);
+		}
+		return grammar->instantiateExpression(rng);
+	}
+
+	bool point = nextPoint == index;
+	if (point) {
+		nextPoint = index + 1 + pointSampler.next(rng);
+	}
+
+	std::shared_ptr<Expression<T>> children[2];
+	uint64_t childIndex = index + 1;
+	for (int i = 0; i < node->childCount(); ++i) {
+		std::shared_ptr<Expression<T>> child = node->child(i);
+		children[i] = mutateNode(child, childIndex, rng);
+		childIndex += child->size();
+	}
+
+	if (!point) {
+		return makeExpression<T>(node->type(), node->value(), children[0], children[1]);
+	}
+	switch (node->childCount()) {
+	case 0:
+		if (node->type() != ExpressionType::Constant) {
+			return grammar->instantiateVar(rng);
+		}
+		// either modify the value by a little bit (normal distrib), or pick a new constant altogether
+		if (Random::bounded(rng, 2) == 0) {
+			std::normal_distribution<T> n(0, 1);
+			return ConstantPtr(T, node->value() + n(rng));
+		}
+		return grammar->instantiateConstant(rng);
+	case 1:
+		return grammar->instantiateFunction(children[0], rng);
+	default:
+		return grammar->instantiateOperation(children[0], children[1], rng);
+	}
+}
@@ -1,16 +1,19 @@
 #pragma once
 
-#pragma once
-
 #include <cassert>
 #include <vector>
 #include <algorithm>
-#include <random>
+#include <unordered_map>
 #include "GrammarDecoder.h"
 #include "Fitness.h"
 #include "Expression.h"
+#include "Serialization.h"
+#include "DuplicatePolicy.h"
+#include "TreeMutator.h"
+#include "TreeCrossover.h"
+#include "Profiler.h"
 
-#define RAND abs(int(rng()))
+#define RAND(n) Random::bounded(rng, n)
 
 /**
  * Represents a single chromosome (i.e. individual) in the population
@@ -19,6 +22,7 @@ template<typename T>
 struct TreeChromosome {
 	std::shared_ptr<Expression<T>> expression = nullptr; // the expression represented by the chromosome
 	T fitness = INFINITY; // last fitness value computed for the chromosome
+	bool evaluated = false; // whether the fitness is up to date with the expression
 };
 
 /**
@@ -32,7 +36,7 @@ private:
 	/**
 	 * Random number generator to use for the population
 	 */
-	std::mt19937 rng;
+	Random::Rng rng;
 
 	/**
 	 * Gives the number of generations that the population has gone through
@@ -62,6 +66,21 @@ private:
 	 */
 	float treeMutationRate;
 
+	/**
+	 * Applies mutations to the children, with the probabilities above
+	 */
+	TreeMutator<T> mutator;
+
+	/**
+	 * Probability for a child to be created by crossover between two parents, rather than from a single parent
+	 */
+	float crossoverRate = 0;
+
+	/**
+	 * Recombines parents when creating children through crossover
+	 */
+	TreeCrossover<T> crossover;
+
 	/**
 	 * Proportion of the population that will be replaced with completely random expressions each generation
 	 */
@@ -82,28 +101,133 @@ private:
 	 */
 	std::vector<TreeChromosome<T>> chromosomes;
 
+	/**
+	 * How to deal with chromosomes whose expression is identical to that of another chromosome in the same generation
+	 */
+	DuplicatePolicy duplicatePolicy = DuplicatePolicy::Share;
+
+	/**
+	 * Index of the first chromosome found for each expression hash in the current generation
+	 */
+	std::unordered_map<uint64_t, size_t> firstCopies;
+
+	/**
+	 * Proportion of chromosomes whose expression was a copy of another one's in the last generation
+	 */
+	float duplicateRatio = 0;
+
+	/**
+	 * Mean number of nodes of the valid expressions of the last generation
+	 */
+	float meanSize = 0;
+
+	/**
+	 * Number of times the fitness function was computed since the population was created
+	 */
+	uint64_t evaluations = 0;
+
+	/**
+	 * Program that expressions are compiled into for evaluation, kept around to reuse its storage
+	 */
+	Program<T> program;
+
 public:
 
 	/**
 	 * Default constructor; initializes the population with random values for all of the genes
+	 * Populations built with the same seed but different streams draw from independent random sequences, e.g. to run several islands from one seed
 	 */
-	TreePopulation(unsigned int n, float replicationRate, int replicationBias, float mutationRate, float treeMutationRate, float randomRate, const Fitness<T>* fitnessFunction, const GrammarDecoder<T>* decoder, unsigned int seed = 0);
+	TreePopulation(unsigned int n, float replicationRate, int replicationBias, float mutationRate, float treeMutationRate, float randomRate, const Fitness<T>* fitnessFunction, const GrammarDecoder<T>* decoder, unsigned int seed = 0, unsigned int stream = 0);
 
 	/**
 	 * Run through a single generation of the population
 	 */
 	const TreeChromosome<T>* nextGeneration();
 
+	/**
+	 * Writes the full state of the population (generation counter, random number generator, expressions and fitness values) to a binary buffer
+	 */
+	void save(Serialization::BinaryWriter& writer) const;
+
+	/**
+	 * Restores the state of the population from a binary buffer created by save(); the population must have been constructed with the same size
+	 * Running nextGeneration() after a call to load() continues exactly as the saved population would have
+	 */
+	void load(Serialization::BinaryReader& reader);
+
+	/**
+	 * Returns the number of generations that the population has gone through
+	 */
+	inline int getGeneration() const { return generation; }
+
+	/**
+	 * Sets how to deal with chromosomes whose expression is identical to that of another chromosome in the same generation
+	 */
+	inline void setDuplicatePolicy(DuplicatePolicy policy) { duplicatePolicy = policy; }
+
+	/**
+	 * Makes the next generation compute the fitness of every chromosome again, e.g. after the collocation points of the fitness function were refined
+	 */
+	inline void invalidateFitness() {
+		for (TreeChromosome<T>& ch : chromosomes) {
+			ch.evaluated = false;
+		}
+	}
+
+	/**
+	 * Returns the proportion of chromosomes whose expression was a copy of another one's in the last generation
+	 */
+	inline float getDuplicateRatio() const { return duplicateRatio; }
+
+	/**
+	 * Returns the mean number of nodes of the valid expressions in the last generation
+	 */
+	inline float getMeanSize() const { return meanSize; }
+
+	/**
+	 * Returns the number of times the fitness function was computed since the population was created (or loaded)
+	 */
+	inline uint64_t getEvaluations() const { return evaluations; }
+
+	/**
+	 * Returns the chromosomes of the population: after a generation has run, the best ones replicated from it followed by their offspring
+	 */
+	inline const std::vector<TreeChromosome<T>>& getChromosomes() const { return chromosomes; }
+
+	/**
+	 * Sets the probability for a child to be created by sub-tree crossover between two parents (0 to disable), how sub-trees are picked,
+	 * and the maximum height of the resulting trees (0 for no limit); children created by crossover are then mutated like any other child
+	 */
+	inline void setCrossover(float rate, CrossoverMode mode = CrossoverMode::SizeFair, unsigned int maxDepth = 0) {
+		crossoverRate = rate;
+		crossover = TreeCrossover<T>(mode, maxDepth);
+	}
+
+private:
+
+	/**
+	 * Picks one of the first parentCount chromosomes, with a probability that decreases with its rank (see replicationBias)
+	 */
+	unsigned int selectParent(unsigned int parentCount);
+
+	/**
+	 * Computes the fitness of a chromosome by compiling its expression into a program
+	 */
+	void evaluate(TreeChromosome<T>& ch);
+
+public:
+
 };
 
 
 
 
 template<typename T>
-inline TreePopulation<T>::TreePopulation(unsigned int n, float replicationRate, int replicationBias, float mutationRate, float treeMutationRate, float randomRate, const Fitness<T>* fitnessFunction, const GrammarDecoder<T>* decoder, unsigned int seed) :
-			replicationRate(replicationRate), replicationBias(replicationBias), mutationRate(mutationRate), treeMutationRate(treeMutationRate), randomRate(randomRate), fitnessFunction(fitnessFunction), decoder(decoder) {
+inline TreePopulation<T>::TreePopulation(unsigned int n, float replicationRate, int replicationBias, float mutationRate, float treeMutationRate, float randomRate, const Fitness<T>* fitnessFunction, const GrammarDecoder<T>* decoder, unsigned int seed, unsigned int stream) :
+			replicationRate(replicationRate), replicationBias(replicationBias), mutationRate(mutationRate), treeMutationRate(treeMutationRate), mutator(mutationRate, treeMutationRate, decoder),
+			randomRate(randomRate), fitnessFunction(fitnessFunction), decoder(decoder) {
 
-	rng = std::mt19937(seed);
+	rng = Random::Rng(seed, stream);
 
 	assert(n >= 2);
 	assert(fitnessFunction);
@@ -123,56 +247,149 @@ inline const TreeChromosome<T>* TreePopulation<T>::nextGeneration() {
 
 	++generation;
 
-	// Compute each chromosome's fitness
-	for (auto& ch : chromosomes) {
-		if (ch.expression == nullptr || ch.expression->isConstant()) {
-			ch.fitness = INFINITY; // invalid expression, definitely don't want to keep this one
-		} else {
-			try {
-				//ch.expression = ch.expression->simplify();
-				ch.fitness = fitnessFunction->fitness(ch.expression);
-			} catch (...) { // handle invalid expressions with /0, log(-1), etc.
-				ch.fitness = INFINITY;
+	// Compute each chromosome's fitness; parents that were kept as-is from the previous generation are already up to date
+	firstCopies.clear();
+	size_t duplicates = 0;
+	for (size_t i = 0; i < chromosomes.size(); ++i) {
+		TreeChromosome<T>& ch = chromosomes[i];
+
+		// look for a chromosome with the same expression earlier in the generation; hashes are cached in the nodes, and copies mostly share their nodes
+		if (duplicatePolicy != DuplicatePolicy::Keep && ch.expression != nullptr) {
+			auto firstCopy = firstCopies.find(ch.expression->hash());
+			if (firstCopy == firstCopies.end()) {
+				firstCopies.emplace(ch.expression->hash(), i);
+			} else if (chromosomes[firstCopy->second].expression->equals(*ch.expression)) {
+				++duplicates;
+				if (duplicatePolicy == DuplicatePolicy::Share) {
+					ch.fitness = chromosomes[firstCopy->second].fitness;
+					ch.evaluated = true;
+					continue;
+				}
+				// replace the copy with a new random expression
+				ch.expression = MultiplicationPtr(T, ConstantPtr(T, 1), decoder->instantiateExpression(rng, 5));
+				ch.evaluated = false;
 			}
 		}
+
+		if (!ch.evaluated) {
+			evaluate(ch);
+		}
 	}
+	duplicateRatio = float(duplicates) / chromosomes.size();
+	size_t sizes = 0, valid = 0;
+	for (const TreeChromosome<T>& ch : chromosomes) {
+		if (ch.expression != nullptr) {
+			sizes += ch.expression->size();
+			++valid;
+		}
+	}
+	meanSize = valid > 0 ? float(sizes) / valid : 0;
 
 	// Sort by fitness - best chromosomes at the top, worst at the end
-	std::sort(chromosomes.begin(), chromosomes.end(), [&](const TreeChromosome<T>& a, const TreeChromosome<T>& b) -> bool {
-		return a.fitness < b.fitness;
-	});
+	{
+		PROFILE_SCOPE(Sort);
+		std::sort(chromosomes.begin(), chromosomes.end(), [&](const TreeChromosome<T>& a, const TreeChromosome<T>& b) -> bool {
+			return a.fitness < b.fitness;
+		});
+	}
 
 	// Genetic operations
+	PROFILE_SCOPE(Breed);
 
 	// Replication
 	unsigned int parentCount = int(replicationRate * chromosomes.size());
 	unsigned int randomCount = int(randomRate * chromosomes.size());
-	for (int i = parentCount; i < chromosomes.size() - randomCount; ++i) {
+	for (int i = parentCount; parentCount >= 1 && i < chromosomes.size() - randomCount; ++i) { // without any parent (replicationRate too small), the other chromosomes are left as they are
 		// replace chromosome with a parent selected at random
-		for (int j = 0; j < parentCount; ++j) {
-			if (RAND % replicationBias == 0 || j == parentCount-1) {
+		unsigned int j = selectParent(parentCount);
 
-				// replicate chromosome [j]
-				chromosomes[i].expression = chromosomes[j].expression;
+		// replicate chromosome [j]
+		chromosomes[i].expression = chromosomes[j].expression;
 
-				// mutations - note that we only mutate children, not parents
+		// or graft a sub-tree of a second parent onto it
+		if (crossoverRate > 0 && Random::uniform(rng) < crossoverRate) {
+			chromosomes[i].expression = crossover.cross(chromosomes[i].expression, chromosomes[selectParent(parentCount)].expression, rng);
+		}
 
-				// modify random nodes and subtrees in expression
-				chromosomes[i].expression = chromosomes[i].expression->mutate(rng, mutationRate, treeMutationRate, decoder, true);
+		// mutations - note that we only mutate children, not parents
 
-				break;
-			}
-		}
+		// modify random nodes and subtrees in expression
+		chromosomes[i].expression = mutator.mutate(chromosomes[i].expression, rng);
+
+		// children that came out unchanged are the very same tree as their parent, so they share its fitness
+		chromosomes[i].fitness = chromosomes[j].fitness;
+		chromosomes[i].evaluated = chromosomes[i].expression == chromosomes[j].expression && chromosomes[j].evaluated;
 	}
 
 	// Random individuals
 	for (int i = chromosomes.size() - randomCount; i < chromosomes.size(); ++i) {
 		chromosomes[i].expression = MultiplicationPtr(T, ConstantPtr(T, 1), decoder->instantiateExpression(rng, 5));
+		chromosomes[i].evaluated = false;
 	}
 
 	// Return top performer
 	return &chromosomes[0];
 }
 
+template<typename T>
+inline unsigned int TreePopulation<T>::selectParent(unsigned int parentCount) {
+	assert(parentCount >= 1);
+	for (unsigned int j = 0; ; ++j) {
+		if (RAND(replicationBias) == 0 || j == parentCount - 1) {
+			return j;
+		}
+	}
+}
+
+template<typename T>
+inline void TreePopulation<T>::evaluate(TreeChromosome<T>& ch) {
+	ch.evaluated = true;
+	if (ch.expression != nullptr) {
+		PROFILE_SCOPE(Decode);
+		program.compile(ch.expression);
+	}
+	if (ch.expression == nullptr || program.isConstant()) {
+		ch.fitness = INFINITY; // invalid expression, definitely don't want to keep this one
+		PROFILE_COUNT(Invalid, 1);
+	} else {
+		++evaluations;
+		PROFILE_COUNT(Evaluations, 1);
+		PROFILE_COUNT(Nodes, program.size());
+		try {
+			ch.fitness = fitnessFunction->fitness(program);
+		} catch (...) { // handle invalid expressions with /0, log(-1), etc.
+			ch.fitness = INFINITY;
+			PROFILE_COUNT(Exceptions, 1);
+		}
+	}
+}
+
+template<typename T>
+inline void TreePopulation<T>::save(Serialization::BinaryWriter& writer) const {
+	writer.write<int>(generation);
+	writer.writeRng(rng);
+	writer.write<unsigned int>((unsigned int)chromosomes.size());
+	for (auto& ch : chromosomes) {
+		writer.write<T>(ch.fitness);
+		writer.write<bool>(ch.evaluated); // so that resumed runs don't evaluate restored chromosomes again
+		Serialization::writeExpression<T>(writer, ch.expression);
+	}
+}
+
+template<typename T>
+inline void TreePopulation<T>::load(Serialization::BinaryReader& reader) {
+	generation = reader.read<int>();
+	reader.readRng(rng);
+	unsigned int n = reader.read<unsigned int>();
+	if (n != chromosomes.size()) {
+		throw "Population checkpoint does not match the population's parameters";
+	}
+	for (auto& ch : chromosomes) {
+		ch.fitness = reader.read<T>();
+		ch.evaluated = reader.read<bool>();
+		ch.expression = Serialization::readExpression<T>(reader);
+	}
+}
+
 
 #undef RAND
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Expression.h"
+#include "Build.h"
 #include "Multiplication.h"
 
 template<typename T>
@@ -9,7 +10,7 @@ private:
 	ExpressionPtr<T> a;
 public:
 
-	Sine(ExpressionPtr<T> a) : a(a) {}
+	Sine(ExpressionPtr<T> a) : Expression<T>(ExpressionType::Sine, 0, a.get()), a(a) {}
 
 	T evaluate(T x, T y) const override;
 
@@ -23,7 +24,15 @@ public:
 
 	bool isConstant() const override { return a->isConstant(); }
 
-	ExpressionPtr<T> mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+	ExpressionPtr<T> mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+
+	static const ExpressionType Type = ExpressionType::Sine;
+
+	ExpressionType type() const override { return Type; }
+
+	int childCount() const override { return 1; }
+
+	ExpressionPtr<T> child(int i) const override { return a; }
 
 };
 #define SinePtr(T, a) ExpressionPtr<T>(new Sine<T>(a))
@@ -36,7 +45,7 @@ private:
 	ExpressionPtr<T> a;
 public:
 
-	Cosine(ExpressionPtr<T> a) : a(a) {}
+	Cosine(ExpressionPtr<T> a) : Expression<T>(ExpressionType::Cosine, 0, a.get()), a(a) {}
 
 	T evaluate(T x, T y) const override;
 
@@ -50,7 +59,15 @@ public:
 
 	bool isConstant() const override { return a->isConstant(); }
 
-	ExpressionPtr<T> mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+	ExpressionPtr<T> mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+
+	static const ExpressionType Type = ExpressionType::Cosine;
+
+	ExpressionType type() const override { return Type; }
+
+	int childCount() const override { return 1; }
+
+	ExpressionPtr<T> child(int i) const override { return a; }
 
 };
 #define CosinePtr(T, a) ExpressionPtr<T>(new Cosine<T>(a))
@@ -68,7 +85,7 @@ inline T Sine<T>::evaluate(T x, T y) const {
 template<typename T>
 inline ExpressionPtr<T> Sine<T>::derivative(int dimension) const {
 	// sin'(a) = a' cos(a)
-	return MultiplicationPtr(T, a->derivative(dimension), CosinePtr(T, a));
+	return Build::multiply(a->derivative(dimension), CosinePtr(T, a));
 }
 
 template<typename T>
@@ -80,12 +97,15 @@ inline ExpressionPtr<T> Sine<T>::simplify() const {
 }
 
 template<typename T>
-inline ExpressionPtr<T> Sine<T>::mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
+inline ExpressionPtr<T> Sine<T>::mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
 	TREE_MUTATION();
 	auto newA = a->mutate(rng, mutationChance, treeMutationChance, grammar, false);
 	if (MUTATION) {
 		return grammar->instantiateFunction(newA, rng);
 	}
+	if (newA == a) {
+		return this->self(); // nothing changed, keep sharing the same node
+	}
 	return SinePtr(T, newA);
 }
 
@@ -97,8 +117,8 @@ inline T Cosine<T>::evaluate(T x, T y) const {
 template<typename T>
 inline ExpressionPtr<T> Cosine<T>::derivative(int dimension) const {
 	// cos'(a) = -a' sin(a)
-	auto minusAPrime = MultiplicationPtr(T, ConstantPtr(T, -1), a->derivative(dimension));
-	return MultiplicationPtr(T, minusAPrime, SinePtr(T, a));
+	auto minusAPrime = Build::multiply(ConstantPtr(T, -1), a->derivative(dimension));
+	return Build::multiply(minusAPrime, SinePtr(T, a));
 }
 
 template<typename T>
@@ -110,11 +130,14 @@ inline ExpressionPtr<T> Cosine<T>::simplify() const {
 }
 
 template<typename T>
-inline ExpressionPtr<T> Cosine<T>::mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
+inline ExpressionPtr<T> Cosine<T>::mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
 	TREE_MUTATION();
 	auto newA = a->mutate(rng, mutationChance, treeMutationChance, grammar, false);
 	if (MUTATION) {
 		return grammar->instantiateFunction(newA, rng);
 	}
+	if (newA == a) {
+		return this->self(); // nothing changed, keep sharing the same node
+	}
 	return CosinePtr(T, newA);
 }
@@ -8,6 +8,8 @@ template<typename T>
 class VarX : public Expression<T> {
 public:
 
+	VarX() : Expression<T>(ExpressionType::VarX) {}
+
 	inline T evaluate(T x, T y) const override { return x; }
 
 	inline ExpressionPtr<T> derivative(int dimension) const override { return ExpressionPtr<T>(new Constant<T>(dimension == 0)); }
@@ -20,7 +22,11 @@ public:
 
 	bool isConstant() const override { return false; }
 
-	ExpressionPtr<T> mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+	ExpressionPtr<T> mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+
+	static const ExpressionType Type = ExpressionType::VarX;
+
+	ExpressionType type() const override { return Type; }
 
 };
 #define VarXPtr(T) ExpressionPtr<T>(new VarX<T>())
@@ -33,6 +39,8 @@ template<typename T>
 class VarY : public Expression<T> {
 public:
 
+	VarY() : Expression<T>(ExpressionType::VarY) {}
+
 	inline T evaluate(T x, T y) const override { return y; }
 
 	inline ExpressionPtr<T> derivative(int dimension) const override { return ExpressionPtr<T>(new Constant<T>(dimension == 1)); }
@@ -45,7 +53,11 @@ public:
 
 	bool isConstant() const override { return false; }
 
-	ExpressionPtr<T> mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+	ExpressionPtr<T> mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const override;
+
+	static const ExpressionType Type = ExpressionType::VarY;
+
+	ExpressionType type() const override { return Type; }
 
 };
 #define VarYPtr(T) ExpressionPtr<T>(new VarY<T>())
@@ -53,19 +65,19 @@ public:
 #define VarYPtrd VarYPtr(double)
 
 template<typename T>
-inline ExpressionPtr<T> VarX<T>::mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
+inline ExpressionPtr<T> VarX<T>::mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
 	TREE_MUTATION();
 	if (MUTATION) {
 		return grammar->instantiateVar(rng);
 	}
-	return VarXPtr(T);
+	return this->self();
 }
 
 template<typename T>
-inline ExpressionPtr<T> VarY<T>::mutate(std::mt19937& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
+inline ExpressionPtr<T> VarY<T>::mutate(Random::Rng& rng, double mutationChance, double treeMutationChance, const GrammarDecoder<T>* grammar, bool first) const {
 	TREE_MUTATION();
 	if (MUTATION) {
 		return grammar->instantiateVar(rng);
 	}
-	return VarYPtr(T);
+	return this->self();
 }
@@ -0,0 +1,395 @@
+// Aggregates the results of many runs (json files, or binary run logs when they exist) into per-problem statistics
+// Usage: ./aggregate [--dir=results] [--output=summary.json|summary.csv] [--points=100] [--threads=0]
+// For each problem: success rate, percentiles of the number of generations and of the wall time, and the convergence curve (best fitness against generation) over all seeds
+// A .csv output gets the per-problem summary, and the convergence curves in <output>_curves.csv next to it; any other output is written as json
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <dirent.h>
+#include "GrammarDecoder.h"
+#include "RunLog.h"
+#include "JsonReader.h"
+#include "JsonWriter.h"
+#include "Config.h"
+
+
+
+/**
+ * Outcome of a single run, along with the history of its best fitness
+ */
+struct RunSummary {
+	std::string problem;
+	int seed = 0;
+	bool solved = false;
+	int generation = 0; // last generation of the run
+	int maxGeneration = 0;
+	double seconds = NAN; // wall time of the run, unknown for json files written before it was recorded
+	std::vector<std::pair<int, double>> improvements; // generation and best fitness each time the best fitness improved
+};
+
+
+/**
+ * Collects the summary of a run replayed from a binary log
+ */
+class SummaryListener : public RunListener<double> {
+public:
+	RunSummary summary;
+
+	void runStarted(const RunState<double>& state) override {
+		summary.problem = state.name;
+		summary.seed = state.seed;
+		summary.maxGeneration = state.params.generations;
+	}
+
+	void generationDone(const RunState<double>& state) override {
+		summary.improvements.emplace_back(state.generation, state.fitness);
+	}
+
+	void runFinished(const RunState<double>& state) override {
+		summary.solved = state.stopReason == "solved";
+		summary.generation = state.generation;
+		summary.seconds = state.stopReason == "interrupted" ? NAN : state.seconds;
+	}
+};
+
+
+/**
+ * Reads the summary of a run from a json file written by JsonRunLog
+ * Files written before the stop reason, last generation and wall time were recorded are supported: the run is then considered solved if its best fitness is below the threshold
+ */
+RunSummary readJson(const std::vector<char>& data) {
+	JsonValue run = JsonReader::parse(data);
+	RunSummary summary;
+	summary.problem = run["problem"].asString();
+	summary.seed = int(run["seed"].asNumber());
+	summary.maxGeneration = int(run["maxGeneration"].asNumber());
+	for (auto& generation : run["generations"].elements) {
+		// non-finite fitness values are written as null
+		summary.improvements.emplace_back(int(generation["generation"].asNumber()), generation["fitness"].asNumber(INFINITY));
+	}
+	double best = summary.improvements.empty() ? INFINITY : summary.improvements.back().second;
+	if (run["stopReason"].isNull()) {
+		summary.solved = best < 1e-7;
+		summary.generation = summary.solved ? summary.improvements.back().first : summary.maxGeneration;
+	} else {
+		summary.solved = run["stopReason"].asString() == "solved";
+		summary.generation = int(run["lastGeneration"].asNumber(summary.maxGeneration));
+		summary.seconds = run["seconds"].asNumber(NAN);
+	}
+	return summary;
+}
+
+
+/**
+ * Returns the files to aggregate in a directory: binary logs, and json files of runs that don't have a binary log (which is faster to read)
+ */
+std::vector<std::string> listRunFiles(const std::string& directory) {
+	std::vector<std::string> logs, jsons;
+	DIR* dir = opendir(directory.c_str());
+	if (!dir) {
+		fprintf(stderr, "Could not open directory %s\n", directory.c_str());
+		return logs;
+	}
+	auto endsWith = [](const std::string& s, const std::string& suffix) {
+		return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+	};
+	while (dirent* entry = readdir(dir)) {
+		std::string name = entry->d_name;
+		if (endsWith(name, ".runlog")) logs.push_back(name.substr(0, name.size() - 7));
+		else if (endsWith(name, ".json")) jsons.push_back(name.substr(0, name.size() - 5));
+	}
+	closedir(dir);
+	std::sort(logs.begin(), logs.end());
+	std::sort(jsons.begin(), jsons.end());
+
+	std::vector<std::string> files;
+	for (auto& log : logs) files.push_back(directory + "/" + log + ".runlog");
+	for (auto& json : jsons) {
+		if (!std::binary_search(logs.begin(), logs.end(), json)) files.push_back(directory + "/" + json + ".json");
+	}
+	return files;
+}
+
+
+/**
+ * Reads the summaries of all given files, spread over several threads; files that can't be read are reported and skipped
+ */
+std::vector<RunSummary> readRuns(const std::vector<std::string>& files, unsigned int threadCount) {
+	std::vector<RunSummary> runs(files.size());
+	std::vector<char> valid(files.size(), false); // not a vector<bool>, whose elements can't be written from different threads
+	std::atomic<size_t> next(0);
+	std::mutex errors;
+	auto work = [&]() {
+		std::vector<char> data;
+		for (size_t i = next++; i < files.size(); i = next++) {
+			const std::string& file = files[i];
+			try {
+				if (!FileWriter::ReadBinary(file, data)) {
+					throw "Could not open file";
+				}
+				if (file.size() > 7 && file.compare(file.size() - 7, 7, ".runlog") == 0) {
+					SummaryListener listener;
+					replayRunLog<double>(data, listener);
+					runs[i] = std::move(listener.summary);
+				} else {
+					runs[i] = readJson(data);
+				}
+				valid[i] = !runs[i].problem.empty();
+			} catch (const char* e) {
+				std::lock_guard<std::mutex> lock(errors);
+				fprintf(stderr, "%s: %s\n", file.c_str(), e);
+			}
+		}
+	};
+	std::vector<std::thread> threads;
+	for (unsigned int t = 1; t < threadCount; ++t) threads.emplace_back(work);
+	work();
+	for (auto& thread : threads) thread.join();
+
+	std::vector<RunSummary> read;
+	for (size_t i = 0; i < runs.size(); ++i) {
+		if (valid[i]) read.push_back(std::move(runs[i]));
+	}
+	return read;
+}
+
+
+/**
+ * Returns the p-th percentile (0 to 1) of sorted values, interpolating linearly between the closest ranks
+ */
+double percentile(const std::vector<double>& sorted, double p) {
+	if (sorted.empty()) return NAN;
+	double rank = p * (sorted.size() - 1);
+	size_t below = size_t(rank);
+	if (below + 1 >= sorted.size() || rank == below || sorted[below] == sorted[below + 1]) return sorted[below]; // also avoids inf - inf between infinite values
+	return sorted[below] + (rank - below) * (sorted[below + 1] - sorted[below]);
+}
+
+static const double Percentiles[] = { 0.1, 0.25, 0.5, 0.75, 0.9 };
+static const char* const PercentileNames[] = { "p10", "p25", "median", "p75", "p90" };
+static const int PercentileCount = 5;
+
+
+/**
+ * Best fitness over the runs of a problem at a given generation
+ */
+struct CurvePoint {
+	int generation;
+	double medianFitness; // median of the best fitness of all runs (infinite while fewer than half the runs have found a valid expression)
+	double geometricMeanFitness; // geometric mean of the best fitness of the runs that have found a valid expression
+	double solvedFraction; // fraction of the runs that have solved the problem by then
+};
+
+
+/**
+ * Aggregated statistics of all runs of a problem
+ */
+struct ProblemSummary {
+	std::string problem;
+	int runs = 0;
+	int solved = 0;
+	std::vector<double> generations; // sorted last generation of every run
+	std::vector<double> solvedGenerations; // sorted last generation of the runs that solved the problem
+	std::vector<double> seconds; // sorted wall time of every run whose wall time is known
+	std::vector<CurvePoint> curve;
+};
+
+
+/**
+ * Aggregates the runs of a problem; the convergence curve is sampled at the given number of generations, evenly spread up to the largest generation budget of the runs
+ */
+ProblemSummary summarize(const std::string& problem, const std::vector<const RunSummary*>& runs, int points) {
+	ProblemSummary s;
+	s.problem = problem;
+	s.runs = int(runs.size());
+	int maxGeneration = 1;
+	for (auto run : runs) {
+		s.solved += run->solved;
+		s.generations.push_back(run->generation);
+		if (run->solved) s.solvedGenerations.push_back(run->generation);
+		if (!std::isnan(run->seconds)) s.seconds.push_back(run->seconds);
+		maxGeneration = std::max(maxGeneration, std::max(run->maxGeneration, run->generation));
+	}
+	std::sort(s.generations.begin(), s.generations.end());
+	std::sort(s.solvedGenerations.begin(), s.solvedGenerations.end());
+	std::sort(s.seconds.begin(), s.seconds.end());
+
+	// each run's best fitness is a step function of the generation, which keeps its last value after the run has stopped
+	std::vector<size_t> positions(runs.size(), 0);
+	std::vector<double> fitness(runs.size(), INFINITY);
+	std::vector<double> sorted;
+	int previous = 0;
+	for (int i = 0; i < points; ++i) {
+		int generation = points > 1 ? 1 + int(int64_t(maxGeneration - 1) * i / (points - 1)) : maxGeneration;
+		if (generation == previous) continue;
+		previous = generation;
+		CurvePoint point;
+		point.generation = generation;
+		double logSum = 0;
+		int finite = 0, solved = 0;
+		for (size_t r = 0; r < runs.size(); ++r) {
+			auto& improvements = runs[r]->improvements;
+			while (positions[r] < improvements.size() && improvements[positions[r]].first <= generation) {
+				fitness[r] = improvements[positions[r]++].second;
+			}
+			if (std::isfinite(fitness[r])) {
+				logSum += log10(std::max(fitness[r], 1e-300));
+				++finite;
+			}
+			solved += runs[r]->solved && runs[r]->generation <= generation;
+		}
+		sorted = fitness;
+		std::sort(sorted.begin(), sorted.end());
+		point.medianFitness = percentile(sorted, 0.5);
+		point.geometricMeanFitness = finite > 0 ? pow(10, logSum / finite) : INFINITY;
+		point.solvedFraction = double(solved) / runs.size();
+		s.curve.push_back(point);
+	}
+	return s;
+}
+
+
+void writeJson(const std::string& filename, const std::vector<ProblemSummary>& summaries) {
+	JsonWriter json;
+	json.open(filename);
+	json.beginObject();
+	json.key("problems").beginArray();
+	for (auto& s : summaries) {
+		json.beginObject();
+		json.key("problem").value(s.problem);
+		json.key("runs").value(s.runs);
+		json.key("solved").value(s.solved);
+		json.key("successRate").value(double(s.solved) / s.runs);
+		auto percentiles = [&](const char* name, const std::vector<double>& values) {
+			json.key(name).beginObject();
+			for (int i = 0; i < PercentileCount; ++i) {
+				json.key(PercentileNames[i]).value(percentile(values, Percentiles[i]));
+			}
+			json.endObject();
+		};
+		percentiles("generations", s.generations);
+		percentiles("generationsToSolve", s.solvedGenerations);
+		percentiles("seconds", s.seconds);
+		json.key("curve").beginArray();
+		for (auto& point : s.curve) {
+			json.beginObject();
+			json.key("generation").value(point.generation);
+			json.key("medianFitness").value(point.medianFitness);
+			json.key("geometricMeanFitness").value(point.geometricMeanFitness);
+			json.key("solvedFraction").value(point.solvedFraction);
+			json.endObject();
+		}
+		json.endArray();
+		json.endObject();
+	}
+	json.endArray();
+	json.endObject();
+	json.close();
+}
+
+
+void writeCsv(const std::string& filename, const std::vector<ProblemSummary>& summaries) {
+	std::string summary = "problem,runs,solved,successRate";
+	for (const char* values : { "generations", "generationsToSolve", "seconds" }) {
+		for (int i = 0; i < PercentileCount; ++i) summary += std::string(",") + values + "_" + PercentileNames[i];
+	}
+	summary += "\n";
+	std::string curves = "problem,generation,medianFitness,geometricMeanFitness,solvedFraction\n";
+	char buffer[256];
+	for (auto& s : summaries) {
+		snprintf(buffer, sizeof(buffer), "%s,%d,%d,%.6g", s.problem.c_str(), s.runs, s.solved, double(s.solved) / s.runs);
+		summary += buffer;
+		for (auto values : { &s.generations, &s.solvedGenerations, &s.seconds }) {
+			for (int i = 0; i < PercentileCount; ++i) {
+				double v = percentile(*values, Percentiles[i]);
+				if (std::isnan(v)) summary += ",";
+				else {
+					snprintf(buffer, sizeof(buffer), ",%.6g", v);
+					summary += buffer;
+				}
+			}
+		}
+		summary += "\n";
+		for (auto& point : s.curve) {
+			snprintf(buffer, sizeof(buffer), "%s,%d,%.6g,%.6g,%.6g\n", s.problem.c_str(), point.generation, point.medianFitness, point.geometricMeanFitness, point.solvedFraction);
+			curves += buffer;
+		}
+	}
+	FileWriter::Write(filename, summary);
+	FileWriter::Write(filename.substr(0, filename.size() - 4) + "_curves.csv", curves);
+}
+
+
+
+int main(int argc, char** argv) {
+
+	Config config;
+	unsigned int threads;
+	int points;
+	try {
+		config.parseArguments(argc, argv);
+		for (auto& key : config.unknownKeys({ "dir", "output", "points", "threads" })) {
+			fprintf(stderr, "Unknown setting: %s\n", key.c_str());
+			throw "Unknown setting";
+		}
+		threads = (unsigned int)config.getInt("threads", 0, 0);
+		points = config.getInt("points", 100, 1);
+	} catch (const char* e) {
+		fprintf(stderr, "%s\n", e);
+		return 1;
+	}
+	if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::string> files = listRunFiles(config.get("dir", "results"));
+	std::vector<RunSummary> runs = readRuns(files, threads);
+	if (runs.empty()) {
+		fprintf(stderr, "No runs found\n");
+		return 1;
+	}
+
+	// group runs by problem, in alphabetical order
+	std::map<std::string, std::vector<const RunSummary*>> problems;
+	for (auto& run : runs) problems[run.problem].push_back(&run);
+	std::vector<ProblemSummary> summaries;
+	for (auto& problem : problems) {
+		summaries.push_back(summarize(problem.first, problem.second, points));
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("%-16s %6s %9s %22s %22s %22s\n", "problem", "runs", "solved", "generations p10/50/90", "to solve p10/50/90", "seconds p10/50/90");
+	for (auto& s : summaries) {
+		auto triple = [](const std::vector<double>& v) {
+			char buffer[64];
+			if (v.empty()) return std::string("-");
+			snprintf(buffer, sizeof(buffer), "%.0f/%.0f/%.0f", percentile(v, 0.1), percentile(v, 0.5), percentile(v, 0.9));
+			return std::string(buffer);
+		};
+		auto times = [](const std::vector<double>& v) {
+			char buffer[64];
+			if (v.empty()) return std::string("-");
+			snprintf(buffer, sizeof(buffer), "%.1f/%.1f/%.1f", percentile(v, 0.1), percentile(v, 0.5), percentile(v, 0.9));
+			return std::string(buffer);
+		};
+		printf("%-16s %6d %8.1f%% %22s %22s %22s\n", s.problem.c_str(), s.runs, 100.0 * s.solved / s.runs, triple(s.generations).c_str(), triple(s.solvedGenerations).c_str(), times(s.seconds).c_str());
+	}
+	printf("\n%d runs read from %d files in %.3f s\n", int(runs.size()), int(files.size()), seconds);
+
+	if (config.has("output")) {
+		std::string output = config.get("output", "");
+		if (output.size() > 4 && output.compare(output.size() - 4, 4, ".csv") == 0) writeCsv(output, summaries);
+		else writeJson(output, summaries);
+		printf("Summary written to %s\n", output.c_str());
+	}
+	return 0;
+}
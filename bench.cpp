@@ -0,0 +1,248 @@
+// End-to-end benchmark of the solver on all built-in problems, with fixed seeds and a fixed budget
+// Usage: make bench, or ./benchmark [--output=bench.json] [--baseline=previous.json] [--tolerance=0.1] [--problems=ODE,PDE3] [--runs=1] [--<run parameter>=value]
+// Runs are executed one after the other on a single thread, so that their timings don't interfere with each other
+
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <chrono>
+#if defined(__unix__) || defined(__APPLE__)
+	#include <sys/resource.h>
+#endif
+#include "Problems.h"
+#include "Solver.h"
+#include "Config.h"
+#include "JsonWriter.h"
+#include "JsonReader.h"
+
+
+
+/**
+ * Outcome of a single benchmark run
+ */
+struct BenchResult {
+	std::string problem;
+	int seed;
+	bool solved;
+	int generations;
+	double seconds;
+	uint64_t evaluations;
+	uint64_t points; // number of points the fitness function was evaluated at
+	double fitness;
+};
+
+
+/**
+ * Parameters of the benchmark runs, which only change when the benchmark itself changes, so that results stay comparable with earlier baselines
+ */
+RunParameters benchParameters() {
+	RunParameters params;
+	params.useTrees = true;
+	params.populationSize = 1000;
+	params.generations = 300;
+	params.replicationRate = 0.05f;
+	params.mutationRate = 0.1f;
+	params.randomRate = 0.1f;
+	params.replicationBias = 25;
+	params.treeMutationRate = 0.1f;
+	params.crossoverRate = 0.3f;
+	params.crossoverMode = CrossoverMode::SizeFair;
+	params.duplicatePolicy = DuplicatePolicy::Share;
+	params.checkpointInterval = 0;
+	params.verbose = false;
+	params.json = false;
+	params.binaryLog = false;
+	params.monitor = false;
+	return params;
+}
+
+
+/**
+ * Returns the peak resident set size of the process in kilobytes, or 0 if unknown
+ */
+long peakRssKb() {
+#if defined(__unix__)
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss; // kilobytes on Linux
+#elif defined(__APPLE__)
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+	return 0;
+#endif
+}
+
+
+/**
+ * Writes the results and their summary to a json file
+ */
+void writeResults(const std::string& filename, const RunParameters& params, const std::vector<BenchResult>& results, double evaluationsPerSecond, double pointsPerSecond, double successRate, long peakRss) {
+	JsonWriter json;
+	json.open(filename);
+	json.beginObject();
+	json.key("time").value(int64_t(time(nullptr)));
+	json.key("populationSize").value(params.populationSize);
+	json.key("maxGeneration").value(params.generations);
+	json.key("runs").beginArray();
+	for (auto& r : results) {
+		json.beginObject();
+		json.key("problem").value(r.problem);
+		json.key("seed").value(r.seed);
+		json.key("solved").value(r.solved);
+		json.key("generations").value(r.generations);
+		json.key("seconds").value(r.seconds);
+		json.key("evaluations").value(r.evaluations);
+		json.key("evaluationsPerSecond").value(r.evaluations / r.seconds);
+		json.key("pointsPerSecond").value(r.points / r.seconds);
+		json.key("fitness").value(r.fitness);
+		json.endObject();
+	}
+	json.endArray();
+	json.key("summary").beginObject();
+	json.key("successRate").value(successRate);
+	json.key("evaluationsPerSecond").value(evaluationsPerSecond);
+	json.key("pointsPerSecond").value(pointsPerSecond);
+	json.key("peakRssKb").value(int64_t(peakRss));
+	json.endObject();
+	json.endObject();
+	json.close();
+}
+
+
+/**
+ * Compares the results with those of a baseline file written by an earlier benchmark; returns false if the throughput regressed by more than the tolerance
+ */
+bool compareWithBaseline(const std::string& filename, const std::vector<BenchResult>& results, double evaluationsPerSecond, double successRate, long peakRss, double tolerance) {
+	std::vector<char> data;
+	if (!FileWriter::ReadBinary(filename, data)) {
+		fprintf(stderr, "Could not open baseline %s\n", filename.c_str());
+		return false;
+	}
+	JsonValue baseline = JsonReader::parse(data);
+
+	printf("\nComparison with %s:\n", filename.c_str());
+	printf("%-12s %6s %14s %14s %9s %s\n", "problem", "seed", "evals/s", "baseline", "change", "");
+	for (auto& r : results) {
+		const JsonValue* b = nullptr;
+		for (auto& run : baseline["runs"].elements) {
+			if (run["problem"].asString() == r.problem && int(run["seed"].asNumber()) == r.seed) b = &run;
+		}
+		if (!b) {
+			printf("%-12s %6d %14.0f %14s\n", r.problem.c_str(), r.seed, r.evaluations / r.seconds, "-");
+			continue;
+		}
+		double before = (*b)["evaluationsPerSecond"].asNumber();
+		double after = r.evaluations / r.seconds;
+		// with the same seed and budget, a run only takes a different path if the search itself changed
+		std::string note;
+		if ((*b)["solved"].boolean != r.solved) note = r.solved ? "now solved" : "no longer solved";
+		else if (int((*b)["generations"].asNumber()) != r.generations) note = "generations " + std::to_string(int((*b)["generations"].asNumber())) + " -> " + std::to_string(r.generations);
+		printf("%-12s %6d %14.0f %14.0f %+8.1f%% %s\n", r.problem.c_str(), r.seed, after, before, 100 * (after / before - 1), note.c_str());
+	}
+
+	double before = baseline["summary"]["evaluationsPerSecond"].asNumber();
+	double change = evaluationsPerSecond / before - 1;
+	printf("%-12s %6s %14.0f %14.0f %+8.1f%%\n", "total", "", evaluationsPerSecond, before, 100 * change);
+	printf("success rate %.1f%% (baseline %.1f%%), peak RSS %ld KB (baseline %ld KB)\n", 100 * successRate, 100 * baseline["summary"]["successRate"].asNumber(), peakRss, long(baseline["summary"]["peakRssKb"].asNumber()));
+	if (change < -tolerance) {
+		printf("Throughput regressed by more than %.0f%%\n", 100 * tolerance);
+		return false;
+	}
+	return true;
+}
+
+
+
+int main(int argc, char** argv) {
+
+	Config config;
+	int runs;
+	double tolerance;
+	std::vector<std::string> knownKeys = RunParameters::keys();
+	knownKeys.insert(knownKeys.end(), { "problems", "runs", "output", "baseline", "tolerance" });
+	RunParameters params = benchParameters();
+	try {
+		config.parseArguments(argc, argv);
+		for (auto& key : config.unknownKeys(knownKeys)) {
+			fprintf(stderr, "Unknown setting: %s\n", key.c_str());
+			throw "Unknown setting";
+		}
+		for (auto& key : RunParameters::keys()) {
+			if (config.has(key)) params.set(key, config.get(key, ""));
+		}
+		runs = config.getInt("runs", 1, 1);
+		tolerance = Config::parseNumber("tolerance", config.get("tolerance", "0.1"), 0, HUGE_VAL);
+	} catch (const char* e) {
+		fprintf(stderr, "%s\n", e);
+		return 1;
+	}
+	if (!config.has("problems")) {
+		config.set("problems", "ODE,NLODE,PDE,Heat,Heat[-pi]");
+	}
+
+	auto decoder1d = createDecoder(false);
+	auto decoder2d = createDecoder(true);
+	std::vector<Problem> problems = getProblems();
+
+	printf("%-12s %6s %7s %11s %10s %14s %14s %12s\n", "problem", "seed", "solved", "generations", "seconds", "evals/s", "points/s", "fitness");
+	std::vector<BenchResult> results;
+	uint64_t totalEvaluations = 0, totalPoints = 0;
+	double totalSeconds = 0;
+	int solved = 0;
+	for (auto& selected : config.values("problems")) {
+		bool found = false;
+		for (auto& problem : problems) {
+			if (!isSelected(problem, selected)) continue;
+			found = true;
+			for (int seed = problem.seed; seed < problem.seed + runs; ++seed) {
+				RunListeners listeners; // nothing is logged, only the final state of the run is used
+				auto start = std::chrono::steady_clock::now();
+				RunState<double> state = solve(problem.name, problem.fitness, problem.twoDimensional ? decoder2d : decoder1d, seed, params, listeners);
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+				BenchResult r = { problem.name, seed, state.stopReason == "solved", state.generation, seconds, state.evaluations, state.evaluations * problem.fitness.cost(), state.fitness };
+				results.push_back(r);
+				totalEvaluations += r.evaluations;
+				totalPoints += r.points;
+				totalSeconds += r.seconds;
+				solved += r.solved;
+				printf("%-12s %6d %7s %11d %10.3f %14.0f %14.0f %12.4g\n", r.problem.c_str(), r.seed, r.solved ? "yes" : "no", r.generations, r.seconds, r.evaluations / r.seconds, r.points / r.seconds, r.fitness);
+				fflush(stdout);
+			}
+		}
+		if (!found) {
+			fprintf(stderr, "Unknown problem: %s\n", selected.c_str());
+			return 1;
+		}
+	}
+	delete decoder1d;
+	delete decoder2d;
+	if (results.empty()) {
+		return 1;
+	}
+
+	double evaluationsPerSecond = totalEvaluations / totalSeconds;
+	double pointsPerSecond = totalPoints / totalSeconds;
+	double successRate = double(solved) / results.size();
+	long peakRss = peakRssKb();
+	printf("\n%d/%d solved, %.3f s, %.0f evaluations/s, %.0f points/s, peak RSS %ld KB\n", solved, int(results.size()), totalSeconds, evaluationsPerSecond, pointsPerSecond, peakRss);
+
+	std::string output = config.get("output", "bench.json");
+	writeResults(output, params, results, evaluationsPerSecond, pointsPerSecond, successRate, peakRss);
+	printf("Results written to %s\n", output.c_str());
+
+	if (config.has("baseline")) {
+		try {
+			if (!compareWithBaseline(config.get("baseline", ""), results, evaluationsPerSecond, successRate, peakRss, tolerance)) {
+				return 2;
+			}
+		} catch (const char* e) {
+			fprintf(stderr, "Invalid baseline: %s\n", e);
+			return 1;
+		}
+	}
+	return 0;
+}
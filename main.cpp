@@ -1,6 +1,8 @@
 ﻿
 
 
+// The settings below are the defaults for every run; they can all be overridden at runtime, see readme.md
+
 //#define FULLY_RANDOM // whether to completely randomise the population every single generation
 //#define SINGLE_EXAMPLE_ODE 3 // whether to run one example ODE problem
 #define EXAMPLE_ODES // whether to run example ODE problems
@@ -10,14 +12,28 @@
 #define HEAT_NO_PI // whether to run the modified heat equation problem (with L=pi instead of L=1, eliminating pi from the solution)
 //#define VERBOSE // whether to output console messages while training each time a new best fit is found amongst the population
 #define JSON // whether to output a json file for each executed run
+//#define BINARY_LOG // whether to output a compact binary log for each executed run, which can be converted to json with runlog2json
+#define MONITOR // whether to publish the progress of each run to shared memory, where the monitor tool can display it live
+//#define FAST_MATH // whether to screen candidates with fast approximations of exp, log, sin, cos and pow, only computing exact fitness values for the best ones
 #define TREE_CHROMOSOMES // whether to use a TreePopulation instead of the grammar-based population
 #define MULTI_RUN // whether to run each problem 50 times instead of once, with a random seed each time
+//#define PROFILE // whether to time the phases of each generation and count evaluations, invalid candidates and exceptions, reported to the console and json files (compile-time only)
+//#define PERF_COUNTERS // whether to also count cycles, instructions, cache misses and branch misses in each phase with Linux perf_event_open, requires PROFILE (compile-time only)
+//#define RNG_PCG32 // whether to use the PCG32 random number generator instead of xoshiro256++ (compile-time only)
+#define DUPLICATE_POLICY DuplicatePolicy::Share // how to deal with individuals whose expression is identical to another's in the same generation (Keep, Share or Replace)
+#define CHECKPOINT_INTERVAL 100 // number of generations between two checkpoints of each run's state, which allows resuming interrupted runs (0 to disable)
+#define THREADS 0 // maximum number of runs executed in parallel (0 for one per hardware thread)
+#define TIME_LIMIT 0 // maximum wall-clock time of each run in seconds (0 for no limit)
+#define EVALUATION_LIMIT 0 // maximum number of fitness evaluations of each run (0 for no limit)
+#define STAGNATION_LIMIT 0 // number of generations without improvement after which a run stops (0 for no limit)
+#define RESTART_ON_STAGNATION false // whether to restart from a new random population instead of stopping when the stagnation limit is reached
+#define COLLOCATION_POINTS 0 // number of grid points the equation is evaluated at, moved toward the highest residuals of the best candidate every REFINE_INTERVAL generations (0 for the whole grid)
+#define REFINE_INTERVAL 10
 
 
 #ifdef FULLY_RANDOM
 	#undef TREE_CHROMOSOMES
 	#define POPULATION_SIZE 5000
-	#define CHROMOSOME_SIZE 50
 	#define REPLICATION_RATE 0.0002
 	#define MUTATION_RATE 0.0002
 	#define RANDOM_RATE 0.9996
@@ -28,265 +44,202 @@
 	#define MUTATION_RATE 0.1
 	#define GENERATIONS 5000
 #ifdef TREE_CHROMOSOMES
-	#define REPLICATION_BIAS 25
-	#define TREE_MUTATION_RATE 0.1
 	#define RANDOM_RATE 0.1
 #else
-	#define CHROMOSOME_SIZE 50
 	#define RANDOM_RATE 0.0
 #endif
 #endif
+// tree population only
+#define REPLICATION_BIAS 25
+#define TREE_MUTATION_RATE 0.1
+#define CROSSOVER_RATE 0.3 // probability for a child to be created by sub-tree crossover between two parents (0 to only replicate and mutate, as before crossover was added)
+#define CROSSOVER_MODE CrossoverMode::SizeFair // how crossover picks the sub-trees that are exchanged (Subtree or SizeFair)
+#define CROSSOVER_MAX_DEPTH 0 // maximum height of trees created by crossover (0 for no limit)
+// grammar-based population only
+#define CHROMOSOME_SIZE 50
 
 
 // ------------------------------------
 
 
-#include <ctime>
-#include <stdlib.h>
-#include <cmath>
+#include <cstdio>
 #include <thread>
-#ifndef M_PI
-	#define M_PI 3.14159265359
-#endif
-#include "Vars.h"
-#include "Addition.h"
-#include "Multiplication.h"
-#include "Division.h"
-#include "Subtraction.h"
-#include "Trig.h"
-#include "Exponential.h"
-#include "Logarithm.h"
-#include "SquareRoot.h"
-#include "Power.h"
-#include "GrammarDecoder.h"
-#include "Population.h"
-#include "TreePopulation.h"
-#if defined(EXAMPLE_ODES) or defined(EXAMPLE_NLODES) or defined(SINGLE_EXAMPLE_ODE)
-	#include "ExampleODEs.h"
-#endif
-#ifdef EXAMPLE_PDES
-	#include "ExamplePDEs.h"
-#endif
-#include "FileWriter.h"
-
-
-
-Fitness<double> heatPde(double tMax) {
-	// exact solution:
-	// u(x, t) = e^{- pi^2 t} sin(pi x)
-	return Fitness<double>(
-		[](FunctionParams<double> p) -> const double {
-			return p.ddx2 - p.ddy; // d^2/dx^2 u = d/dt u
-		},
-		Domain<double>(0, 1, 50), Domain<double>(0, tMax, 50), 100,
-		{
-			Boundary<double>(0, 0, [](double t, double f, double dfdx, double ddfdx) -> double {
-				return -f; // u(0, t) = 0
-			}),
-			Boundary<double>(1, 0, [](double t, double f, double dfdx, double ddfdx) -> double {
-				return -f; // u(L, t) = 0
-			}),
-			Boundary<double>(0, 1, [](double x, double f, double dfdt, double ddfdt) -> double {
-				return f - sin(M_PI * x); // u(x, 0) = sin(pi x)
-			})
-		}
-	);
-}
-
-Fitness<double> heatPdeNoPi(double tMax) {
-	// exact solution:
-	// u(x, t) = e^{-t} sin(x)
-	return Fitness<double>(
-		[](FunctionParams<double> p) -> const double {
-			return p.ddx2 - p.ddy;
-		},
-		Domain<double>(0, M_PI, 50), Domain<double>(0, tMax, 50), 100,
-		{
-			Boundary<double>(0, 0, [](double t, double f, double dfdx, double ddfdx) -> double {
-				return -f; // u(0, t) = 0
-			}),
-			Boundary<double>(M_PI, 0, [](double t, double f, double dfdx, double ddfdx) -> double {
-				return -f; // u(pi, t) = 0
-			}),
-			Boundary<double>(0, 1, [](double x, double f, double dfdt, double ddfdt) -> double {
-				return f - sin(x); // u(x, 0) = sin(x)
-			})
-		}
-	);
-}
-
+#include "Problems.h"
+#include "Solver.h"
+#include "Config.h"
+#include "JobScheduler.h"
 
 
 
 /**
- * Solves an ODE/PDE given its fitness function and a grammatical decoder
- * This uses the parameters #define'd at the top of main.cpp
+ * Returns the parameters #define'd at the top of main.cpp
  */
-void solve(std::string name, Fitness<double> fitnessFunction, GrammarDecoder<double>* decoder, int seed) {
-
-#ifdef MULTI_RUN
-	int ogSeed = seed;
-	for (; seed < ogSeed + 50; ++seed) {
-#endif
-
-		// Init population
+RunParameters defaultParameters() {
+	RunParameters params;
 #ifdef TREE_CHROMOSOMES
-		TreePopulation<double> population(POPULATION_SIZE, REPLICATION_RATE, REPLICATION_BIAS, MUTATION_RATE, TREE_MUTATION_RATE, RANDOM_RATE, &fitnessFunction, decoder, seed);
-		const TreeChromosome<double>* top = nullptr;
+	params.useTrees = true;
+#else
+	params.useTrees = false;
+#endif
+	params.populationSize = POPULATION_SIZE;
+	params.generations = GENERATIONS;
+	params.replicationRate = REPLICATION_RATE;
+	params.mutationRate = MUTATION_RATE;
+	params.randomRate = RANDOM_RATE;
+	params.chromosomeSize = CHROMOSOME_SIZE;
+	params.replicationBias = REPLICATION_BIAS;
+	params.treeMutationRate = TREE_MUTATION_RATE;
+	params.crossoverRate = CROSSOVER_RATE;
+	params.crossoverMode = CROSSOVER_MODE;
+	params.crossoverMaxDepth = CROSSOVER_MAX_DEPTH;
+	params.duplicatePolicy = DUPLICATE_POLICY;
+	params.checkpointInterval = CHECKPOINT_INTERVAL;
+	params.timeLimit = TIME_LIMIT;
+	params.evaluationLimit = EVALUATION_LIMIT;
+	params.stagnationLimit = STAGNATION_LIMIT;
+	params.restartOnStagnation = RESTART_ON_STAGNATION;
+	params.collocationPoints = COLLOCATION_POINTS;
+	params.refineInterval = REFINE_INTERVAL;
+#ifdef VERBOSE
+	params.verbose = true;
 #else
-		Population<double> population(POPULATION_SIZE, CHROMOSOME_SIZE, REPLICATION_RATE, MUTATION_RATE, RANDOM_RATE, &fitnessFunction, decoder, seed);
-		const Chromosome<double>* top = nullptr;
+	params.verbose = false;
 #endif
-
-
-		// create json string with results (hard-coded json structure since it's kept fairly simple)
 #ifdef JSON
-		std::string json = "{\"time\":" + std::to_string(time(nullptr)) + ",\"seed\":" + std::to_string(seed) + ",\"problem\":\"" + name + "\",\"useTrees\":";
-#ifdef TREE_CHROMOSOMES
-		json += "true,";
+	params.json = true;
 #else
-		json += "false,";
+	params.json = false;
 #endif
-		json += "\"populationSize\":" + std::to_string(POPULATION_SIZE) + ",";
-		json += "\"replicationRate\":" + std::to_string(REPLICATION_RATE) + ",";
-		json += "\"mutationRate\":" + std::to_string(MUTATION_RATE) + ",";
-		json += "\"maxGeneration\":" + std::to_string(GENERATIONS) + ",";
-#ifdef TREE_CHROMOSOMES
-		json += "\"replicationBias\":" + std::to_string(REPLICATION_BIAS) + ",";
-		json += "\"treeMutationRate\":" + std::to_string(TREE_MUTATION_RATE) + ",";
+#ifdef BINARY_LOG
+	params.binaryLog = true;
 #else
-		json += "\"chromosomeSize\":" + std::to_string(CHROMOSOME_SIZE) + ",";
-		json += "\"randomRate\":" + std::to_string(RANDOM_RATE) + ",";
+	params.binaryLog = false;
 #endif
-		json += "\"generations\":[";
-#endif
-
-
-		// Iterate over generations
-		int gen;
-		double fitness = INFINITY;
-		std::shared_ptr<Expression<double>> bestExpression = nullptr;
-		for (gen = 1; gen <= GENERATIONS; ++gen) {
-			top = population.nextGeneration();
-			if (top && top->fitness < fitness) {
-				fitness = top->fitness;
-				bestExpression = top->expression;
-#ifdef VERBOSE
-				printf("%s \tGen. %d, \tfitness %f, \tf(x, y) = %s\n", name.c_str(), gen, fitness, top->expression->toString().c_str());
+#ifdef MONITOR
+	params.monitor = true;
+#else
+	params.monitor = false;
 #endif
-#ifdef JSON // add one json object to the array of generations each time a new best fit is found
-				json += "{\"generation\":" + std::to_string(gen) + ",\"fitness\":" + std::to_string(top->fitness) + ",";
-				json += "\"expression\":\"" + top->expression->toString() + "\",\"jsExpression\":\"" + top->expression->toJsString() + "\"},";
+#ifdef FAST_MATH
+	params.fastMath = true;
+#else
+	params.fastMath = false;
 #endif
-			}
-			if (top && top->fitness < 1e-7) {
-				break;
-			}
-		}
+	return params;
+}
 
 
-		// Log result
-		if (!top) {
-			printf("Could not solve %s, null result.\n\n", name.c_str());
-		} else {
-			printf("\nFinished solving %s in %d generations: \tfitness %f, \tf(x, y) = %s\n\n", name.c_str(), gen, fitness, bestExpression->toString().c_str());
-			printf("d/dx f(x, y) = %s\n", bestExpression->derivative(0)->simplify()->toString().c_str());
-			printf("d/dy f(x, y) = %s\n", bestExpression->derivative(1)->simplify()->toString().c_str());
-			printf("d^2/dx^2 f(x, y) = %s\n", bestExpression->derivative(0)->derivative(0)->simplify()->toString().c_str());
-			printf("d^2/dy^2 f(x, y) = %s\n\n", bestExpression->derivative(1)->derivative(1)->simplify()->toString().c_str());
-		}
 
 
-		// close json string and output to file
-#ifdef JSON
-		json = json.substr(0, json.length() - 1); // remove last trailing comma
-		json += "]}";
-		FileWriter::Write("results/" + name + "_" + std::to_string(time(nullptr)) + ".json", json);
-#endif
+int main(int argc, char** argv) {
 
+	// Read runtime settings, which override the defaults #define'd at the top of main.cpp
+	Config config;
+	std::vector<std::string> knownKeys = RunParameters::keys();
+	knownKeys.insert(knownKeys.end(), { "problems", "problemFile", "runs", "seed", "threads" });
+	int runs, threads;
+	try {
+		config.parseArguments(argc, argv);
+		for (auto& key : config.unknownKeys(knownKeys)) {
+			fprintf(stderr, "Unknown setting: %s\n", key.c_str());
+			throw "Unknown setting";
+		}
 #ifdef MULTI_RUN
-	}
+		runs = config.getInt("runs", 50, 1);
+#else
+		runs = config.getInt("runs", 1, 1);
 #endif
-}
-
-
-
-
-int main() {
+		threads = config.getInt("threads", THREADS, 0);
+	} catch (const char* e) {
+		fprintf(stderr, "%s\n", e);
+		return 1;
+	}
 
 	// Set up grammar - two different variants for 1D problems (ODEs) and 2D problems (PDEs)
-	std::vector<GrammaticalElement_base<double>*> variables1d = {
-		Gd(VarX)
-	};
-	std::vector<GrammaticalElement_base<double>*> variables2d = {
-		Gd(VarX),
-		Gd(VarY)
-	};
-	std::vector<GrammaticalElement_base<double>*> operations = {
-		G2d(Addition),
-		G2d(Subtraction),
-		G2d(Multiplication),
-		G2d(Division),
-		G2d(Power)
-	};
-	std::vector<GrammaticalElement_base<double>*> functions = {
-		G1d(Sine),
-		G1d(Cosine),
-		G1d(Exponential),
-		G1d(Logarithm),
-		// G1d(SquareRoot) <- not including sqrt() in the grammar since it's not quite general enough, we already have powers so it's possible to obtain ^0.5 anyways
-	};
-	std::vector<double> constants = {
-		-1, 0, 1, 2, 3, M_PI, 4, 5, 6, 7, 8, 9, 10
-	};
-	auto decoder1d = new GrammarDecoder<double>(0, variables1d, operations, functions, constants);
-	auto decoder2d = new GrammarDecoder<double>(0, variables2d, operations, functions, constants);
-
+	auto decoder1d = createDecoder(false);
+	auto decoder2d = createDecoder(true);
 
-	std::vector<std::thread*> threads;
 
+	// All problems that can be solved: the built-in ones, and those loaded from problem files (which are solved by default when given)
+	std::vector<Problem> problems = getProblems();
+	std::string loadedProblems = "";
+	try {
+		for (auto& filename : config.values("problemFile")) {
+			problems.push_back(loadProblem(filename));
+			loadedProblems += "," + problems.back().name;
+		}
+	} catch (const char* e) {
+		fprintf(stderr, "%s\n", e);
+		return 1;
+	}
 
 
-	// solve example ODEs from the original paper
+	// Problems to solve, either by name (e.g. ODE3) or by family (e.g. PDE for all PDEs)
+	std::string defaultProblems = "";
 #if defined(SINGLE_EXAMPLE_ODE) and not defined(EXAMPLE_ODES)
-	threads.push_back(new std::thread(solve, "ODE" + std::to_string(SINGLE_EXAMPLE_ODE), getExampleODE(SINGLE_EXAMPLE_ODE), decoder1d, 0));
+	defaultProblems += ",ODE" + std::to_string(SINGLE_EXAMPLE_ODE);
 #endif
 #ifdef EXAMPLE_ODES
-	for (int i = 1; i <= 9; ++i) {
-		threads.push_back(new std::thread(solve, "ODE" + std::to_string(i), getExampleODE(i), decoder1d, i));
-	}
+	defaultProblems += ",ODE";
 #endif
-
-	// solve example NLODEs from the original paper
 #ifdef EXAMPLE_NLODES
-	for (int i = 1; i <= 4; ++i) {
-		threads.push_back(new std::thread(solve, "NLODE" + std::to_string(i), getExampleNLODE(i), decoder1d, i));
-	}
+	defaultProblems += ",NLODE";
 #endif
-
-	// solve example PDEs from the original paper
 #ifdef EXAMPLE_PDES
-	for (int i = 1; i <= 6; ++i) {
-		threads.push_back(new std::thread(solve, "PDE" + std::to_string(i), getExamplePDE(i), decoder2d, i));
-	}
+	defaultProblems += ",PDE";
 #endif
-
-	// solve 1D temporal heat equation problem
 #ifdef HEAT
-	threads.push_back(new std::thread(solve, "Heat", heatPde(1), decoder2d, 1337));
+	defaultProblems += ",Heat";
 #endif
 #ifdef HEAT_NO_PI
-	threads.push_back(new std::thread(solve, "Heat[-pi]", heatPdeNoPi(1), decoder2d, 1337));
+	defaultProblems += ",Heat[-pi]";
 #endif
+	if (!config.has("problems")) {
+		config.set("problems", loadedProblems.empty() ? defaultProblems : loadedProblems);
+	}
 
-
-	// Run all threads until they terminate, then exit the program
-	for (auto it = threads.begin(); it != threads.end(); it++) {
-		(*it)->join();
-		delete* it;
+	// Queue one job per problem, parameter set and seed; comma-separated values of run parameters are expanded into every combination
+	JobScheduler scheduler;
+	auto parameterSets = config.combinations(RunParameters::keys());
+	for (auto& selected : config.values("problems")) {
+		bool found = false;
+		for (auto& problem : problems) {
+			if (!isSelected(problem, selected)) continue;
+			found = true;
+			for (size_t k = 0; k < parameterSets.size(); ++k) {
+				RunParameters params = defaultParameters();
+				int firstSeed;
+				try {
+					for (auto& setting : parameterSets[k]) {
+						params.set(setting.first, setting.second);
+					}
+					firstSeed = config.getInt("seed", problem.seed);
+				} catch (const char* e) {
+					fprintf(stderr, "%s\n", e);
+					return 1;
+				}
+				// runs with several parameter sets are told apart by the index of their parameter set
+				std::string name = parameterSets.size() > 1 ? problem.name + "_p" + std::to_string(k + 1) : problem.name;
+				GrammarDecoder<double>* decoder = problem.twoDimensional ? decoder2d : decoder1d;
+				for (int seed = firstSeed; seed < firstSeed + runs; ++seed) {
+					const Fitness<double>* fitness = &problem.fitness;
+					scheduler.add(double(fitness->cost()) * params.populationSize * params.generations, [name, fitness, decoder, seed, params]() {
+						solve(name, *fitness, decoder, seed, params, createListeners(params));
+					});
+				}
+			}
+		}
+		if (!found) {
+			fprintf(stderr, "Unknown problem: %s\n", selected.c_str());
+			return 1;
+		}
 	}
 
+
+	// Run all jobs until they terminate, then exit the program, with an error if any of them failed
+	size_t failed = scheduler.run(threads);
+
 	delete decoder1d;
 	delete decoder2d;
-	return 0;
+	return failed > 0 ? 1 : 0;
 }
@@ -0,0 +1,482 @@
+// Micro-benchmarks of the expression layer: evaluation of each node type (one point at a time, and batched with exact and fast functions), derivatives, simplification, mutation, printing, decoding and random instantiation
+// Usage: make microbench, or ./microbenchmark [--filter=evaluate,decode] [--minTime=0.2] [--output=microbench.json] [--baseline=previous.json] [--tolerance=0.25]
+// Trees are sampled from the populations of short runs on built-in problems, so that their sizes and depths follow those seen in real runs
+// Each kernel reports the time, number of heap allocations and number of allocated bytes per operation
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <new>
+#include "Problems.h"
+#include "Population.h"
+#include "TreePopulation.h"
+#include "TreeMutator.h"
+#include "Program.h"
+#include "Config.h"
+#include "JsonWriter.h"
+#include "JsonReader.h"
+
+
+
+// Every heap allocation of the process goes through these operators, which count them; the benchmark is single-threaded
+static uint64_t allocationCount = 0;
+static uint64_t allocationBytes = 0;
+
+// every deallocation function goes through the single-object delete, which is kept out of line: otherwise GCC inlines its free() into callers and flags it as mismatched with the operator new they called (-Wmismatched-new-delete)
+#ifdef __GNUC__
+	#define NOINLINE __attribute__((noinline))
+#else
+	#define NOINLINE
+#endif
+
+void* operator new(size_t size) {
+	++allocationCount;
+	allocationBytes += size;
+	void* p = malloc(size ? size : 1);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	++allocationCount;
+	allocationBytes += size;
+	return malloc(size ? size : 1);
+}
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+NOINLINE void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+
+
+/**
+ * Results are accumulated into this variable so that the compiler can't optimize the benchmarked calls away
+ */
+static volatile double sink = 0;
+
+
+/**
+ * Cost of one operation of a kernel, averaged over all the operations run while measuring it
+ */
+struct Measurement {
+	std::string name;
+	uint64_t operations;
+	double nanoseconds;
+	double allocations;
+	double bytes;
+};
+
+
+/**
+ * Runs a kernel until at least minSeconds have elapsed and returns its cost per operation
+ * Each call to run() executes a batch of operations and returns how many; the first batch warms up caches and reusable storage and isn't measured
+ */
+template<typename F>
+Measurement measure(const std::string& name, double minSeconds, F run) {
+	run();
+	uint64_t operations = 0;
+	uint64_t allocations = allocationCount;
+	uint64_t bytes = allocationBytes;
+	auto start = std::chrono::steady_clock::now();
+	double seconds;
+	do {
+		operations += run();
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	} while (seconds < minSeconds);
+	Measurement m;
+	m.name = name;
+	m.operations = operations;
+	m.nanoseconds = 1e9 * seconds / operations;
+	m.allocations = double(allocationCount - allocations) / operations;
+	m.bytes = double(allocationBytes - bytes) / operations;
+	return m;
+}
+
+
+/**
+ * Returns whether an expression can be evaluated at all the given points, along with its derivatives, without throwing
+ */
+bool isValid(const ExpressionPtr<double>& expression, const std::vector<std::pair<double, double>>& points) {
+	Program<double> program;
+	program.compile(expression);
+	try {
+		for (auto& p : points) {
+			expression->evaluate(p.first, p.second);
+			program.evaluate(p.first, p.second);
+		}
+	} catch (...) { // division by zero, log of a non-positive value, etc.
+		return false;
+	}
+	return true;
+}
+
+
+/**
+ * Trees and gene sequences sampled from short runs, along with the sizes and heights of the trees
+ */
+struct Corpus {
+	std::vector<std::shared_ptr<Expression<double>>> trees; // all trees, including those that can't be evaluated
+	std::vector<std::shared_ptr<Expression<double>>> validTrees; // trees that can be evaluated at every sample point, so that evaluation kernels never measure the cost of exceptions
+	std::vector<std::vector<Gene>> sequences; // gene sequences of the grammar-based population
+};
+
+
+/**
+ * Samples trees from tree populations, and gene sequences from grammar-based populations, evolving on each of the given problems
+ * The populations are sampled at several generations, since trees grow and change shape as a run goes on
+ */
+Corpus sampleCorpus(const std::vector<Problem>& problems, const GrammarDecoder<double>* decoder1d, const GrammarDecoder<double>* decoder2d, const std::vector<std::pair<double, double>>& points, unsigned int maxTrees) {
+	const unsigned int populationSize = 500;
+	const unsigned int chromosomeSize = 50;
+	const std::vector<int> sampledGenerations = { 5, 20, 50 };
+
+	Corpus corpus;
+	for (auto& problem : problems) {
+		const GrammarDecoder<double>* decoder = problem.twoDimensional ? decoder2d : decoder1d;
+
+		TreePopulation<double> trees(populationSize, 0.05f, 25, 0.1f, 0.1f, 0.1f, &problem.fitness, decoder, problem.seed);
+		trees.setCrossover(0.3f, CrossoverMode::SizeFair);
+		Population<double> genes(populationSize, chromosomeSize, 0.05f, 0.1f, 0.1f, &problem.fitness, decoder, problem.seed);
+		for (int generation = 1; generation <= sampledGenerations.back(); ++generation) {
+			trees.nextGeneration();
+			genes.nextGeneration();
+			if (std::find(sampledGenerations.begin(), sampledGenerations.end(), generation) == sampledGenerations.end()) continue;
+			for (auto& ch : trees.getChromosomes()) {
+				if (ch.expression) corpus.trees.push_back(ch.expression);
+			}
+			for (auto& ch : genes.getChromosomes()) {
+				corpus.sequences.emplace_back(ch.genes, ch.genes + chromosomeSize);
+			}
+		}
+	}
+
+	// keep an evenly spread subset, so that every problem and generation stays represented
+	auto subsample = [maxTrees](auto& v) {
+		if (v.size() <= maxTrees) return;
+		std::vector<typename std::decay<decltype(v)>::type::value_type> kept;
+		for (unsigned int i = 0; i < maxTrees; ++i) kept.push_back(v[size_t(i) * v.size() / maxTrees]);
+		v.swap(kept);
+	};
+	subsample(corpus.trees);
+	subsample(corpus.sequences);
+	for (auto& tree : corpus.trees) {
+		if (isValid(tree, points)) corpus.validTrees.push_back(tree);
+	}
+	return corpus;
+}
+
+
+/**
+ * Prints the distribution of the sizes and heights of the sampled trees
+ */
+void printCorpus(const Corpus& corpus) {
+	std::vector<unsigned int> sizes, heights;
+	for (auto& tree : corpus.trees) {
+		sizes.push_back(tree->size());
+		heights.push_back(tree->height());
+	}
+	std::sort(sizes.begin(), sizes.end());
+	std::sort(heights.begin(), heights.end());
+	auto percentile = [](const std::vector<unsigned int>& v, double p) { return v[size_t(p * (v.size() - 1))]; };
+	printf("%d trees (%d valid), %d gene sequences\n", int(corpus.trees.size()), int(corpus.validTrees.size()), int(corpus.sequences.size()));
+	printf("size: median %u, p90 %u, max %u; height: median %u, p90 %u, max %u\n\n",
+		percentile(sizes, 0.5), percentile(sizes, 0.9), sizes.back(), percentile(heights, 0.5), percentile(heights, 0.9), heights.back());
+}
+
+
+/**
+ * Writes the measurements to a json file
+ */
+void writeResults(const std::string& filename, const std::vector<Measurement>& results) {
+	JsonWriter json;
+	json.open(filename);
+	json.beginObject();
+	json.key("time").value(int64_t(time(nullptr)));
+	json.key("kernels").beginArray();
+	for (auto& m : results) {
+		json.beginObject();
+		json.key("name").value(m.name);
+		json.key("operations").value(m.operations);
+		json.key("nsPerOp").value(m.nanoseconds);
+		json.key("allocationsPerOp").value(m.allocations);
+		json.key("bytesPerOp").value(m.bytes);
+		json.endObject();
+	}
+	json.endArray();
+	json.endObject();
+	json.close();
+}
+
+
+/**
+ * Compares the measurements with those of a baseline file written by an earlier run; returns false if a kernel became slower by more than the tolerance, or allocates more
+ */
+bool compareWithBaseline(const std::string& filename, const std::vector<Measurement>& results, double tolerance) {
+	std::vector<char> data;
+	if (!FileWriter::ReadBinary(filename, data)) {
+		fprintf(stderr, "Could not open baseline %s\n", filename.c_str());
+		return false;
+	}
+	JsonValue baseline = JsonReader::parse(data);
+
+	printf("\nComparison with %s:\n", filename.c_str());
+	printf("%-28s %12s %12s %9s %s\n", "kernel", "ns/op", "baseline", "change", "");
+	bool regressed = false;
+	for (auto& m : results) {
+		const JsonValue* b = nullptr;
+		for (auto& kernel : baseline["kernels"].elements) {
+			if (kernel["name"].asString() == m.name) b = &kernel;
+		}
+		if (!b) {
+			printf("%-28s %12.1f %12s\n", m.name.c_str(), m.nanoseconds, "-");
+			continue;
+		}
+		double before = (*b)["nsPerOp"].asNumber();
+		double change = m.nanoseconds / before - 1;
+		// allocation counts are deterministic, so any increase is reported
+		std::string note;
+		if (m.allocations > (*b)["allocationsPerOp"].asNumber() + 1e-3) note = "more allocations";
+		if (change > tolerance) note = note.empty() ? "slower" : "slower, " + note;
+		regressed = regressed || !note.empty();
+		printf("%-28s %12.1f %12.1f %+8.1f%% %s\n", m.name.c_str(), m.nanoseconds, before, 100 * change, note.c_str());
+	}
+	if (regressed) {
+		printf("Some kernels regressed (tolerance %.0f%%)\n", 100 * tolerance);
+	}
+	return !regressed;
+}
+
+
+
+int main(int argc, char** argv) {
+
+	Config config;
+	double minSeconds;
+	int treeCount;
+	double tolerance;
+	try {
+		config.parseArguments(argc, argv);
+		for (auto& key : config.unknownKeys({ "filter", "minTime", "trees", "output", "baseline", "tolerance" })) {
+			fprintf(stderr, "Unknown setting: %s\n", key.c_str());
+			throw "Unknown setting";
+		}
+		minSeconds = Config::parseNumber("minTime", config.get("minTime", "0.2"), 0, HUGE_VAL);
+		treeCount = config.getInt("trees", 2000, 1);
+		tolerance = Config::parseNumber("tolerance", config.get("tolerance", "0.25"), 0, HUGE_VAL);
+	} catch (const char* e) {
+		fprintf(stderr, "%s\n", e);
+		return 1;
+	}
+	std::vector<Measurement> results;
+	auto run = [&](const std::string& name, auto kernel) {
+		if (config.has("filter")) {
+			bool selected = false;
+			for (auto& filter : config.values("filter")) {
+				selected = selected || name.find(filter) != std::string::npos;
+			}
+			if (!selected) return;
+		}
+		Measurement m = measure(name, minSeconds, kernel);
+		printf("%-28s %12.1f %12.2f %12.1f\n", m.name.c_str(), m.nanoseconds, m.allocations, m.bytes);
+		fflush(stdout);
+		results.push_back(m);
+	};
+
+	// sample points inside the domains of the problems, where most expressions are defined
+	std::vector<std::pair<double, double>> points;
+	for (int i = 0; i < 8; ++i) {
+		for (int j = 0; j < 8; ++j) {
+			points.emplace_back(0.1 + 0.8 * i / 7, 0.1 + 0.8 * j / 7);
+		}
+	}
+
+	auto decoder1d = createDecoder(false);
+	auto decoder2d = createDecoder(true);
+	std::vector<Problem> sampled;
+	for (auto& problem : getProblems()) {
+		if (problem.name == "ODE1" || problem.name == "NLODE1" || problem.name == "PDE1" || problem.name == "Heat") sampled.push_back(problem);
+	}
+	Corpus corpus = sampleCorpus(sampled, decoder1d, decoder2d, points, treeCount);
+	printCorpus(corpus);
+	if (corpus.validTrees.empty()) { // the tree kernels count their operations from the corpus, and would measure nothing
+		fprintf(stderr, "No valid tree in the corpus, sample more trees with --trees\n");
+		delete decoder1d;
+		delete decoder2d;
+		return 1;
+	}
+	printf("%-28s %12s %12s %12s\n", "kernel", "ns/op", "allocs/op", "bytes/op");
+
+
+	// evaluation of each node type, on its own with variables and constants as operands
+	auto x = VarXPtr(double);
+	auto y = VarYPtr(double);
+	std::vector<std::pair<std::string, std::shared_ptr<Expression<double>>>> nodes = {
+		{ "x", x },
+		{ "c", ConstantPtr(double, 2) },
+		{ "x+y", AdditionPtr(double, x, y) },
+		{ "x-y", SubtractionPtr(double, x, y) },
+		{ "x*y", MultiplicationPtr(double, x, y) },
+		{ "x/y", DivisionPtr(double, x, y) },
+		{ "x^2", PowerPtr(double, x, ConstantPtr(double, 2)) },
+		{ "x^3", PowerPtr(double, x, ConstantPtr(double, 3)) },
+		{ "x^-1", PowerPtr(double, x, ConstantPtr(double, -1)) },
+		{ "x^0.5", PowerPtr(double, x, ConstantPtr(double, 0.5)) },
+		{ "x^pi", PowerPtr(double, x, ConstantPtr(double, M_PI)) },
+		{ "x^y", PowerPtr(double, x, y) },
+		{ "sin(x)", SinePtr(double, x) },
+		{ "cos(x)", CosinePtr(double, x) },
+		{ "exp(x)", ExponentialPtr(double, x) },
+		{ "log(x)", LogarithmPtr(double, x) },
+		{ "sqrt(x)", SquareRootPtr(double, x) }
+	};
+	for (auto& node : nodes) {
+		const ExpressionPtr<double>& expression = node.second;
+		run("evaluate/" + node.first, [&]() -> uint64_t {
+			double sum = 0;
+			for (auto& p : points) sum += expression->evaluate(p.first, p.second);
+			sink = sink + sum;
+			return points.size();
+		});
+	}
+	for (auto& node : nodes) {
+		if (!isValid(node.second, points)) continue; // e.g. variable exponents, whose derivatives are invalid
+		Program<double> program;
+		program.compile(node.second);
+		run("jet/" + node.first, [&]() -> uint64_t {
+			double sum = 0;
+			for (auto& p : points) sum += program.evaluate(p.first, p.second).dxx;
+			sink = sink + sum;
+			return points.size();
+		});
+	}
+	std::vector<double> pointsX, pointsY;
+	for (auto& p : points) {
+		pointsX.push_back(p.first);
+		pointsY.push_back(p.second);
+	}
+	Jets<double> jets;
+	for (auto& node : nodes) {
+		if (!isValid(node.second, points)) continue;
+		Program<double> program;
+		program.compile(node.second);
+		for (auto accuracy : { FastMath::Accuracy::Exact, FastMath::Accuracy::Fast }) {
+			run("jets/" + node.first + (accuracy == FastMath::Accuracy::Fast ? "/fast" : ""), [&]() -> uint64_t {
+				program.evaluate(pointsX.data(), pointsY.data(), points.size(), jets, accuracy);
+				sink = sink + jets.dxx[0];
+				return points.size();
+			});
+		}
+	}
+
+
+	// operations on whole trees sampled from runs; each operation is one call on one tree
+	// kernels that evaluate constant sub-trees (derivatives of powers, simplification) only use valid trees, as they could throw on the others
+	auto& trees = corpus.trees;
+	auto& validTrees = corpus.validTrees;
+	run("evaluate/tree", [&]() -> uint64_t {
+		double sum = 0;
+		for (auto& tree : validTrees) {
+			for (auto& p : points) sum += tree->evaluate(p.first, p.second);
+		}
+		sink = sink + sum;
+		return validTrees.size() * points.size();
+	});
+	std::vector<Program<double>> programs(validTrees.size());
+	for (size_t i = 0; i < validTrees.size(); ++i) programs[i].compile(validTrees[i]);
+	run("jet/tree", [&]() -> uint64_t {
+		double sum = 0;
+		for (auto& program : programs) {
+			for (auto& p : points) sum += program.evaluate(p.first, p.second).dxx;
+		}
+		sink = sink + sum;
+		return programs.size() * points.size();
+	});
+	for (auto accuracy : { FastMath::Accuracy::Exact, FastMath::Accuracy::Fast }) {
+		run(std::string("jets/tree") + (accuracy == FastMath::Accuracy::Fast ? "/fast" : ""), [&]() -> uint64_t {
+			for (auto& program : programs) {
+				program.evaluate(pointsX.data(), pointsY.data(), points.size(), jets, accuracy);
+				sink = sink + jets.dxx[0];
+			}
+			return programs.size() * points.size();
+		});
+	}
+	Program<double> program;
+	run("compile", [&]() -> uint64_t {
+		for (auto& tree : trees) {
+			program.compile(tree);
+			sink = sink + program.size();
+		}
+		return trees.size();
+	});
+	run("derivative", [&]() -> uint64_t {
+		for (auto& tree : validTrees) sink = sink + tree->derivative(0)->size();
+		return validTrees.size();
+	});
+	run("derivative/second", [&]() -> uint64_t {
+		for (auto& tree : validTrees) sink = sink + tree->derivative(0)->derivative(0)->size();
+		return validTrees.size();
+	});
+	run("simplify", [&]() -> uint64_t {
+		for (auto& tree : validTrees) sink = sink + tree->simplify()->size();
+		return validTrees.size();
+	});
+	run("toString", [&]() -> uint64_t {
+		for (auto& tree : trees) sink = sink + tree->toString().size();
+		return trees.size();
+	});
+	Random::Rng rng(1);
+	TreeMutator<double> mutator(0.1, 0.1, decoder2d);
+	run("mutate", [&]() -> uint64_t {
+		for (auto& tree : trees) sink = sink + mutator.mutate(tree, rng)->size();
+		return trees.size();
+	});
+	run("mutate/recursive", [&]() -> uint64_t {
+		for (auto& tree : trees) sink = sink + tree->mutate(rng, 0.1, 0.1, decoder2d, true)->size();
+		return trees.size();
+	});
+
+
+	// grammar-based decoding of gene sequences sampled from runs, and random trees as created by tree populations
+	auto& sequences = corpus.sequences;
+	run("decode", [&]() -> uint64_t {
+		for (auto& sequence : sequences) {
+			auto expression = decoder2d->decode(sequence.data(), (unsigned int)sequence.size());
+			sink = sink + (expression ? expression->size() : 0);
+		}
+		return sequences.size();
+	});
+	run("decodeProgram", [&]() -> uint64_t {
+		for (auto& sequence : sequences) {
+			sink = sink + decoder2d->decodeProgram(sequence.data(), (unsigned int)sequence.size(), program);
+		}
+		return sequences.size();
+	});
+	run("instantiateExpression", [&]() -> uint64_t {
+		for (int i = 0; i < 1000; ++i) sink = sink + decoder2d->instantiateExpression(rng, 5)->size();
+		return 1000;
+	});
+
+	delete decoder1d;
+	delete decoder2d;
+
+
+	if (config.has("output")) {
+		writeResults(config.get("output", ""), results);
+		printf("Results written to %s\n", config.get("output", "").c_str());
+	}
+	if (config.has("baseline")) {
+		try {
+			if (!compareWithBaseline(config.get("baseline", ""), results, tolerance)) {
+				return 2;
+			}
+		} catch (const char* e) {
+			fprintf(stderr, "Invalid baseline: %s\n", e);
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,187 @@
+// Displays the live progress of the runs of every running solver process (started with MONITOR or --monitor=true), refreshed every second
+// Usage: ./monitor [--pid=1234] [--interval=1] [--once] [--all] [--clean]
+// --once prints the table a single time, --all also lists finished runs, and --clean removes the regions left behind by processes that crashed
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <dirent.h>
+#include <signal.h>
+#include "Monitor.h"
+#include "Config.h"
+
+
+
+/**
+ * Shared memory region of a solver process, mapped read-only
+ */
+struct Attachment {
+	int pid;
+	const Monitor::Region* region;
+};
+
+
+/**
+ * Maps the region of a process; returns nullptr if it doesn't exist or isn't a valid region
+ */
+const Monitor::Region* attach(int pid) {
+	std::string name = Monitor::regionName(pid);
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0) return nullptr;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(Monitor::Region)) {
+		close(fd);
+		return nullptr;
+	}
+	void* p = mmap(nullptr, sizeof(Monitor::Region), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) return nullptr;
+	const Monitor::Region* region = (const Monitor::Region*)p;
+	if (region->magic != Monitor::Magic || region->version != Monitor::Version) {
+		munmap(p, sizeof(Monitor::Region));
+		return nullptr;
+	}
+	return region;
+}
+
+
+/**
+ * Returns the processes that have a region, from the entries of /dev/shm
+ */
+std::vector<int> findProcesses() {
+	std::vector<int> pids;
+	DIR* dir = opendir("/dev/shm");
+	if (!dir) return pids;
+	while (dirent* entry = readdir(dir)) {
+		std::string name = entry->d_name;
+		if (name.compare(0, 7, "ga-ode-") == 0 && name.find_first_not_of("0123456789", 7) == std::string::npos && name.size() > 7) {
+			pids.push_back(atoi(name.c_str() + 7));
+		}
+	}
+	closedir(dir);
+	std::sort(pids.begin(), pids.end());
+	return pids;
+}
+
+
+inline bool isRunning(int pid) {
+	return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+
+/**
+ * Formats a duration as e.g. 1h02m03s
+ */
+std::string formatSeconds(double seconds) {
+	if (!(seconds >= 0) || seconds > 1e8) return "-";
+	long s = long(seconds + 0.5);
+	char buffer[32];
+	if (s >= 3600) snprintf(buffer, sizeof(buffer), "%ldh%02ldm%02lds", s / 3600, s / 60 % 60, s % 60);
+	else if (s >= 60) snprintf(buffer, sizeof(buffer), "%ldm%02lds", s / 60, s % 60);
+	else snprintf(buffer, sizeof(buffer), "%lds", s);
+	return buffer;
+}
+
+
+/**
+ * Prints the table of the runs of all attached processes
+ */
+void printTable(const std::vector<Attachment>& attachments, bool all) {
+	for (auto& a : attachments) {
+		std::vector<Monitor::Progress> runs;
+		int finished = 0, solved = 0;
+		for (uint32_t i = 0; i < Monitor::SlotCount; ++i) {
+			Monitor::Progress p;
+			if (!Monitor::read(a.region->slots[i], p) || p.status == Monitor::Free) continue;
+			if (p.status == Monitor::Finished) {
+				++finished;
+				solved += strcmp(p.stopReason, "solved") == 0;
+				if (!all) continue;
+			}
+			runs.push_back(p);
+		}
+		// running runs first, then by name and seed
+		std::sort(runs.begin(), runs.end(), [](const Monitor::Progress& x, const Monitor::Progress& y) {
+			if (x.status != y.status) return x.status < y.status;
+			int names = strcmp(x.name, y.name);
+			return names != 0 ? names < 0 : x.seed < y.seed;
+		});
+
+		bool running = isRunning(a.pid);
+		printf("Process %d%s, started %s ago: %d running, %d finished (%d solved)\n", a.pid, running ? "" : " (not running)",
+			formatSeconds(double(time(nullptr) - a.region->startTime)).c_str(), int(std::count_if(runs.begin(), runs.end(), [](const Monitor::Progress& p) { return p.status == Monitor::Running; })), finished, solved);
+		printf("%-16s %6s %13s %12s %12s %9s %8s %10s %10s %s\n", "problem", "seed", "generation", "fitness", "evals/s", "mean size", "restarts", "elapsed", "eta", "status");
+		for (auto& p : runs) {
+			std::string generation = std::to_string(p.generation) + "/" + std::to_string(p.maxGeneration);
+			printf("%-16s %6d %13s %12.4g %12.0f %9.1f %8d %10s %10s %s\n", p.name, p.seed, generation.c_str(), p.fitness, p.evaluationsPerSecond, p.meanSize, p.restarts,
+				formatSeconds(p.seconds).c_str(), p.status == Monitor::Running && running ? formatSeconds(p.eta).c_str() : "",
+				p.status == Monitor::Finished ? p.stopReason : running ? "running" : "interrupted");
+		}
+		printf("\n");
+	}
+}
+
+
+
+int main(int argc, char** argv) {
+
+	Config config;
+	double interval;
+	int selectedPid;
+	try {
+		config.parseArguments(argc, argv);
+		for (auto& key : config.unknownKeys({ "pid", "interval", "once", "all", "clean" })) {
+			fprintf(stderr, "Unknown setting: %s\n", key.c_str());
+			throw "Unknown setting";
+		}
+		interval = Config::parseNumber("interval", config.get("interval", "1"), 0, HUGE_VAL);
+		selectedPid = config.getInt("pid", 0, 1);
+	} catch (const char* e) {
+		fprintf(stderr, "%s\n", e);
+		return 1;
+	}
+	bool once = config.has("once");
+	bool all = config.has("all");
+
+	if (config.has("clean")) {
+		for (int pid : findProcesses()) {
+			if (!isRunning(pid)) {
+				shm_unlink(Monitor::regionName(pid).c_str());
+				printf("Removed the region of process %d\n", pid);
+			}
+		}
+		return 0;
+	}
+
+	std::vector<Attachment> attachments;
+	while (true) {
+		// attach to processes started since the last refresh (regions are never unmapped: a finished process keeps showing its last state)
+		std::vector<int> pids;
+		if (config.has("pid")) pids.push_back(selectedPid);
+		else pids = findProcesses();
+		for (int pid : pids) {
+			if (std::any_of(attachments.begin(), attachments.end(), [pid](const Attachment& a) { return a.pid == pid; })) continue;
+			if (const Monitor::Region* region = attach(pid)) {
+				attachments.push_back({ pid, region });
+			}
+		}
+
+		if (!once) {
+			printf("\x1b[H\x1b[2J"); // clear the terminal
+		}
+		if (attachments.empty()) {
+			printf("No solver process found%s\n", config.has("pid") ? "" : " (runs publish their progress with MONITOR or --monitor=true)");
+		} else {
+			printTable(attachments, all);
+		}
+		fflush(stdout);
+		if (once) break;
+		std::this_thread::sleep_for(std::chrono::duration<double>(interval));
+	}
+	return attachments.empty() ? 1 : 0;
+}
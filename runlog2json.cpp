@@ -0,0 +1,37 @@
+// Converts binary run logs (written by main with BINARY_LOG or --binaryLog=true) to the json format read by index.html
+// Usage: runlog2json file.runlog [file2.runlog ...], which writes file.json next to each log
+
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "GrammarDecoder.h"
+#include "RunLog.h"
+
+
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s file.runlog [file2.runlog ...]\n", argv[0]);
+		return 1;
+	}
+
+	int failures = 0;
+	for (int i = 1; i < argc; ++i) {
+		std::string input = argv[i];
+		std::string output = input.substr(0, input.rfind(".runlog")) + ".json";
+		std::vector<char> data;
+		try {
+			if (!FileWriter::ReadBinary(input, data)) {
+				throw "Could not open file";
+			}
+			JsonRunLog<double> json(output);
+			replayRunLog<double>(data, json);
+			printf("%s -> %s\n", input.c_str(), output.c_str());
+		} catch (const char* e) {
+			fprintf(stderr, "%s: %s\n", input.c_str(), e);
+			++failures;
+		}
+	}
+	return failures > 0 ? 1 : 0;
+}